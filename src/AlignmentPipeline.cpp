@@ -0,0 +1,257 @@
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <utility>
+#include <stdexcept>
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/ref.hpp>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+#include "configuration.hpp"
+#include "AlignmentPipeline.hpp"
+#include "input_file.hpp"
+
+using namespace std;
+namespace fs = boost::filesystem;
+
+namespace trtok {
+
+namespace {
+
+// save_events caches the events in the file at events_path. They are
+// written to a temporary file first, so that the cache never holds events
+// which were only partially written. A failure only means the events will
+// not be cached.
+void save_events(MaxentTrainer const &events, string const &events_path) {
+  ostringstream temp_path;
+  temp_path << events_path << ".tmp." << boost::this_thread::get_id();
+  try {
+    events.save_events(temp_path.str());
+    fs::rename(temp_path.str(), events_path);
+  } catch (runtime_error const &exc) {
+    cerr << exc.what() << " The events will not be cached." << endl;
+    boost::system::error_code error;
+    fs::remove(temp_path.str(), error);
+  }
+}
+
+}
+
+
+AlignmentPipeline::AlignmentPipeline(
+        classifier_mode_t mode,
+        IRoughLexerWrapper *rough_lexer_wrapper_p,
+        string const &input_encoding,
+        bool remove_xml,
+        bool remove_xml_perm,
+        bool expand_entities,
+        bool expand_entities_perm,
+        int n_basic_properties,
+        vector<pcrecpp::RE> const &regex_properties,
+        multimap<string, int> const &word_to_list_props,
+        vector<string> const &property_names,
+        int precontext,
+        int postcontext,
+        bool *features_mask,
+        vector< vector< pair<int,int> > > const &combined_features,
+        ostream *qa_stream_p,
+        bool collect_questions,
+        Profile *profile_p):
+    m_mode(mode),
+    m_qa_stream_p(qa_stream_p),
+    m_collect_questions(collect_questions && (qa_stream_p != NULL)),
+    m_profile_p(profile_p),
+    m_prefetcher_p(NULL),
+    m_spool_block_size(0),
+    m_n_cached_trainers(0),
+    m_rough_lexer_wrapper_p(rough_lexer_wrapper_p),
+    m_input_pipe(pipes::pipe::limited_capacity),
+    m_input_pipe_to(m_input_pipe),
+    m_input_pipe_from(m_input_pipe),
+    m_input_documents(m_input_pipe_from),
+    m_annot_pipe(pipes::pipe::limited_capacity),
+    m_annot_pipe_to(m_annot_pipe),
+    m_annot_pipe_from(m_annot_pipe),
+    m_annot_documents(m_annot_pipe_from),
+    m_jobs_p(NULL)
+{
+  m_input_cleaner_p = new TextCleaner(&m_input_pipe_to, input_encoding,
+                                      remove_xml, remove_xml_perm,
+                                      expand_entities, expand_entities_perm);
+  m_annot_cleaner_p = new TextCleaner(&m_annot_pipe_to, input_encoding,
+                                      remove_xml, remove_xml_perm,
+                                      expand_entities, expand_entities_perm);
+
+  m_rough_tokenizer_p = new RoughTokenizer(m_rough_lexer_wrapper_p);
+  m_rough_tokenizer_p->setup(&m_input_documents, "UTF-8");
+  m_pipeline.add_filter(profiled(m_profile_p, *m_rough_tokenizer_p,
+                                 ROUGH_TOKENIZER_STAGE));
+
+  m_feature_extractor_p = new FeatureExtractor(n_basic_properties,
+                                               regex_properties,
+                                               word_to_list_props);
+  m_pipeline.add_filter(profiled(m_profile_p, *m_feature_extractor_p,
+                                 FEATURE_EXTRACTOR_STAGE));
+
+  m_classifier_p = new Classifier(mode, property_names, precontext,
+                                  postcontext, features_mask,
+                                  combined_features, qa_stream_p,
+                                  &m_annot_documents);
+  m_classifier_p->set_document_listener(this);
+  if (m_collect_questions) {
+    m_classifier_p->set_qa_stream(&m_questions);
+  }
+  m_pipeline.add_filter(profiled(m_profile_p, *m_classifier_p,
+                                 CLASSIFIER_STAGE));
+}
+
+AlignmentPipeline::~AlignmentPipeline() {
+  m_pipeline.clear();
+  delete m_classifier_p;
+  delete m_feature_extractor_p;
+  delete m_rough_tokenizer_p;
+  delete m_annot_cleaner_p;
+  delete m_input_cleaner_p;
+}
+
+bool AlignmentPipeline::load_cached_events(alignment_job_t &job) {
+  // The trainer holding the cached events is spooled like the trainers of
+  // the extracted events.
+  MaxentTrainer *events_p = new MaxentTrainer();
+  if (!m_spool_prefix.empty()) {
+    ostringstream spool_path;
+    spool_path << m_spool_prefix << ".cached." << m_n_cached_trainers++;
+    events_p->spool_to(spool_path.str() + ".events",
+                       spool_path.str() + ".heldout", m_spool_block_size);
+  }
+  try {
+    events_p->load_events(job.events_file);
+    job.events_p = events_p;
+    return true;
+  } catch (runtime_error const &exc) {
+    cerr << exc.what() << " Extracting the events again." << endl;
+    delete events_p;
+    job.reuse_events = false;
+    return false;
+  }
+}
+
+void AlignmentPipeline::feed_jobs() {
+  size_t job_index;
+  while (m_jobs_p->take(job_index)) {
+    alignment_job_t &job = m_jobs_p->job(job_index);
+    // The events cached by an earlier run are used if there are any.
+    if (job.reuse_events && load_cached_events(job)) {
+      m_jobs_p->finish(job_index);
+      continue;
+    }
+
+    // Announce the job to the Classifier before sending its text,...
+    {
+      boost::mutex::scoped_lock lock(m_documents_mutex);
+      m_documents.push_back(job_index);
+    }
+
+    // open the files,...
+    istream *input_stream_p = open_file(job.input_file);
+    istream *annotated_stream_p = open_file(job.annotated_file);
+
+    // clean them into the pipes...
+    m_input_cleaner_p->setup(input_stream_p);
+    m_annot_cleaner_p->setup(annotated_stream_p);
+    m_annot_worker.post(ProfiledWork<TextCleaner>(*m_annot_cleaner_p,
+                            m_profile_p, TEXT_CLEANER_STAGE));
+    ProfiledWork<TextCleaner>(*m_input_cleaner_p, m_profile_p,
+                              TEXT_CLEANER_STAGE)();
+    m_annot_worker.wait();
+
+    // and close them.
+    if (m_profile_p != NULL) {
+      m_profile_p->add_counts(TEXT_CLEANER_STAGE, 0,
+          fs::file_size(job.input_file) + fs::file_size(job.annotated_file),
+          0);
+    }
+    close_file(job.input_file, input_stream_p);
+    close_file(job.annotated_file, annotated_stream_p);
+  }
+
+  // Closing the pipes ends the run of the pipeline.
+  m_input_cleaner_p->close();
+  m_annot_cleaner_p->close();
+}
+
+void AlignmentPipeline::start_document() {
+  size_t job_index;
+  {
+    boost::mutex::scoped_lock lock(m_documents_mutex);
+    job_index = m_documents.front();
+  }
+  alignment_job_t const &job = m_jobs_p->job(job_index);
+  // The Classifier reads the annotated version of the document.
+  m_annot_documents.next_document();
+  m_classifier_p->setup(job.input_file, job.annotated_file);
+}
+
+void AlignmentPipeline::end_document() {
+  size_t job_index;
+  {
+    boost::mutex::scoped_lock lock(m_documents_mutex);
+    job_index = m_documents.front();
+    m_documents.pop_front();
+  }
+  alignment_job_t &job = m_jobs_p->job(job_index);
+
+  if (m_mode == TRAIN_MODE) {
+    job.events_p = m_classifier_p->release_events();
+    if (!job.events_file.empty()) {
+      save_events(*job.events_p, job.events_file);
+    }
+  }
+  job.stats = m_classifier_p->stats();
+  job.n_tokens = m_classifier_p->n_tokens();
+  if (m_profile_p != NULL) {
+    m_profile_p->add_counts(CLASSIFIER_STAGE, m_classifier_p->n_decisions(),
+                            0, 0);
+  }
+  if (m_collect_questions) {
+    job.questions = m_questions.str();
+    m_questions.str("");
+  }
+  m_jobs_p->finish(job_index);
+}
+
+istream *AlignmentPipeline::open_file(string const &path) {
+  if (m_prefetcher_p != NULL)
+    return m_prefetcher_p->open(path);
+  return open_input_file(path);
+}
+
+void AlignmentPipeline::close_file(string const &path, istream *stream_p) {
+  if (m_prefetcher_p != NULL) {
+    m_prefetcher_p->close(path, stream_p);
+  } else {
+    delete stream_p;
+  }
+}
+
+void AlignmentPipeline::run_jobs(AlignmentJobs &jobs) {
+  m_jobs_p = &jobs;
+  m_input_worker.post(boost::bind(&AlignmentPipeline::feed_jobs, this));
+  m_pipeline.run(WORK_UNIT_COUNT);
+  m_input_worker.wait();
+
+  if (m_profile_p != NULL) {
+    // The Classifier reads the annotated text from its pipe.
+    m_profile_p->add_wait(TEXT_CLEANER_STAGE,
+        m_input_pipe.put_wait_seconds() + m_annot_pipe.put_wait_seconds());
+    m_profile_p->add_wait(ROUGH_TOKENIZER_STAGE,
+                          m_input_pipe.get_wait_seconds());
+    m_profile_p->add_wait(CLASSIFIER_STAGE, m_annot_pipe.get_wait_seconds());
+  }
+}
+
+}
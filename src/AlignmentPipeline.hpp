@@ -0,0 +1,318 @@
+#ifndef ALIGNMENT_PIPELINE_INCLUDE_GUARD
+#define ALIGNMENT_PIPELINE_INCLUDE_GUARD
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <utility>
+#include <boost/thread.hpp>
+#include <boost/noncopyable.hpp>
+#include "tbb/pipeline.h"
+#include <pcrecpp.h>
+
+#include "pipes/pipe.hpp"
+
+#include "roughtok/roughtok_wrapper.hpp"
+#include "TextCleaner.hpp"
+#include "RoughTokenizer.hpp"
+#include "DocumentStream.hpp"
+#include "FeatureExtractor.hpp"
+#include "Classifier.hpp"
+#include "MaxentTrainer.hpp"
+#include "evaluation_stats.hpp"
+#include "Profile.hpp"
+#include "WorkerThread.hpp"
+#include "FilePrefetcher.hpp"
+
+namespace trtok {
+
+/* A pair of an input file and its annotated version to be processed in the
+   'train' or 'evaluate' modes, along with the results of processing it. */
+struct alignment_job_t {
+  std::string input_file;
+  std::string annotated_file;
+  bool heldout;
+  // The file caching the events extracted in 'train' mode, or empty.
+  std::string events_file;
+  // Whether the events are read from events_file instead of being
+  // extracted. It is cleared if the file cannot be read.
+  bool reuse_events;
+
+  // Results
+  bool done;
+  // The events extracted in 'train' mode.
+  MaxentTrainer *events_p;
+  // The outcomes of the decisions in 'evaluate' mode.
+  evaluation_stats_t stats;
+  size_t n_tokens;
+  // The questions and answers, if they are collected per file.
+  std::string questions;
+
+  alignment_job_t(std::string const &input_file_,
+                  std::string const &annotated_file_,
+                  bool heldout_,
+                  std::string const &events_file_,
+                  bool reuse_events_):
+    input_file(input_file_),
+    annotated_file(annotated_file_),
+    heldout(heldout_),
+    events_file(events_file_),
+    reuse_events(reuse_events_),
+    done(false),
+    events_p(NULL),
+    n_tokens(0)
+  {}
+};
+
+/* AlignmentJobs is the list of file pairs shared by all the AlignmentPipelines
+   running concurrently. The pipelines take the jobs in order and the results
+   are collected in order as well, so that they do not depend on the number
+   of pipelines or on which pipeline processed which file. The results of
+   the jobs taken but not merged yet are kept in memory, so the number of
+   such jobs can be limited. */
+class AlignmentJobs: private boost::noncopyable {
+
+public:
+    AlignmentJobs(): m_next_job(0), m_n_merged(0), m_max_pending(0) {}
+
+    // limit_pending makes take wait while max_pending jobs have been taken
+    // and their results have not been merged, 0 means no limit.
+    void limit_pending(size_t max_pending) {
+      boost::mutex::scoped_lock lock(m_mutex);
+      m_max_pending = max_pending;
+    }
+
+    // add must only be called before any pipeline is started.
+    void add(std::string const &input_file,
+             std::string const &annotated_file,
+             bool heldout,
+             std::string const &events_file = "",
+             bool reuse_events = false) {
+      m_jobs.push_back(alignment_job_t(input_file, annotated_file, heldout,
+                                       events_file, reuse_events));
+    }
+
+    size_t size() const { return m_jobs.size(); }
+
+    // restart makes all the jobs available for processing again, after
+    // their results have been collected.
+    void restart() {
+      boost::mutex::scoped_lock lock(m_mutex);
+      for (size_t j = 0; j != m_jobs.size(); j++) {
+        m_jobs[j].done = false;
+      }
+      m_next_job = 0;
+      m_n_merged = 0;
+    }
+
+    // take gives the index of the next job to be processed and returns
+    // false when there are none left. If the number of pending jobs is
+    // limited, it blocks until enough of the taken jobs are merged.
+    bool take(size_t &job_index) {
+      boost::mutex::scoped_lock lock(m_mutex);
+      while ((m_max_pending != 0) && (m_next_job < m_jobs.size())
+             && (m_next_job - m_n_merged >= m_max_pending)) {
+        m_job_merged.wait(lock);
+      }
+      if (m_next_job == m_jobs.size())
+        return false;
+      job_index = m_next_job++;
+      std::clog << "trtok: Processing file " << m_jobs[job_index].input_file
+                << std::endl;
+      return true;
+    }
+
+    alignment_job_t &job(size_t job_index) {
+      return m_jobs[job_index];
+    }
+
+    // finish marks the job as done, its results must already be filled in.
+    void finish(size_t job_index) {
+      boost::mutex::scoped_lock lock(m_mutex);
+      m_jobs[job_index].done = true;
+      m_job_done.notify_all();
+    }
+
+    // wait_for blocks until the job is done and returns it.
+    alignment_job_t &wait_for(size_t job_index) {
+      boost::mutex::scoped_lock lock(m_mutex);
+      while (!m_jobs[job_index].done) {
+        m_job_done.wait(lock);
+      }
+      return m_jobs[job_index];
+    }
+
+    // merged tells the waiting pipelines that the results of the next job
+    // in order have been merged and released.
+    void merged() {
+      boost::mutex::scoped_lock lock(m_mutex);
+      m_n_merged++;
+      m_job_merged.notify_all();
+    }
+
+private:
+    std::vector<alignment_job_t> m_jobs;
+    size_t m_next_job;
+    // The number of jobs whose results have been merged, in order.
+    size_t m_n_merged;
+    size_t m_max_pending;
+    boost::mutex m_mutex;
+    boost::condition_variable m_job_done;
+    boost::condition_variable m_job_merged;
+};
+
+/* AlignmentPipeline bundles everything needed to align an input file with its
+   annotated version in the 'train' and 'evaluate' modes: the TextCleaners
+   and pipes for both of the files, the RoughTokenizer, the FeatureExtractor
+   and the Classifier. Every instance has its own rough lexer, so several
+   AlignmentPipelines can process different files at the same time. The
+   files of all the jobs an instance takes flow through a single run of its
+   pipeline, one document after another: they are cleaned in its
+   WorkerThreads and the results of every document are collected as soon
+   as the Classifier has finished it. */
+class AlignmentPipeline: public DocumentListener,
+                         private boost::noncopyable {
+
+public:
+    AlignmentPipeline(/* Either TRAIN_MODE or EVALUATE_MODE. */
+                      classifier_mode_t mode,
+                      /* A rough lexer to be used only by this pipeline. */
+                      IRoughLexerWrapper *rough_lexer_wrapper_p,
+                      /* The settings of the TextCleaners,
+                         see TextCleaner. */
+                      std::string const &input_encoding,
+                      bool remove_xml,
+                      bool remove_xml_perm,
+                      bool expand_entities,
+                      bool expand_entities_perm,
+                      /* The settings of the FeatureExtractor,
+                         see FeatureExtractor. */
+                      int n_basic_properties,
+                      std::vector<pcrecpp::RE> const &regex_properties,
+                      std::multimap<std::string, int> const
+                        &word_to_list_props,
+                      /* The settings of the Classifier, see Classifier. */
+                      std::vector<std::string> const &property_names,
+                      int precontext,
+                      int postcontext,
+                      bool *features_mask,
+                      std::vector< std::vector< std::pair<int,int> > > const
+                        &combined_features,
+                      /* The stream to which questions and answers are
+                         written, or NULL. */
+                      std::ostream *qa_stream_p,
+                      /* Whether the questions and answers should be
+                         collected in the jobs instead of being written
+                         directly to the stream. */
+                      bool collect_questions,
+                      /* Where the time spent in the stages is recorded,
+                         or NULL. */
+                      Profile *profile_p = NULL);
+
+    ~AlignmentPipeline();
+
+    void load_model(std::string const &model_path) {
+      m_classifier_p->load_model(model_path);
+    }
+
+    void load_compact_model(std::string const &model_path) {
+      m_classifier_p->load_compact_model(model_path);
+    }
+
+    void hash_features(size_t n_buckets) {
+      m_classifier_p->hash_features(n_buckets);
+    }
+
+    void binary_questions(bool binary) {
+      m_classifier_p->binary_questions(binary);
+    }
+
+    // prefetch_from makes the pipeline open the files through a
+    // FilePrefetcher, which reads them ahead.
+    void prefetch_from(FilePrefetcher *prefetcher_p) {
+      m_prefetcher_p = prefetcher_p;
+    }
+
+    // spool_events_to makes the events of every file in 'train' mode be
+    // kept in spool files until they are merged, see
+    // Classifier::spool_events_to.
+    void spool_events_to(std::string const &spool_prefix,
+                         size_t block_size) {
+      m_spool_prefix = spool_prefix;
+      m_spool_block_size = block_size;
+      m_classifier_p->spool_events_to(spool_prefix, block_size);
+    }
+
+    // run_jobs processes jobs until there are none left and stores their
+    // results in them. In 'train' mode, the events are read from a job's
+    // events file instead, if it is to be reused, or they are written to
+    // it. It is meant to be run in its own thread.
+    void run_jobs(AlignmentJobs &jobs);
+
+    // start_document and end_document are called by the Classifier, they
+    // set it up for the next job and collect the results of the job.
+    virtual void start_document();
+    virtual void end_document();
+
+private:
+    // feed_jobs takes the jobs and cleans their files into the pipes, it
+    // is run by the input worker.
+    void feed_jobs();
+    // load_cached_events reads the events of a job from its events file,
+    // it returns false if they cannot be read.
+    bool load_cached_events(alignment_job_t &job);
+    std::istream *open_file(std::string const &path);
+    void close_file(std::string const &path, std::istream *stream_p);
+
+private:
+    // Configuration
+    classifier_mode_t m_mode;
+    std::ostream *m_qa_stream_p;
+    bool m_collect_questions;
+    Profile *m_profile_p;
+    FilePrefetcher *m_prefetcher_p;
+    // Where the trainers of the cached events are spooled, or empty, see
+    // spool_events_to.
+    std::string m_spool_prefix;
+    size_t m_spool_block_size;
+    size_t m_n_cached_trainers;
+
+    // Components
+    IRoughLexerWrapper *m_rough_lexer_wrapper_p;
+
+    pipes::pipe m_input_pipe;
+    pipes::opipestream m_input_pipe_to;
+    pipes::ipipestream m_input_pipe_from;
+    DocumentStream m_input_documents;
+    TextCleaner *m_input_cleaner_p;
+
+    pipes::pipe m_annot_pipe;
+    pipes::opipestream m_annot_pipe_to;
+    pipes::ipipestream m_annot_pipe_from;
+    DocumentStream m_annot_documents;
+    TextCleaner *m_annot_cleaner_p;
+
+    RoughTokenizer *m_rough_tokenizer_p;
+    FeatureExtractor *m_feature_extractor_p;
+    Classifier *m_classifier_p;
+
+    tbb::pipeline m_pipeline;
+
+    WorkerThread m_input_worker;
+    WorkerThread m_annot_worker;
+
+    // State
+    AlignmentJobs *m_jobs_p;
+    // The jobs fed to the pipeline and not yet finished by the Classifier.
+    std::deque<size_t> m_documents;
+    boost::mutex m_documents_mutex;
+    // The questions and answers of the current job, if they are collected.
+    std::ostringstream m_questions;
+};
+
+}
+
+#endif
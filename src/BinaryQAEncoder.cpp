@@ -0,0 +1,81 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <utility>
+
+#include "BinaryQAEncoder.hpp"
+#include "EventSpool.hpp"
+#include "evaluation_stats.hpp"
+
+using namespace std;
+
+namespace trtok {
+
+namespace {
+
+void write_uint32_le(ostream &out, uint32_t value) {
+  char bytes[4];
+  for (int b = 0; b != 4; b++) {
+    bytes[b] = (char)((value >> (8 * b)) & 0xff);
+  }
+  out.write(bytes, 4);
+}
+
+}
+
+void write_binary_qa_header(ostream &out) {
+  out.write("trtokqa\0", 8);
+  write_uint32_le(out, BINARY_QA_VERSION);
+}
+
+void BinaryQAEncoder::write_question(ostream &out, int line,
+                                     string const &predicted_outcome,
+                                     string const &true_outcome,
+                                     vector< pair<string,float> > const
+                                       &context) {
+  if (!m_file_started) {
+    out.put('F');
+    write_string(out, m_filename);
+    m_pred_ids.clear();
+    m_file_started = true;
+  }
+
+  out.put('Q');
+  write_varint(out, line);
+  out.put((char)outcome_from_name(predicted_outcome));
+  out.put((char)outcome_from_name(true_outcome));
+  write_varint(out, context.size());
+
+  for (vector< pair<string,float> >::const_iterator
+       feature = context.begin(); feature != context.end(); feature++) {
+    bool has_value = (feature->second != 1.0);
+    boost::unordered_map<string, uint32_t>::const_iterator pred_it =
+      m_pred_ids.find(feature->first);
+    if (pred_it != m_pred_ids.end()) {
+      write_varint(out, ((uint64_t)pred_it->second << 1) | has_value);
+    } else {
+      uint32_t id = m_pred_ids.size();
+      m_pred_ids[feature->first] = id;
+      write_varint(out, ((uint64_t)id << 1) | has_value);
+      write_string(out, feature->first);
+    }
+    if (has_value) {
+      write_uint32_le(out, float_to_word(feature->second));
+    }
+  }
+}
+
+void BinaryQAEncoder::write_varint(ostream &out, uint64_t value) {
+  while (value >= 0x80) {
+    out.put((char)((value & 0x7f) | 0x80));
+    value >>= 7;
+  }
+  out.put((char)value);
+}
+
+void BinaryQAEncoder::write_string(ostream &out, string const &str) {
+  write_varint(out, str.length());
+  out.write(str.data(), str.length());
+}
+
+}
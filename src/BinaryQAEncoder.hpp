@@ -0,0 +1,70 @@
+#ifndef BINARY_QA_ENCODER_INCLUDE_GUARD
+#define BINARY_QA_ENCODER_INCLUDE_GUARD
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <utility>
+#include <boost/unordered_map.hpp>
+#include <boost/cstdint.hpp>
+typedef boost::uint32_t uint32_t;
+typedef boost::uint64_t uint64_t;
+
+namespace trtok {
+
+// The version of the binary format of questions and answers.
+uint32_t const BINARY_QA_VERSION = 1;
+
+// write_binary_qa_header writes the header which starts every file of
+// questions and answers in the binary format.
+void write_binary_qa_header(std::ostream &out);
+
+/* BinaryQAEncoder writes the questions and answers in a compact binary
+   format instead of the text format used by default. The file starts with
+   the magic "trtokqa\0" and the version of the format as a 32-bit
+   little-endian integer, then a sequence of records follows:
+
+     'F' name       All the following questions come from the file name.
+                    Resets the dictionary of predicates.
+     'Q' line predicted true n_features features...
+                    A question, the outcomes are single bytes (outcome_t,
+                    0 for none, 1 for SPLIT, 2 for JOIN and 3 for
+                    BREAK_SENTENCE).
+
+   Every feature is written as the varint (id << 1 | has_value), followed by
+   the value as a 32-bit little-endian float if has_value is set (the value
+   is 1.0 otherwise). A predicate id equal to the number of predicates seen
+   since the last 'F' record introduces a new predicate whose name follows.
+   Integers are varints (7 bits per byte, least significant first), strings
+   are their varint length followed by their bytes. The python/qa2text.py
+   script converts the binary format to the text format. */
+class BinaryQAEncoder {
+
+public:
+    BinaryQAEncoder(): m_file_started(false) {}
+
+    // start_file makes the following questions belong to filename. The 'F'
+    // record is written along with the first of them.
+    void start_file(std::string const &filename) {
+      m_filename = filename;
+      m_file_started = false;
+    }
+
+    void write_question(std::ostream &out, int line,
+                        std::string const &predicted_outcome,
+                        std::string const &true_outcome,
+                        std::vector< std::pair<std::string,float> > const
+                          &context);
+
+private:
+    static void write_varint(std::ostream &out, uint64_t value);
+    static void write_string(std::ostream &out, std::string const &str);
+
+    std::string m_filename;
+    bool m_file_started;
+    boost::unordered_map<std::string, uint32_t> m_pred_ids;
+};
+
+}
+
+#endif
@@ -0,0 +1,82 @@
+#include <iostream>
+#include <streambuf>
+#include <string>
+
+#include "BlockBuffer.hpp"
+
+using namespace std;
+
+namespace trtok {
+
+BlockBuffer::BlockBuffer(BlockQueue &queue, ios_base::openmode mode,
+                         size_t block_size):
+    m_queue(queue),
+    m_mode(mode),
+    m_block_size(block_size),
+    m_block_position(0)
+{
+  if (m_mode & ios_base::out) {
+    m_block.assign(m_block_size, '\0');
+    setp(&m_block[0], &m_block[0] + m_block.size());
+  }
+}
+
+void BlockBuffer::hand_over() {
+  size_t n_written = pptr() - pbase();
+  if (n_written == 0)
+    return;
+  m_block.resize(n_written);
+  m_queue.push_block(m_block);
+  m_block_position += n_written;
+  m_block.assign(m_block_size, '\0');
+  setp(&m_block[0], &m_block[0] + m_block.size());
+}
+
+BlockBuffer::int_type BlockBuffer::underflow() {
+  if (!(m_mode & ios_base::in))
+    return traits_type::eof();
+  if (gptr() < egptr())
+    return traits_type::to_int_type(*gptr());
+  streamoff block_size = m_block.size();
+  if (!m_queue.pop_block(m_block))
+    return traits_type::eof();
+  m_block_position += block_size;
+  setg(&m_block[0], &m_block[0], &m_block[0] + m_block.size());
+  return traits_type::to_int_type(*gptr());
+}
+
+BlockBuffer::int_type BlockBuffer::overflow(int_type c) {
+  if (!(m_mode & ios_base::out))
+    return traits_type::eof();
+  hand_over();
+  if (!traits_type::eq_int_type(c, traits_type::eof())) {
+    *pptr() = traits_type::to_char_type(c);
+    pbump(1);
+  }
+  return traits_type::not_eof(c);
+}
+
+int BlockBuffer::sync() {
+  if (m_mode & ios_base::out)
+    hand_over();
+  return 0;
+}
+
+BlockBuffer::pos_type BlockBuffer::seekoff(off_type off,
+                                           ios_base::seekdir dir,
+                                           ios_base::openmode which) {
+  // Only telling the position is supported.
+  if ((off != 0) || (dir != ios_base::cur) || !(which & m_mode))
+    return pos_type(off_type(-1));
+  if (m_mode & ios_base::out)
+    return pos_type(m_block_position + (pptr() - pbase()));
+  return pos_type(m_block_position + (gptr() - eback()));
+}
+
+BlockBuffer::pos_type BlockBuffer::seekpos(pos_type pos,
+                                           ios_base::openmode which) {
+  pos_type current = seekoff(0, ios_base::cur, which);
+  return (pos == current) ? current : pos_type(off_type(-1));
+}
+
+}
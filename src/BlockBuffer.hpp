@@ -0,0 +1,64 @@
+#ifndef BLOCK_BUFFER_INCLUDE_GUARD
+#define BLOCK_BUFFER_INCLUDE_GUARD
+
+#include <iostream>
+#include <streambuf>
+#include <string>
+
+namespace trtok {
+
+/* BlockQueue is the other end of a BlockBuffer, usually a queue of blocks
+   served by a background thread. A stream written in blocks implements
+   push_block, a stream read in blocks implements pop_block. */
+class BlockQueue {
+
+public:
+    virtual ~BlockQueue() {}
+
+    // push_block takes over a block written to the stream, block is
+    // swapped with an empty string.
+    virtual void push_block(std::string &block) {}
+
+    // pop_block swaps the next block to be read with block, or returns
+    // false if there are no more blocks.
+    virtual bool pop_block(std::string &block) { return false; }
+};
+
+/* BlockBuffer is the stream buffer of the streams which hand their data
+   over to a BlockQueue, or take them from it, in large blocks. Data written
+   to the buffer are collected in a block of block_size bytes, which is
+   pushed to the queue when it is full, when the stream is flushed or when
+   hand_over is called. Data read from the buffer come from the blocks
+   popped from the queue. The position in the data can be told but not
+   changed. */
+class BlockBuffer: public std::streambuf {
+
+public:
+    // The mode is either std::ios_base::in or std::ios_base::out, the
+    // block_size only matters for the latter.
+    BlockBuffer(BlockQueue &queue, std::ios_base::openmode mode,
+                size_t block_size = 0);
+
+    // hand_over pushes the data written so far to the queue.
+    void hand_over();
+
+protected:
+    virtual int_type underflow();
+    virtual int_type overflow(int_type c);
+    virtual int sync();
+    virtual pos_type seekoff(off_type off, std::ios_base::seekdir dir,
+                             std::ios_base::openmode which);
+    virtual pos_type seekpos(pos_type pos, std::ios_base::openmode which);
+
+private:
+    BlockQueue &m_queue;
+    std::ios_base::openmode m_mode;
+    std::string m_block;
+    size_t m_block_size;
+    // The position of the current block in the data.
+    std::streamoff m_block_position;
+};
+
+}
+
+#endif
@@ -1,18 +1,19 @@
 #include <iostream>
 #include <string>
 #include <vector>
+#include <algorithm>
+#include <stdexcept>
 #include <boost/lexical_cast.hpp>
 
 #include "Classifier.hpp"
 #include "token_t.hpp"
 #include "utils.hpp"
+#include "feature_hash.hpp"
 #include "alignment_exception.hpp"
 
 using namespace std;
 
-#define WINDOW_OFFSET(offset) ((m_center_token + offset < 0) ?\
-(((m_center_token + offset) % m_window_size) + m_window_size) :\
-((m_center_token + offset) % m_window_size))
+#define WINDOW_SLOT(offset) ((m_center_token + (offset)) & (m_ring_size - 1))
 
 #define CHECK_DECISION_FLAG(flag) {\
   if (questioned_token.decision_flags & flag##_FLAG) {\
@@ -26,9 +27,9 @@ using namespace std;
 namespace trtok {
 
 
-void Classifier::process_center_token(chunk_t *out_chunk_p) {
+void Classifier::process_center_token() {
 
-  token_t &center_token = m_window[m_center_token];
+  token_t &center_token = *m_window[m_center_token];
 
   if (center_token.text == "") {
     return;
@@ -38,6 +39,7 @@ void Classifier::process_center_token(chunk_t *out_chunk_p) {
    || (center_token.decision_flags & MAY_JOIN_FLAG)
    || (center_token.decision_flags & MAY_BREAK_SENTENCE_FLAG)) {
 
+    m_n_decisions++;
     int n_predicate_properties = center_token.property_flags.size();
     int length_property = n_predicate_properties;
     int word_property = n_predicate_properties + 1;
@@ -47,9 +49,8 @@ void Classifier::process_center_token(chunk_t *out_chunk_p) {
     // Simple features
     for (int offset = -m_precontext; offset != m_postcontext + 1; offset++) {
 
-      int window_offset = WINDOW_OFFSET(offset);
       string offset_str = boost::lexical_cast<string>(offset) + ":";
-      token_t &questioned_token = m_window[window_offset];
+      token_t &questioned_token = *m_window[WINDOW_SLOT(offset)];
 
       // end of input marks
       if (questioned_token.text == "") {
@@ -107,77 +108,65 @@ void Classifier::process_center_token(chunk_t *out_chunk_p) {
     }
 
     // combined features
-    for (vector< vector< pair<int,int> > >::const_iterator
-         combined_feature = m_combined_features.begin();
-         combined_feature != m_combined_features.end();
+    // The strings of the combined features are only built when they are
+    // needed: for the Maxent toolkit's model, for training (unless the
+    // features are hashed) and for the questions and answers. Otherwise,
+    // only their hashes are computed and handed to the model directly.
+    bool compact_lookup = m_compact_model.is_loaded()
+                          && (m_n_feature_buckets == 0);
+    bool combined_as_strings = (m_qa_stream_p != NULL)
+        || ((m_n_feature_buckets == 0) && !compact_lookup);
+    m_combined_hashes.clear();
+    string feature_string;
+    for (vector<CombinedFeatureTemplate>::const_iterator
+         combined_feature = m_combined_templates.begin();
+         combined_feature != m_combined_templates.end();
          combined_feature++) {
-      
-      string feature_string = "(";
-      bool crossed_end_of_input = false;
-
-      for (vector< pair<int,int> >::const_iterator
-           constituent_feature = combined_feature->begin();
-           constituent_feature != combined_feature->end();
-           constituent_feature++) {
-
-        int offset = constituent_feature->first;
-        int window_offset = WINDOW_OFFSET(offset);
-        token_t &questioned_token = m_window[window_offset];
-        string offset_str = boost::lexical_cast<string>(offset);
-
-        if (questioned_token.text == "") {
-          crossed_end_of_input = true;
-          break;
-        }
-        
-        int property = constituent_feature->second;
-        string property_name = m_property_names[property];
-        string single_feature_string = offset_str + ":"
-                                          + property_name + "=";
-
-        if (property < n_predicate_properties) {
-          single_feature_string +=
-              questioned_token.property_flags[property] ? "1.0" : "0.0";
-        } else if (property == length_property) {
-          single_feature_string +=
-              boost::lexical_cast<string>(questioned_token.text.length());
-        } else if (property == word_property) {
-          single_feature_string +=
-              questioned_token.text;
-        }
-
-        if (feature_string != "(") {
-          feature_string += "^";
-        }
-        feature_string += single_feature_string;
+      uint64_t hash;
+      if (!combined_feature->instantiate(m_window, m_center_token,
+                                         m_ring_size - 1, hash,
+                                         combined_as_strings ?
+                                           &feature_string : NULL)) {
+        continue;
       }
-
-      feature_string += ")";
-
-      if (!crossed_end_of_input) {
+      if (combined_as_strings) {
         context.push_back(make_pair(feature_string, 1.0));
+      } else {
+        m_combined_hashes.push_back(hash);
       }
     }
 
 
+    // In the hashed-feature mode, the model only sees the buckets.
+    vector< pair<string,float> > const &model_context =
+      (m_n_feature_buckets > 0) ? hash_context(context) : context;
+
+    outcome_t true_outcome_id = NO_OUTCOME;
     string true_outcome;
     string predicted_outcome;
 
     if ((m_mode == TRAIN_MODE) || (m_mode == EVALUATE_MODE)) {
       if (center_token.decision_flags & DO_BREAK_SENTENCE_FLAG) {
-        true_outcome = "BREAK_SENTENCE";
+        true_outcome_id = BREAK_SENTENCE_OUTCOME;
       } else if ((center_token.decision_flags & DO_SPLIT_FLAG)
              || ((center_token.n_newlines >= 0)
                 && !(center_token.decision_flags & DO_JOIN_FLAG))) {
-        true_outcome = "SPLIT";
+        true_outcome_id = SPLIT_OUTCOME;
       }
       else {
-        true_outcome = "JOIN";
+        true_outcome_id = JOIN_OUTCOME;
       }
+      true_outcome = outcome_names[true_outcome_id];
     }
 
     if ((m_mode == TOKENIZE_MODE) || (m_mode == EVALUATE_MODE)) {
-      predicted_outcome = m_model.predict(context);
+      if (compact_lookup) {
+        predicted_outcome = m_compact_model.predict(feature_hashes(context));
+      } else if (m_compact_model.is_loaded()) {
+        predicted_outcome = m_compact_model.predict(model_context);
+      } else {
+        predicted_outcome = m_model.predict(model_context);
+      }
     }
 
     if (m_mode == PREPARE_MODE) {
@@ -191,12 +180,7 @@ void Classifier::process_center_token(chunk_t *out_chunk_p) {
       }
     }
     else if (m_mode == TRAIN_MODE) {
-      if (m_processing_heldout_data) {
-        m_model.add_heldout_event(context, true_outcome);
-      } else {
-        m_model.add_event(context, true_outcome);
-      }
-      m_n_events_registered++;
+      m_trainer_p->add_event(model_context, true_outcome);
     }
     else if (m_mode == TOKENIZE_MODE) {
       if ((predicted_outcome == "BREAK_SENTENCE")
@@ -216,8 +200,17 @@ void Classifier::process_center_token(chunk_t *out_chunk_p) {
               (center_token.decision_flags | DO_JOIN_FLAG);
       }
     }
+    else if (m_mode == EVALUATE_MODE) {
+      m_stats.add(outcome_from_name(predicted_outcome), true_outcome_id,
+                  center_token.decision_flags & MAY_BREAK_SENTENCE_FLAG,
+                  center_token.decision_flags
+                    & (MAY_SPLIT_FLAG | MAY_JOIN_FLAG));
+    }
 
-    if (m_qa_stream_p != NULL) {
+    if ((m_qa_stream_p != NULL) && m_binary_questions) {
+      m_qa_encoder.write_question(*m_qa_stream_p, m_center_token_line,
+                                  predicted_outcome, true_outcome, context);
+    } else if (m_qa_stream_p != NULL) {
 
       *m_qa_stream_p << m_processed_filename << ':'
                      << m_center_token_line << '|';
@@ -240,43 +233,212 @@ void Classifier::process_center_token(chunk_t *out_chunk_p) {
         }
       }
 
-      *m_qa_stream_p << endl;
+      // No endl here, the QA stream is flushed at the end of the run.
+      *m_qa_stream_p << '\n';
     }
   }
+}
+
+
+vector< pair<string,float> > const &Classifier::hash_context(
+    vector< pair<string,float> > const &context) {
+  m_hashed_context.clear();
+  for (vector< pair<string,float> >::const_iterator
+       feature = context.begin(); feature != context.end(); feature++) {
+    m_hashed_context.push_back(make_pair(
+          hashed_feature_name(feature->first, m_n_feature_buckets),
+          feature->second));
+  }
+  for (vector<uint64_t>::const_iterator hash = m_combined_hashes.begin();
+       hash != m_combined_hashes.end(); hash++) {
+    m_hashed_context.push_back(make_pair(
+          hashed_feature_name(*hash, m_n_feature_buckets), 1.0f));
+  }
+  return m_hashed_context;
+}
 
-  if (out_chunk_p != NULL) {
-    out_chunk_p->tokens.push_back(center_token);
+
+CompactModel::hashed_context_t const &Classifier::feature_hashes(
+    vector< pair<string,float> > const &context) {
+  m_feature_hashes.clear();
+  for (vector< pair<string,float> >::const_iterator
+       feature = context.begin(); feature != context.end(); feature++) {
+    m_feature_hashes.push_back(make_pair(feature_hash(feature->first),
+                                         feature->second));
+  }
+  for (vector<uint64_t>::const_iterator hash = m_combined_hashes.begin();
+       hash != m_combined_hashes.end(); hash++) {
+    m_feature_hashes.push_back(make_pair(*hash, 1.0f));
   }
+  return m_feature_hashes;
 }
 
 
-void Classifier::process_tokens(vector<token_t> &tokens,
-                                chunk_t *out_chunk_p) {
+void Classifier::push_token(token_t *token_p) {
+  m_center_token = WINDOW_SLOT(1);
+  m_window[WINDOW_SLOT(m_postcontext)] = token_p;
+  process_center_token();
+
+  token_t &center_token = *m_window[m_center_token];
+  m_center_token_line += max(0, center_token.n_newlines);
+  if (&center_token != &m_end_token) {
+    m_n_decided++;
+    m_n_tokens++;
+  }
+}
+
+void Classifier::process_tokens(vector<token_t> &tokens) {
   for (vector<token_t>::iterator token = tokens.begin();
        token != tokens.end(); token++) {
-    m_center_token = WINDOW_OFFSET(1);
-    m_window[WINDOW_OFFSET(m_postcontext)] = *token;
-    process_center_token(out_chunk_p);
-    m_center_token_line += max(0, m_window[m_center_token].n_newlines);
+    push_token(&*token);
   }
 }
 
+size_t Classifier::redecide(vector<token_t> &tokens, size_t first,
+                            size_t changed_end) {
+  reset();
+  // The window is filled so that the token before first is in the center.
+  for (int offset = -m_precontext; offset <= m_postcontext; offset++) {
+    long index = (long)first - 1 + offset;
+    m_window[WINDOW_SLOT(offset)] =
+      ((index >= 0) && (index < (long)tokens.size())) ? &tokens[index]
+                                                      : &m_end_token;
+  }
+
+  decision_flags_t const do_flags = (decision_flags_t)
+        (DO_SPLIT_FLAG | DO_JOIN_FLAG | DO_BREAK_SENTENCE_FLAG);
+  size_t n_unchanged = 0;
+  size_t next = first;
+  while (next < tokens.size()) {
+    if ((next >= changed_end + m_precontext)
+        && (n_unchanged >= (size_t)m_precontext))
+      break;
+
+    token_t &token = tokens[next];
+    decision_flags_t old_flags = token.decision_flags;
+    token.decision_flags = (decision_flags_t)(old_flags & ~do_flags);
+
+    size_t incoming = next + m_postcontext;
+    push_token((incoming < tokens.size()) ? &tokens[incoming]
+                                          : &m_end_token);
+
+    if (token.decision_flags == old_flags)
+      n_unchanged++;
+    else
+      n_unchanged = 0;
+    next++;
+  }
+
+  m_n_decided = 0;
+  return next;
+}
+
+
+// swap_tokens exchanges the contents of two tokens without copying
+// their text or properties.
+static void swap_tokens(token_t &a, token_t &b) {
+  a.text.swap(b.text);
+  swap(a.decision_flags, b.decision_flags);
+  swap(a.n_newlines, b.n_newlines);
+  a.property_flags.swap(b.property_flags);
+}
+
+chunk_t *Classifier::release_decided_chunks(bool is_final) {
+  vector<chunk_t*> released;
+  while (!m_chunks.empty()
+      && (m_chunks.front()->tokens.size() <= m_n_decided)) {
+    chunk_t *chunk_p = m_chunks.front();
+    m_chunks.pop_front();
+    m_n_decided -= chunk_p->tokens.size();
+
+    // Tokens of the released chunk which are still in the window are
+    // copied so that they survive the chunk. After the final chunk, the
+    // window is not used anymore.
+    if (!is_final && !chunk_p->tokens.empty()) {
+      token_t *begin = &chunk_p->tokens[0];
+      token_t *end = begin + chunk_p->tokens.size();
+      for (int slot = 0; slot != m_ring_size; slot++) {
+        if ((m_window[slot] >= begin) && (m_window[slot] < end)) {
+          m_carry[slot] = *m_window[slot];
+          m_window[slot] = &m_carry[slot];
+        }
+      }
+    }
+
+    released.push_back(chunk_p);
+  }
+
+  if ((m_mode == TRAIN_MODE) || (m_mode == EVALUATE_MODE)) {
+    for (size_t c = 0; c != released.size(); c++) {
+      delete released[c];
+    }
+    return NULL;
+  }
+
+  // The decided chunks are sent down the pipeline in place. The pipeline
+  // expects a chunk for every chunk received, so we send an empty one if
+  // nothing has been decided yet and merge the chunks if there are more.
+  if (released.empty()) {
+    return new chunk_t;
+  }
+  chunk_t *out_chunk_p = released[0];
+  if (released.size() > 1) {
+    size_t n_tokens = 0;
+    for (size_t c = 0; c != released.size(); c++) {
+      n_tokens += released[c]->tokens.size();
+    }
+    vector<token_t> tokens;
+    tokens.reserve(n_tokens);
+    for (size_t c = 0; c != released.size(); c++) {
+      for (vector<token_t>::iterator token = released[c]->tokens.begin();
+           token != released[c]->tokens.end(); token++) {
+        tokens.push_back(token_t());
+        swap_tokens(tokens.back(), *token);
+      }
+      if (c > 0) {
+        delete released[c];
+      }
+    }
+    out_chunk_p->tokens.swap(tokens);
+  }
+  out_chunk_p->is_final = is_final;
+  return out_chunk_p;
+}
 
 
 
 bool Classifier::consume_whitespace() {
   bool line_break = false;
-  do
-  {
-    if (m_annot_char == 0x0A) {
+  uint32_t annot_char;
+  size_t n_bytes;
+  while (is_whitespace(annot_char = peek_annotated(n_bytes))) {
+    if (annot_char == 0x0A) {
       line_break = true;
       m_current_annot_line++;
     }
-    m_annot_char = get_unicode_from_utf8(m_annot_stream_p);
-  } while (is_whitespace(m_annot_char) && (m_annot_stream_p->gcount() > 0));
+    m_annot_reader.advance(n_bytes);
+  }
   return line_break;
 }
 
+// peek_annotated decodes the next character of the annotated data. Malformed
+// or truncated UTF-8 is reported and read as a replacement character standing
+// for its first byte, which then fails to align like any other mismatch.
+uint32_t Classifier::peek_annotated(size_t &n_bytes) {
+  try {
+    return m_annot_reader.peek(n_bytes);
+  } catch (domain_error const &) {
+    if (!m_reported_invalid_annot) {
+      cerr << m_annotated_filename << ":" << m_current_annot_line
+           << ": Warning: Invalid UTF-8 encountered in annotated data."
+           << endl;
+      m_reported_invalid_annot = true;
+    }
+    n_bytes = 1;
+    return 0xFFFD;
+  }
+}
+
 void Classifier::report_alignment_warning(string occurence_type,
                                           string prefix,
                                           string suffix,
@@ -303,44 +465,58 @@ void Classifier::align_chunk_with_solution(chunk_t *in_chunk_p) {
   for (vector<token_t>::iterator token = in_chunk_p->tokens.begin();
        token != in_chunk_p->tokens.end(); token++)
   {
-    basic_string<uint32_t> token_text = utf8_to_unicode(token->text);
-
-    for (size_t i = 0; i != token_text.length(); i++)
+    string const &text = token->text;
+    size_t i = 0;
+    while (i != text.length())
     {
-      if (m_annot_stream_p->gcount() == 0)
+      if (!m_annot_reader.fill(text.length() - i))
         throw alignment_exception((m_annotated_filename
               + ":" + boost::lexical_cast<string>(m_current_annot_line)
               + ": Annotated data truncated!").c_str());
+
+      // The bytes which the token shares with the annotated data are
+      // skipped at once, up to the start of the first character in which
+      // they differ (or which is not wholly available).
+      char const *annot = m_annot_reader.data();
+      size_t n_bytes = min(text.length() - i, m_annot_reader.available());
+      size_t n_common = mismatch(annot, annot + n_bytes, text.data() + i).first
+                        - annot;
+      while ((n_common > 0) && (i + n_common != text.length())
+             && (((uint8_t)text[i + n_common] & 0xC0) == 0x80))
+        n_common--;
+      if (n_common > 0) {
+        m_annot_reader.advance(n_common);
+        i += n_common;
+        continue;
+      }
+
       // An unexpected word break
-      if (is_whitespace(m_annot_char))
+      if (is_whitespace(peek_annotated()))
       {
         bool line_break = consume_whitespace();
 
         report_alignment_warning("word break",
-          unicode_to_utf8(token_text.substr(0, i)),
-          unicode_to_utf8(token_text.substr(i)),
+          text.substr(0, i), text.substr(i),
           "Consider adding a tokenization rule to a *.split file.");
 
         if (line_break)
           report_alignment_warning("sentence break",
-            unicode_to_utf8(token_text.substr(0, i)),
-            unicode_to_utf8(token_text.substr(i)),
+            text.substr(0, i), text.substr(i),
             "Consider adding more sentence terminators or starters.");
       }
       // Different text in the annotated data
-      if (m_annot_char != token_text[i])
+      else
       {
         throw alignment_exception((m_annotated_filename
                 + ":" + boost::lexical_cast<string>(m_current_annot_line)
                 + ": Annotated data mismatch!").c_str());
       }
-      m_annot_char = get_unicode_from_utf8(m_annot_stream_p);
-    } // for (size_t i = 0; i != token_text.length(); i++)
+    } // while (i != text.length())
 
     // Check for the presence of whitespace/newlines between this and
     // the next token
     if ((token + 1 != in_chunk_p->tokens.end()) || !in_chunk_p->is_final) {
-      if (is_whitespace(m_annot_char)) {
+      if (is_whitespace(peek_annotated())) {
         bool line_break = consume_whitespace();
 
         if (token->n_newlines == -1)
@@ -380,10 +556,8 @@ void Classifier::align_chunk_with_solution(chunk_t *in_chunk_p) {
     m_current_input_line += max(0, token->n_newlines);
   } // for (vector<token_t>::iterator token = in_chunk_p->tokens.begin();
   
-  if (is_whitespace(m_annot_char)) {
-    consume_whitespace();
-  }
-  if (in_chunk_p->is_final && !m_annot_stream_p->eof()) {
+  consume_whitespace();
+  if (in_chunk_p->is_final && !m_annot_reader.at_end()) {
     cerr << m_annotated_filename << ": "
          << "Warning: Extra text at the end of annotated data." << endl;
   }
@@ -394,26 +568,33 @@ void Classifier::align_chunk_with_solution(chunk_t *in_chunk_p) {
 void* Classifier::operator()(void* input_p) {
   chunk_t* in_chunk_p = (chunk_t*)input_p;
 
-  if ((m_mode == TRAIN_MODE) || (m_mode == EVALUATE_MODE)) {
-    align_chunk_with_solution(in_chunk_p);
+  if (!m_in_document) {
+    m_in_document = true;
+    if (m_document_listener_p != NULL)
+      m_document_listener_p->start_document();
   }
 
-  chunk_t *out_chunk_p = NULL;
-  if ((m_mode == TOKENIZE_MODE) || (m_mode == PREPARE_MODE)) {
-    out_chunk_p = new chunk_t;
-    out_chunk_p->is_final = in_chunk_p->is_final;
+  if ((m_mode == TRAIN_MODE) || (m_mode == EVALUATE_MODE)) {
+    align_chunk_with_solution(in_chunk_p);
   }
 
-  process_tokens(in_chunk_p->tokens, out_chunk_p);
+  m_chunks.push_back(in_chunk_p);
+  process_tokens(in_chunk_p->tokens);
 
-  if (in_chunk_p->is_final) {
-    token_t end_token;
-    end_token.text = "";
-    vector<token_t> end_tokens(m_postcontext + 1, end_token);
-    process_tokens(end_tokens, out_chunk_p);
+  if (!in_chunk_p->is_final) {
+    return release_decided_chunks(false);
   }
 
-  delete in_chunk_p;
+  // The last tokens are decided by pushing end of input marks into the
+  // window. The next document then starts with an empty window.
+  for (int i = 0; i != m_postcontext; i++) {
+    push_token(&m_end_token);
+  }
+  chunk_t *out_chunk_p = release_decided_chunks(true);
+  reset();
+  m_in_document = false;
+  if (m_document_listener_p != NULL)
+    m_document_listener_p->end_document();
   return out_chunk_p;
 }
 
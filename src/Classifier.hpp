@@ -2,15 +2,23 @@
 #define CLASSIFIER_INCLUDE_GUARD
 
 #include <iostream>
+#include <sstream>
 #include <string>
 #include <vector>
 #include <utility>
+#include <deque>
 #include "tbb/pipeline.h"
 #include <boost/cstdint.hpp>
 typedef boost::uint32_t uint32_t;
 #include <maxentmodel.hpp>
 
 #include <token_t.hpp>
+#include "MaxentTrainer.hpp"
+#include "CompactModel.hpp"
+#include "CombinedFeatureTemplate.hpp"
+#include "evaluation_stats.hpp"
+#include "BinaryQAEncoder.hpp"
+#include "Utf8Reader.hpp"
 
 namespace trtok {
 
@@ -21,20 +29,20 @@ enum classifier_mode_t {
   EVALUATE_MODE
 };
 
-struct training_parameters_t {
-  size_t event_cutoff;
-  size_t n_iterations;
-  std::string method_name;
-  double smoothing_coefficient;
-  double convergence_tolerance;
-
-  training_parameters_t():
-    event_cutoff(1),
-    n_iterations(15),
-    method_name("lbfgs"),
-    smoothing_coefficient(0.0),
-    convergence_tolerance(1e-05)
-  {}
+/* A DocumentListener is told by the Classifier when it starts and when it
+   finishes deciding a document, so that what concerns the document alone
+   (the names of its files, its events and statistics) can be handled while
+   the following documents are already in the pipeline. */
+class DocumentListener {
+
+public:
+    // start_document is called before the first chunk of a document is
+    // processed.
+    virtual void start_document() = 0;
+    // end_document is called after the last token of a document has been
+    // decided.
+    virtual void end_document() = 0;
+    virtual ~DocumentListener() {}
 };
 
 class Classifier: public tbb::filter {
@@ -56,78 +64,181 @@ public:
               m_postcontext(postcontext),
               m_window_size(precontext + 1 + postcontext),
               m_features_mask(features_mask),
-              m_combined_features(combined_features),
               m_qa_stream_p(qa_stream_p),
               m_annot_stream_p(annot_stream_p),
-              m_n_events_registered(0)
+              m_n_feature_buckets(0),
+              m_binary_questions(false),
+              m_spool_block_size(0),
+              m_n_spooled_trainers(0),
+              m_n_tokens(0),
+              m_n_decisions(0),
+              m_document_listener_p(NULL),
+              m_in_document(false)
     {
-        m_window = new token_t[m_window_size];
-        if (m_mode == TRAIN_MODE) {
-          m_model.begin_add_event();
-          m_processing_heldout_data = false;
+        // The window is a ring of pointers whose size is a power of two,
+        // so that offsets can be wrapped by masking.
+        m_ring_size = 1;
+        while (m_ring_size < m_window_size)
+          m_ring_size *= 2;
+        m_window = new token_t*[m_ring_size];
+        m_carry = new token_t[m_ring_size];
+        m_trainer_p = (m_mode == TRAIN_MODE) ? new MaxentTrainer() : NULL;
+        for (size_t f = 0; f != combined_features.size(); f++) {
+          m_combined_templates.push_back(
+              CombinedFeatureTemplate(combined_features[f], property_names));
         }
         reset();
     }
 
     void setup(std::string processed_filename,
                std::string annotated_filename = "") {
+        m_stats = evaluation_stats_t();
+        m_n_tokens = 0;
+        m_n_decisions = 0;
+        start_file(processed_filename, annotated_filename);
+        reset();
+    }
+
+    // start_file tells the Classifier the names of the files the next
+    // document comes from, without resetting its statistics.
+    void start_file(std::string processed_filename,
+                    std::string annotated_filename = "") {
         m_processed_filename = processed_filename;
         m_annotated_filename = annotated_filename;
-        reset();
+        m_qa_encoder.start_file(processed_filename);
+        m_annot_reader.setup(m_annot_stream_p);
     }
 
+    // reset prepares the Classifier for another document, it is called
+    // after the last chunk of every document.
     void reset() {
         m_first_chunk = true;
-        for (int i = 0; i < m_window_size; i++) {
-          m_window[i].text = "";
-          m_window[i].decision_flags = NO_FLAG;
+        for (int i = 0; i < m_ring_size; i++) {
+          m_window[i] = &m_end_token;
         }
         m_center_token = 0;
+        while (!m_chunks.empty()) {
+          delete m_chunks.front();
+          m_chunks.pop_front();
+        }
+        m_n_decided = 0;
         m_center_token_line = 1;
         m_current_input_line = 1;
         m_current_annot_line = 1;
+        m_reported_invalid_annot = false;
     }
 
     void load_model(std::string const &model_path) {
       m_model.load(model_path);
     }
 
-    void train_model(training_parameters_t const &training_parameters,
-                     std::string const &model_path,
-                     bool save_as_binary = false) {
+    // load_compact_model makes the Classifier use a CompactModel instead
+    // of the Maxent toolkit's model.
+    void load_compact_model(std::string const &model_path) {
+      m_compact_model.load(model_path);
+    }
 
-      m_model.end_add_event(training_parameters.event_cutoff);
-      if (m_n_events_registered > 0) {
-        m_model.train(training_parameters.n_iterations,
-                      training_parameters.method_name,
-                      training_parameters.smoothing_coefficient,
-                      training_parameters.convergence_tolerance);
-      }
-      m_model.save(model_path, save_as_binary);
+    // hash_features makes the Classifier hash all the features of a context
+    // into a fixed number of buckets before handing them to the model,
+    // which bounds the number of the model's predicates. The same number of
+    // buckets must be used in training and in tokenization.
+    void hash_features(size_t n_buckets) {
+      m_n_feature_buckets = n_buckets;
+    }
+
+    // set_qa_stream redirects the questions and answers to another stream.
+    void set_qa_stream(std::ostream *qa_stream_p) {
+      m_qa_stream_p = qa_stream_p;
     }
 
-    void switch_to_training_data() {
-      m_processing_heldout_data = false;
+    // set_document_listener makes the Classifier tell listener_p about
+    // the documents it processes.
+    void set_document_listener(DocumentListener *listener_p) {
+      m_document_listener_p = listener_p;
     }
 
-    void switch_to_heldout_data() {
-      m_processing_heldout_data = true;
+    // binary_questions makes the Classifier write the questions and answers
+    // in the binary format (see BinaryQAEncoder).
+    void binary_questions(bool binary) {
+      m_binary_questions = binary;
     }
 
+    // release_events hands over the trainer holding the events registered
+    // so far to the caller, who becomes responsible for deleting it.
+    // The Classifier continues with a new, empty trainer.
+    MaxentTrainer *release_events() {
+      MaxentTrainer *trainer_p = m_trainer_p;
+      m_trainer_p = new_trainer();
+      return trainer_p;
+    }
+
+    // spool_events_to makes the trainers holding the events keep them in
+    // spool files whose paths start with spool_prefix instead of memory,
+    // see MaxentTrainer::spool_to. It must be called before any events are
+    // registered.
+    void spool_events_to(std::string const &spool_prefix,
+                         size_t block_size) {
+      m_spool_prefix = spool_prefix;
+      m_spool_block_size = block_size;
+      delete m_trainer_p;
+      m_trainer_p = new_trainer();
+    }
+
+    // The outcomes of the decisions made in EVALUATE_MODE and the number
+    // of tokens and decision points processed since the last call to setup.
+    evaluation_stats_t const &stats() const { return m_stats; }
+    size_t n_tokens() const { return m_n_tokens; }
+    size_t n_decisions() const { return m_n_decisions; }
+
     ~Classifier() {
+        reset();
         delete[] m_window;
+        delete[] m_carry;
+        delete m_trainer_p;
     }
 
-    void process_tokens(std::vector<token_t> &tokens, chunk_t *out_chunk_p);
-    void process_center_token(chunk_t *out_chunk_p);
+    void process_tokens(std::vector<token_t> &tokens);
+
+    // redecide decides the tokens again from first on, outside of the
+    // pipeline, with the tokens before first and their decisions serving
+    // as the context. The tokens from changed_end on must be the same as
+    // when they were last decided. redecide stops at the first token past
+    // changed_end + precontext whose preceding precontext decisions have
+    // not changed, since its context and so all the following decisions
+    // are then the same as before, and it returns the index of that token.
+    size_t redecide(std::vector<token_t> &tokens, size_t first,
+                    size_t changed_end);
+    void process_center_token();
     void align_chunk_with_solution(chunk_t *in_chunk_p);
     virtual void* operator()(void *input_p);
 
 private:
+    void push_token(token_t *token_p);
+    chunk_t *release_decided_chunks(bool is_final);
     bool consume_whitespace();
+    uint32_t peek_annotated(size_t &n_bytes);
+    uint32_t peek_annotated() {
+      size_t n_bytes;
+      return peek_annotated(n_bytes);
+    }
+    std::vector< std::pair<std::string,float> > const &hash_context(
+        std::vector< std::pair<std::string,float> > const &context);
+    CompactModel::hashed_context_t const &feature_hashes(
+        std::vector< std::pair<std::string,float> > const &context);
     void report_alignment_warning(std::string occurence_type,
                                   std::string prefix, std::string suffix,
                                   std::string advice);
+    MaxentTrainer *new_trainer() {
+      MaxentTrainer *trainer_p = new MaxentTrainer();
+      if (!m_spool_prefix.empty()) {
+        std::ostringstream spool_path;
+        spool_path << m_spool_prefix << '.' << m_n_spooled_trainers++;
+        trainer_p->spool_to(spool_path.str() + ".events",
+                            spool_path.str() + ".heldout",
+                            m_spool_block_size);
+      }
+      return trainer_p;
+    }
 private:
     // Configuration
     classifier_mode_t m_mode;
@@ -136,19 +247,50 @@ private:
     int m_postcontext;
     int m_window_size;
     bool *m_features_mask;
-    std::vector< std::vector< std::pair<int,int> > > m_combined_features;
+    std::vector<CombinedFeatureTemplate> m_combined_templates;
     std::ostream *m_qa_stream_p;
     std::istream *m_annot_stream_p;
     std::string m_processed_filename;
     std::string m_annotated_filename;
+    size_t m_n_feature_buckets;
+    bool m_binary_questions;
 
     // State
-    uint32_t m_annot_char;
+    Utf8Reader m_annot_reader;
     bool m_first_chunk;
-    token_t *m_window;
+    // The context window holds pointers to the tokens inside the chunks
+    // (m_window[m_center_token] being the token in the center) so that the
+    // tokens need not be copied. Chunks are kept in m_chunks until all of
+    // their tokens have been decided, the tokens of released chunks which
+    // are still in the window are copied to m_carry.
+    token_t **m_window;
+    int m_ring_size;
     int m_center_token;
+    token_t *m_carry;
+    token_t m_end_token;
+    std::deque<chunk_t*> m_chunks;
+    // The number of tokens in m_chunks which have already been decided.
+    size_t m_n_decided;
+    std::vector< std::pair<std::string,float> > m_hashed_context;
+    // The hashes of the combined features which have not been built as
+    // strings, see CombinedFeatureTemplate.
+    std::vector<uint64_t> m_combined_hashes;
+    CompactModel::hashed_context_t m_feature_hashes;
     maxent::MaxentModel m_model;
-    int m_n_events_registered;
+    CompactModel m_compact_model;
+    MaxentTrainer *m_trainer_p;
+    // Where the trainers spool their events, or empty, and the number of
+    // trainers spooled so far, which makes the paths of their spools unique.
+    std::string m_spool_prefix;
+    size_t m_spool_block_size;
+    size_t m_n_spooled_trainers;
+    BinaryQAEncoder m_qa_encoder;
+    evaluation_stats_t m_stats;
+    size_t m_n_tokens;
+    size_t m_n_decisions;
+    DocumentListener *m_document_listener_p;
+    // Whether a document has been started and not yet finished.
+    bool m_in_document;
     // The line of the input file containing the token in the center of
     // the context window (may be slightly off due to multiline XML tags).
     int m_center_token_line;
@@ -156,8 +298,8 @@ private:
     int m_current_input_line;
     // The current line of the annotated file when aligning data.
     int m_current_annot_line;
-    // Are we currently processing heldout data?
-    bool m_processing_heldout_data;
+    // Whether malformed UTF-8 in the annotated file has been reported.
+    bool m_reported_invalid_annot;
 };
 
 }
@@ -0,0 +1,45 @@
+#include <string>
+#include <vector>
+#include <utility>
+#include <boost/lexical_cast.hpp>
+
+#include "CombinedFeatureTemplate.hpp"
+
+using namespace std;
+
+namespace trtok {
+
+CombinedFeatureTemplate::CombinedFeatureTemplate(
+    vector< pair<int,int> > const &constituents,
+    vector<string> const &property_names) {
+  int length_property = property_names.size() - 2;
+  int word_property = property_names.size() - 1;
+
+  for (vector< pair<int,int> >::const_iterator
+       constituent = constituents.begin();
+       constituent != constituents.end(); constituent++) {
+    piece_t piece;
+    piece.offset = constituent->first;
+    piece.property = constituent->second;
+    if (piece.property == length_property) {
+      piece.kind = LENGTH_PIECE;
+    } else if (piece.property == word_property) {
+      piece.kind = WORD_PIECE;
+    } else {
+      piece.kind = PREDICATE_PIECE;
+    }
+
+    piece.prefix = (constituent == constituents.begin()) ? "(" : "^";
+    piece.prefix += boost::lexical_cast<string>(piece.offset) + ":"
+                    + property_names[piece.property] + "=";
+    piece.prefix_hash = feature_hash(piece.prefix);
+    piece.prefix_power = feature_hash_power(piece.prefix.length());
+    piece.true_hash = feature_hash(piece.prefix + "1.0");
+    piece.false_hash = feature_hash(piece.prefix + "0.0");
+    piece.value_power = feature_hash_power(piece.prefix.length() + 3);
+
+    m_pieces.push_back(piece);
+  }
+}
+
+}
@@ -0,0 +1,111 @@
+#ifndef COMBINED_FEATURE_TEMPLATE_INCLUDE_GUARD
+#define COMBINED_FEATURE_TEMPLATE_INCLUDE_GUARD
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <boost/lexical_cast.hpp>
+#include <boost/cstdint.hpp>
+typedef boost::uint64_t uint64_t;
+
+#include "token_t.hpp"
+#include "feature_hash.hpp"
+
+namespace trtok {
+
+/* CombinedFeatureTemplate is a combined feature compiled for a quick
+   instantiation. A combined feature looks like
+   "(-1:%Upper=1.0^0:%length=3^1:%Word=the)"; everything in it except for
+   the values of the properties is known in advance. The constant pieces
+   are therefore prepared once along with their hashes, so that an instance
+   of the feature can be hashed by combining the precomputed hashes with the
+   values of the properties, without building the feature string. The hash
+   is the feature_hash of the feature string. */
+class CombinedFeatureTemplate {
+
+public:
+    // property_names are the names of all the properties, the last two
+    // of them being %length and %Word.
+    CombinedFeatureTemplate(
+        std::vector< std::pair<int,int> > const &constituents,
+        std::vector<std::string> const &property_names);
+
+    // instantiate computes the hash of the feature for the tokens in the
+    // context window (window[(center + offset) & mask] being the token at
+    // offset) and, if feature_string_p is not NULL, the feature string
+    // itself. It returns false if the feature reaches beyond the end of the
+    // input, in which case it must not be used.
+    bool instantiate(token_t * const *window, int center, int mask,
+                     uint64_t &hash, std::string *feature_string_p) const {
+      hash = 0;
+      if (feature_string_p != NULL)
+        feature_string_p->clear();
+
+      for (std::vector<piece_t>::const_iterator piece = m_pieces.begin();
+           piece != m_pieces.end(); piece++) {
+        token_t const &token = *window[(center + piece->offset) & mask];
+        if (token.text.empty())
+          return false;
+
+        if (piece->kind == PREDICATE_PIECE) {
+          bool value = token.property_flags[piece->property];
+          hash = hash * piece->value_power
+               + (value ? piece->true_hash : piece->false_hash);
+          if (feature_string_p != NULL) {
+            *feature_string_p += piece->prefix;
+            *feature_string_p += value ? "1.0" : "0.0";
+          }
+        } else {
+          hash = hash * piece->prefix_power + piece->prefix_hash;
+          if (piece->kind == LENGTH_PIECE) {
+            hash = feature_hash_decimal(token.text.length(), hash);
+            if (feature_string_p != NULL) {
+              *feature_string_p += piece->prefix;
+              *feature_string_p +=
+                boost::lexical_cast<std::string>(token.text.length());
+            }
+          } else {
+            hash = feature_hash(token.text, hash);
+            if (feature_string_p != NULL) {
+              *feature_string_p += piece->prefix;
+              *feature_string_p += token.text;
+            }
+          }
+        }
+      }
+
+      hash = hash * FEATURE_HASH_BASE + ')';
+      if (feature_string_p != NULL)
+        *feature_string_p += ')';
+      return true;
+    }
+
+private:
+    enum piece_kind_t {
+      PREDICATE_PIECE,
+      LENGTH_PIECE,
+      WORD_PIECE
+    };
+
+    // A constituent of the feature. Its prefix contains the opening
+    // parenthesis or the separator, the offset and the name of the property.
+    struct piece_t {
+      int offset;
+      piece_kind_t kind;
+      int property;
+      std::string prefix;
+      uint64_t prefix_hash;
+      uint64_t prefix_power;
+      // The hashes of the prefix followed by "1.0" and "0.0" and the power
+      // of the base for their length.
+      uint64_t true_hash;
+      uint64_t false_hash;
+      uint64_t value_power;
+    };
+
+    std::vector<piece_t> m_pieces;
+};
+
+}
+
+#endif
@@ -0,0 +1,288 @@
+#include <string>
+#include <vector>
+#include <fstream>
+#include <cstring>
+#include <cmath>
+#include <stdexcept>
+#include <boost/cstdint.hpp>
+typedef boost::int8_t int8_t;
+typedef boost::int16_t int16_t;
+
+#include "CompactModel.hpp"
+#include "feature_hash.hpp"
+
+using namespace std;
+
+namespace trtok {
+
+namespace {
+
+char const COMPACT_MODEL_MAGIC[8] = { 't', 'r', 't', 'o', 'k', 'c', 'm', '\0' };
+uint32_t const COMPACT_MODEL_VERSION = 1;
+
+inline size_t align8(size_t size) {
+  return (size + 7) & ~(size_t)7;
+}
+
+// The number of slots of the predicate table, a power of two which keeps
+// the table at most three quarters full.
+size_t table_size(size_t n_preds) {
+  size_t n_slots = 1;
+  while (3 * n_slots < 4 * n_preds)
+    n_slots *= 2;
+  return n_slots;
+}
+
+size_t layout_size(unsigned weight_bits, size_t n_outcomes,
+                   size_t outcome_names_size, size_t n_slots,
+                   size_t n_params) {
+  return align8(sizeof(compact_model_header_t))
+       + align8(n_outcomes * sizeof(float))
+       + align8(outcome_names_size)
+       + align8(n_slots * sizeof(compact_model_slot_t))
+       + align8(n_params * sizeof(uint16_t))
+       + align8(n_params * weight_bits / 8);
+}
+
+void write_padding(ofstream &model_file) {
+  static char const zeros[8] = { 0 };
+  size_t position = model_file.tellp();
+  model_file.write(zeros, align8(position) - position);
+}
+
+}
+
+
+size_t CompactModel::file_size(unsigned weight_bits, size_t n_outcomes,
+                               size_t outcome_names_size, size_t n_preds,
+                               size_t n_params) {
+  return layout_size(weight_bits, n_outcomes, outcome_names_size,
+                     table_size(n_preds), n_params);
+}
+
+void CompactModel::quantize(unsigned weight_bits, size_t n_outcomes,
+                            vector<uint32_t> const &param_outcomes,
+                            vector<double> const &theta,
+                            vector<float> &scales,
+                            vector<int> &weights) {
+  int max_weight = (1 << (weight_bits - 1)) - 1;
+
+  vector<double> max_abs(n_outcomes, 0.0);
+  for (size_t k = 0; k != theta.size(); k++) {
+    max_abs[param_outcomes[k]] = max(max_abs[param_outcomes[k]],
+                                     fabs(theta[k]));
+  }
+  scales.resize(n_outcomes);
+  for (size_t o = 0; o != n_outcomes; o++) {
+    scales[o] = (max_abs[o] > 0.0) ? max_abs[o] / max_weight : 1.0;
+  }
+
+  weights.resize(theta.size());
+  for (size_t k = 0; k != theta.size(); k++) {
+    double weight = floor(theta[k] / scales[param_outcomes[k]] + 0.5);
+    weight = max(-(double)max_weight, min((double)max_weight, weight));
+    weights[k] = (int)weight;
+  }
+}
+
+void CompactModel::write(string const &model_path, unsigned weight_bits,
+                         vector<string> const &outcome_names,
+                         vector<string> const &pred_names,
+                         vector<size_t> const &param_offsets,
+                         vector<uint32_t> const &param_outcomes,
+                         vector<double> const &theta) {
+  if ((weight_bits != 8) && (weight_bits != 16)) {
+    throw invalid_argument("Compact models use either 8-bit or 16-bit "
+                           "weights.");
+  }
+  if (outcome_names.size() > 0xffff) {
+    throw invalid_argument("Too many outcomes for a compact model.");
+  }
+
+  vector<float> scales;
+  vector<int> weights;
+  quantize(weight_bits, outcome_names.size(), param_outcomes, theta,
+           scales, weights);
+
+  string outcome_names_block;
+  for (size_t o = 0; o != outcome_names.size(); o++) {
+    outcome_names_block += outcome_names[o];
+    outcome_names_block += '\0';
+  }
+
+  // Only predicates which have some parameters are stored.
+  size_t n_preds = 0;
+  for (size_t p = 0; p + 1 < param_offsets.size(); p++) {
+    if (param_offsets[p + 1] != param_offsets[p])
+      n_preds++;
+  }
+  vector<compact_model_slot_t> slots(table_size(n_preds));
+  memset(&slots[0], 0, slots.size() * sizeof(compact_model_slot_t));
+  size_t mask = slots.size() - 1;
+  for (size_t p = 0; p + 1 < param_offsets.size(); p++) {
+    if (param_offsets[p + 1] == param_offsets[p])
+      continue;
+    uint64_t key = mix_feature_hash(feature_hash(pred_names[p]));
+    size_t slot = key & mask;
+    while (slots[slot].n_params != 0) {
+      slot = (slot + 1) & mask;
+    }
+    slots[slot].key = key;
+    slots[slot].param_offset = param_offsets[p];
+    slots[slot].n_params = param_offsets[p + 1] - param_offsets[p];
+  }
+
+  compact_model_header_t header;
+  memcpy(header.magic, COMPACT_MODEL_MAGIC, sizeof(header.magic));
+  header.version = COMPACT_MODEL_VERSION;
+  header.weight_bits = weight_bits;
+  header.n_outcomes = outcome_names.size();
+  header.n_slots = slots.size();
+  header.n_params = theta.size();
+  header.outcome_names_size = outcome_names_block.size();
+
+  ofstream model_file(model_path.c_str(), ios::binary | ios::trunc);
+  if (!model_file) {
+    throw runtime_error(model_path + ": Cannot create the compact model.");
+  }
+  model_file.write((char const*)&header, sizeof(header));
+  write_padding(model_file);
+  if (!scales.empty()) {
+    model_file.write((char const*)&scales[0], scales.size() * sizeof(float));
+  }
+  write_padding(model_file);
+  model_file.write(outcome_names_block.data(), outcome_names_block.size());
+  write_padding(model_file);
+  model_file.write((char const*)&slots[0],
+                   slots.size() * sizeof(compact_model_slot_t));
+  write_padding(model_file);
+  for (size_t k = 0; k != param_outcomes.size(); k++) {
+    uint16_t outcome = param_outcomes[k];
+    model_file.write((char const*)&outcome, sizeof(outcome));
+  }
+  write_padding(model_file);
+  for (size_t k = 0; k != weights.size(); k++) {
+    if (weight_bits == 16) {
+      int16_t weight = weights[k];
+      model_file.write((char const*)&weight, sizeof(weight));
+    } else {
+      int8_t weight = weights[k];
+      model_file.write((char const*)&weight, sizeof(weight));
+    }
+  }
+  write_padding(model_file);
+
+  if (!model_file) {
+    throw runtime_error(model_path + ": Cannot write the compact model.");
+  }
+}
+
+void CompactModel::load(string const &model_path) {
+  try {
+    m_file.open(model_path);
+  } catch (ios::failure const &exc) {
+    throw runtime_error(model_path + ": Cannot map the compact model.");
+  }
+
+  char const *data = m_file.data();
+  size_t size = m_file.size();
+  m_header_p = (compact_model_header_t const*)data;
+  if ((size < sizeof(compact_model_header_t))
+      || (memcmp(m_header_p->magic, COMPACT_MODEL_MAGIC,
+                 sizeof(COMPACT_MODEL_MAGIC)) != 0)
+      || (m_header_p->version != COMPACT_MODEL_VERSION)
+      || ((m_header_p->weight_bits != 8) && (m_header_p->weight_bits != 16))
+      || (m_header_p->n_slots == 0)
+      || ((m_header_p->n_slots & (m_header_p->n_slots - 1)) != 0)
+      || (size != layout_size(m_header_p->weight_bits,
+                              m_header_p->n_outcomes,
+                              m_header_p->outcome_names_size,
+                              m_header_p->n_slots, m_header_p->n_params))) {
+    m_header_p = NULL;
+    m_file.close();
+    throw runtime_error(model_path + ": Not a compact model of this version "
+                        "of trtok.");
+  }
+
+  size_t offset = align8(sizeof(compact_model_header_t));
+  m_scales = (float const*)(data + offset);
+  offset += align8(m_header_p->n_outcomes * sizeof(float));
+  char const *outcome_names = data + offset;
+  offset += align8(m_header_p->outcome_names_size);
+  m_slots = (compact_model_slot_t const*)(data + offset);
+  offset += align8(m_header_p->n_slots * sizeof(compact_model_slot_t));
+  m_param_outcomes = (uint16_t const*)(data + offset);
+  offset += align8(m_header_p->n_params * sizeof(uint16_t));
+  m_weights = data + offset;
+
+  m_outcome_names.clear();
+  for (uint32_t o = 0; o != m_header_p->n_outcomes; o++) {
+    m_outcome_names.push_back(string(outcome_names));
+    outcome_names += m_outcome_names.back().size() + 1;
+  }
+}
+
+compact_model_slot_t const *CompactModel::find(uint64_t key) const {
+  size_t mask = m_header_p->n_slots - 1;
+  size_t slot = key & mask;
+  while (m_slots[slot].n_params != 0) {
+    if (m_slots[slot].key == key)
+      return &m_slots[slot];
+    slot = (slot + 1) & mask;
+  }
+  return NULL;
+}
+
+void CompactModel::add_scores(uint64_t pred_hash, float value,
+                              vector<double> &scores) const {
+  compact_model_slot_t const *slot_p = find(mix_feature_hash(pred_hash));
+  if (slot_p == NULL)
+    return;
+  bool wide = (m_header_p->weight_bits == 16);
+  uint32_t end = slot_p->param_offset + slot_p->n_params;
+  for (uint32_t k = slot_p->param_offset; k != end; k++) {
+    int weight = wide ? ((int16_t const*)m_weights)[k]
+                      : ((int8_t const*)m_weights)[k];
+    scores[m_param_outcomes[k]] += value * weight;
+  }
+}
+
+string const &CompactModel::best_outcome(vector<double> &scores) const {
+  size_t best = 0;
+  for (size_t o = 0; o != scores.size(); o++) {
+    scores[o] *= m_scales[o];
+    if (scores[o] > scores[best])
+      best = o;
+  }
+  return m_outcome_names[best];
+}
+
+string const &CompactModel::predict(context_t const &context) const {
+  static string const no_outcome;
+  if (m_header_p->n_outcomes == 0)
+    return no_outcome;
+
+  // The weights are summed up in their quantized form and scaled only
+  // once per outcome.
+  vector<double> scores(m_header_p->n_outcomes, 0.0);
+  for (context_t::const_iterator feature = context.begin();
+       feature != context.end(); feature++) {
+    add_scores(feature_hash(feature->first), feature->second, scores);
+  }
+  return best_outcome(scores);
+}
+
+string const &CompactModel::predict(hashed_context_t const &context) const {
+  static string const no_outcome;
+  if (m_header_p->n_outcomes == 0)
+    return no_outcome;
+
+  vector<double> scores(m_header_p->n_outcomes, 0.0);
+  for (hashed_context_t::const_iterator feature = context.begin();
+       feature != context.end(); feature++) {
+    add_scores(feature->first, feature->second, scores);
+  }
+  return best_outcome(scores);
+}
+
+}
@@ -0,0 +1,113 @@
+#ifndef COMPACT_MODEL_INCLUDE_GUARD
+#define COMPACT_MODEL_INCLUDE_GUARD
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <boost/noncopyable.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
+#include <boost/cstdint.hpp>
+typedef boost::uint16_t uint16_t;
+typedef boost::uint32_t uint32_t;
+typedef boost::uint64_t uint64_t;
+
+namespace trtok {
+
+/* The header of a compact model file. It is followed by the per-outcome
+   scales of the weights (floats), the outcome names (each terminated by
+   a zero byte), the predicate table, the outcomes of the parameters
+   (16-bit) and the quantized weights of the parameters (8-bit or 16-bit).
+   Every section starts at a multiple of 8 bytes. */
+struct compact_model_header_t {
+  char magic[8];
+  uint32_t version;
+  uint32_t weight_bits;
+  uint32_t n_outcomes;
+  uint32_t n_slots;
+  uint32_t n_params;
+  uint32_t outcome_names_size;
+};
+
+/* A slot of the predicate table, which is an open-addressing hash table
+   with linear probing keyed by the mixed feature_hash of the predicate
+   string. Empty slots have n_params == 0. The parameters of the predicate
+   are those at indices param_offset to param_offset + n_params. */
+struct compact_model_slot_t {
+  uint64_t key;
+  uint32_t param_offset;
+  uint32_t n_params;
+};
+
+/* CompactModel is a read-only maxent model stored in trtok's own format.
+   Predicates are not stored as strings, only as 64-bit hashes, and the
+   weights are quantized to 16 or 8 bits with a separate scale for every
+   outcome. The file is mapped into memory instead of being parsed, so
+   loading is immediate and concurrent tokenizer processes share a single
+   copy of the model in the page cache. */
+class CompactModel: private boost::noncopyable {
+
+public:
+    typedef std::vector< std::pair<std::string, float> > context_t;
+    // A context whose predicates are given by their feature_hash.
+    typedef std::vector< std::pair<uint64_t, float> > hashed_context_t;
+
+    CompactModel():
+        m_header_p(NULL),
+        m_scales(NULL),
+        m_slots(NULL),
+        m_param_outcomes(NULL),
+        m_weights(NULL)
+    {}
+
+    // load maps the model file into memory, throws std::runtime_error if
+    // the file is not a valid compact model.
+    void load(std::string const &model_path);
+
+    bool is_loaded() const { return m_header_p != NULL; }
+
+    // predict returns the most probable outcome for the context.
+    std::string const &predict(context_t const &context) const;
+    std::string const &predict(hashed_context_t const &context) const;
+
+    // quantize computes the per-outcome scales and the quantized weights
+    // of the parameters theta whose outcomes are given in param_outcomes.
+    static void quantize(unsigned weight_bits, size_t n_outcomes,
+                         std::vector<uint32_t> const &param_outcomes,
+                         std::vector<double> const &theta,
+                         std::vector<float> &scales,
+                         std::vector<int> &weights);
+
+    // write stores a model in the compact format. The parameters of
+    // predicate p are stored at indices param_offsets[p] to
+    // param_offsets[p+1] of param_outcomes and theta.
+    static void write(std::string const &model_path, unsigned weight_bits,
+                      std::vector<std::string> const &outcome_names,
+                      std::vector<std::string> const &pred_names,
+                      std::vector<size_t> const &param_offsets,
+                      std::vector<uint32_t> const &param_outcomes,
+                      std::vector<double> const &theta);
+
+    // file_size computes the size of a compact model file in bytes.
+    static size_t file_size(unsigned weight_bits, size_t n_outcomes,
+                            size_t outcome_names_size, size_t n_preds,
+                            size_t n_params);
+
+private:
+    compact_model_slot_t const *find(uint64_t key) const;
+    void add_scores(uint64_t pred_hash, float value,
+                    std::vector<double> &scores) const;
+    std::string const &best_outcome(std::vector<double> &scores) const;
+
+private:
+    boost::iostreams::mapped_file_source m_file;
+    compact_model_header_t const *m_header_p;
+    float const *m_scales;
+    compact_model_slot_t const *m_slots;
+    uint16_t const *m_param_outcomes;
+    char const *m_weights;
+    std::vector<std::string> m_outcome_names;
+};
+
+}
+
+#endif
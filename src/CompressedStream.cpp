@@ -0,0 +1,331 @@
+#include <iostream>
+#include <string>
+#include <deque>
+#include <map>
+#include <exception>
+#include <boost/thread.hpp>
+#include <boost/bind.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+#include <boost/iostreams/device/back_inserter.hpp>
+#include <boost/iostreams/filter/gzip.hpp>
+
+#include "configuration.hpp"
+#ifdef USE_XZ
+#include <boost/iostreams/filter/lzma.hpp>
+#endif
+#ifdef USE_ZSTD
+#include <boost/iostreams/filter/zstd.hpp>
+#endif
+
+#include "CompressedStream.hpp"
+#include "messages.hpp"
+
+using namespace std;
+namespace io = boost::iostreams;
+
+namespace trtok {
+
+namespace {
+
+bool has_magic(char const *bytes, size_t n_bytes,
+               char const *magic, size_t n_magic) {
+  return (n_bytes >= n_magic)
+      && (string(bytes, n_magic) == string(magic, n_magic));
+}
+
+bool has_extension(string const &path, string const &extension) {
+  return (path.length() > extension.length())
+      && (path.compare(path.length() - extension.length(),
+                       extension.length(), extension) == 0);
+}
+
+void push_decompressor(io::filtering_istream &stream,
+                       compression_t compression) {
+  switch (compression) {
+    case GZIP_COMPRESSION:
+      stream.push(io::gzip_decompressor());
+      break;
+#ifdef USE_XZ
+    case XZ_COMPRESSION:
+      stream.push(io::lzma_decompressor());
+      break;
+#endif
+#ifdef USE_ZSTD
+    case ZSTD_COMPRESSION:
+      stream.push(io::zstd_decompressor());
+      break;
+#endif
+    default:
+      break;
+  }
+}
+
+// compress_block compresses the block as a complete gzip member, xz stream
+// or zstd frame.
+void compress_block(string const &block, compression_t compression,
+                    string &compressed) {
+  io::filtering_ostream stream;
+  switch (compression) {
+    case GZIP_COMPRESSION:
+      stream.push(io::gzip_compressor());
+      break;
+#ifdef USE_XZ
+    case XZ_COMPRESSION:
+      stream.push(io::lzma_compressor());
+      break;
+#endif
+#ifdef USE_ZSTD
+    case ZSTD_COMPRESSION:
+      stream.push(io::zstd_compressor());
+      break;
+#endif
+    default:
+      break;
+  }
+  stream.push(io::back_inserter(compressed));
+  stream.write(block.data(), block.size());
+  // Closing the stream writes out the end of the member or frame.
+  stream.reset();
+}
+
+}
+
+
+compression_t compression_from_magic(char const *bytes, size_t n_bytes) {
+  if (has_magic(bytes, n_bytes, "\x1f\x8b", 2))
+    return GZIP_COMPRESSION;
+#ifdef USE_XZ
+  if (has_magic(bytes, n_bytes, "\xfd" "7zXZ\0", 6))
+    return XZ_COMPRESSION;
+#endif
+#ifdef USE_ZSTD
+  if (has_magic(bytes, n_bytes, "\x28\xb5\x2f\xfd", 4))
+    return ZSTD_COMPRESSION;
+#endif
+  return NO_COMPRESSION;
+}
+
+compression_t compression_from_extension(string const &path) {
+  if (has_extension(path, ".gz"))
+    return GZIP_COMPRESSION;
+#ifdef USE_XZ
+  if (has_extension(path, ".xz"))
+    return XZ_COMPRESSION;
+#endif
+#ifdef USE_ZSTD
+  if (has_extension(path, ".zst"))
+    return ZSTD_COMPRESSION;
+#endif
+  return NO_COMPRESSION;
+}
+
+
+DecompressingStream::DecompressingStream(istream *compressed_p,
+                                         compression_t compression,
+                                         string const &name,
+                                         size_t block_size):
+    std::istream(NULL),
+    m_compressed_p(compressed_p),
+    m_compression(compression),
+    m_name(name),
+    m_block_size(block_size),
+    m_buffer(*this, ios_base::in),
+    m_max_blocks(4),
+    m_finished(false),
+    m_closing(false)
+{
+  rdbuf(&m_buffer);
+  m_thread = boost::thread(boost::bind(&DecompressingStream::decompress_blocks,
+                                       this));
+}
+
+DecompressingStream::~DecompressingStream() {
+  {
+    boost::mutex::scoped_lock lock(m_mutex);
+    m_closing = true;
+    m_blocks_changed.notify_all();
+  }
+  m_thread.join();
+  delete m_compressed_p;
+}
+
+bool DecompressingStream::pop_block(string &block) {
+  boost::mutex::scoped_lock lock(m_mutex);
+  while (m_blocks.empty() && !m_finished) {
+    m_blocks_changed.wait(lock);
+  }
+  if (m_blocks.empty()) {
+    // The error is reported once, when the reader gets to it.
+    if (!m_error.empty()) {
+      SIGNAL_WARNING(m_name, m_error);
+      m_error.clear();
+    }
+    return false;
+  }
+  block.swap(m_blocks.front());
+  m_blocks.pop_front();
+  m_blocks_changed.notify_all();
+  return true;
+}
+
+void DecompressingStream::decompress_blocks() {
+  try {
+    io::filtering_istream decompressed;
+    push_decompressor(decompressed, m_compression);
+    decompressed.push(*m_compressed_p);
+    decompressed.exceptions(ios::badbit);
+    while (true) {
+      string block(m_block_size, '\0');
+      decompressed.read(&block[0], block.size());
+      block.resize(decompressed.gcount());
+      if (block.empty())
+        break;
+
+      boost::mutex::scoped_lock lock(m_mutex);
+      while ((m_blocks.size() >= m_max_blocks) && !m_closing) {
+        m_blocks_changed.wait(lock);
+      }
+      if (m_closing)
+        return;
+      m_blocks.push_back(string());
+      m_blocks.back().swap(block);
+      m_blocks_changed.notify_all();
+    }
+  } catch (exception const &exc) {
+    boost::mutex::scoped_lock lock(m_mutex);
+    m_error = string("The compressed data are corrupt (") + exc.what()
+              + "), the rest of the file is left out.";
+  }
+  boost::mutex::scoped_lock lock(m_mutex);
+  m_finished = true;
+  m_blocks_changed.notify_all();
+}
+
+
+CompressingStream::CompressingStream(ostream *out_p,
+                                     compression_t compression,
+                                     string const &name,
+                                     size_t block_size, size_t n_threads):
+    std::ostream(NULL),
+    m_out_p(out_p),
+    m_compression(compression),
+    m_name(name),
+    m_buffer(*this, ios_base::out, block_size),
+    m_n_blocks(0),
+    m_n_held(0),
+    m_max_blocks(2 * n_threads + 2),
+    m_closing(false),
+    m_first_failed((size_t)-1)
+{
+  rdbuf(&m_buffer);
+  for (size_t t = 0; t != n_threads; t++) {
+    m_compressors.create_thread(
+        boost::bind(&CompressingStream::compress_blocks, this));
+  }
+  m_writer = boost::thread(boost::bind(&CompressingStream::write_blocks,
+                                       this));
+}
+
+CompressingStream::~CompressingStream() {
+  close();
+}
+
+void CompressingStream::close() {
+  if (!m_writer.joinable())
+    return;
+  m_buffer.hand_over();
+  {
+    boost::mutex::scoped_lock lock(m_mutex);
+    m_closing = true;
+    m_blocks_changed.notify_all();
+  }
+  m_compressors.join_all();
+  m_writer.join();
+  m_out_p->flush();
+  if (!m_error.empty()) {
+    SIGNAL_WARNING(m_name, m_error);
+    setstate(ios::badbit);
+  } else if (!*m_out_p) {
+    setstate(ios::badbit);
+  }
+  delete m_out_p;
+}
+
+void CompressingStream::push_block(string &block) {
+  boost::mutex::scoped_lock lock(m_mutex);
+  while (m_n_held >= m_max_blocks) {
+    m_blocks_changed.wait(lock);
+  }
+  m_pending.push_back(make_pair(m_n_blocks++, string()));
+  m_pending.back().second.swap(block);
+  m_n_held++;
+  m_blocks_changed.notify_all();
+}
+
+void CompressingStream::compress_blocks() {
+  while (true) {
+    pair<size_t, string> block;
+    {
+      boost::mutex::scoped_lock lock(m_mutex);
+      while (m_pending.empty() && !m_closing) {
+        m_blocks_changed.wait(lock);
+      }
+      if (m_pending.empty())
+        return;
+      block.first = m_pending.front().first;
+      block.second.swap(m_pending.front().second);
+      m_pending.pop_front();
+    }
+
+    // A block which cannot be compressed is handed to the writer empty,
+    // so that it does not wait for it forever.
+    string compressed;
+    bool failed = false;
+    string error;
+    try {
+      compress_block(block.second, m_compression, compressed);
+    } catch (exception const &exc) {
+      compressed.clear();
+      failed = true;
+      error = exc.what();
+    }
+
+    boost::mutex::scoped_lock lock(m_mutex);
+    if (failed && (block.first < m_first_failed)) {
+      m_first_failed = block.first;
+      m_error = "The output cannot be compressed (" + error
+                + "), the rest of the file is left out.";
+    }
+    m_compressed[block.first].swap(compressed);
+    m_blocks_changed.notify_all();
+  }
+}
+
+void CompressingStream::write_blocks() {
+  // The blocks are written in their order, whichever thread compressed
+  // them first.
+  for (size_t next_block = 0; ; next_block++) {
+    string compressed;
+    {
+      boost::mutex::scoped_lock lock(m_mutex);
+      while ((m_compressed.find(next_block) == m_compressed.end())
+             && !(m_closing && (next_block == m_n_blocks))) {
+        m_blocks_changed.wait(lock);
+      }
+      if (m_compressed.find(next_block) == m_compressed.end())
+        return;
+      compressed.swap(m_compressed[next_block]);
+      m_compressed.erase(next_block);
+      if (next_block >= m_first_failed)
+        compressed.clear();
+    }
+
+    m_out_p->write(compressed.data(), compressed.size());
+
+    boost::mutex::scoped_lock lock(m_mutex);
+    m_n_held--;
+    m_blocks_changed.notify_all();
+  }
+}
+
+}
@@ -0,0 +1,126 @@
+#ifndef COMPRESSED_STREAM_INCLUDE_GUARD
+#define COMPRESSED_STREAM_INCLUDE_GUARD
+
+#include <iostream>
+#include <streambuf>
+#include <string>
+#include <deque>
+#include <map>
+#include <boost/thread.hpp>
+#include <boost/noncopyable.hpp>
+
+#include "BlockBuffer.hpp"
+
+namespace trtok {
+
+enum compression_t {
+  NO_COMPRESSION,
+  GZIP_COMPRESSION,
+  XZ_COMPRESSION,
+  ZSTD_COMPRESSION
+};
+
+// compression_from_magic recognizes compressed data by their first bytes,
+// of which there should be at least 6. Only the compressions supported by
+// this build are recognized, see USE_XZ and USE_ZSTD.
+compression_t compression_from_magic(char const *bytes, size_t n_bytes);
+
+// compression_from_extension recognizes the files to be compressed by
+// their extension: .gz, .xz or .zst.
+compression_t compression_from_extension(std::string const &path);
+
+/* DecompressingStream reads the data of a compressed stream. The data are
+   decompressed in blocks by a background thread, a few blocks ahead of the
+   reader, so that the decompression runs alongside the TextCleaner. The
+   stream can tell its position but cannot seek. */
+class DecompressingStream: public std::istream, private BlockQueue,
+                           private boost::noncopyable {
+
+public:
+    // The DecompressingStream takes over the compressed stream. The name
+    // of the file is used in error messages.
+    DecompressingStream(std::istream *compressed_p, compression_t compression,
+                        std::string const &name, size_t block_size);
+
+    ~DecompressingStream();
+
+private:
+    virtual bool pop_block(std::string &block);
+    void decompress_blocks();
+
+private:
+    std::istream *m_compressed_p;
+    compression_t m_compression;
+    std::string m_name;
+    size_t m_block_size;
+    BlockBuffer m_buffer;
+
+    // The decompressed blocks waiting to be read, at most m_max_blocks of
+    // them.
+    std::deque<std::string> m_blocks;
+    size_t m_max_blocks;
+    bool m_finished;
+    bool m_closing;
+    std::string m_error;
+    boost::mutex m_mutex;
+    boost::condition_variable m_blocks_changed;
+    boost::thread m_thread;
+};
+
+/* CompressingStream compresses the data written to it into another stream.
+   The data are cut into blocks which are compressed independently by
+   several background threads and written out in order, one gzip member,
+   xz stream or zstd frame per block. The standard tools decompress such
+   concatenations as a single file. The position told by the stream is
+   that in the uncompressed data. If a block cannot be compressed, the rest
+   of the file is left out and the stream goes bad when it is closed. */
+class CompressingStream: public std::ostream, private BlockQueue,
+                         private boost::noncopyable {
+
+public:
+    // The CompressingStream takes over the stream it writes to. The name
+    // of the file is used in error messages.
+    CompressingStream(std::ostream *out_p, compression_t compression,
+                      std::string const &name, size_t block_size,
+                      size_t n_threads);
+
+    // The destructor closes the stream.
+    ~CompressingStream();
+
+    // close compresses and writes out everything written so far, stops the
+    // background threads and closes the underlying stream.
+    void close();
+
+private:
+    virtual void push_block(std::string &block);
+    void compress_blocks();
+    void write_blocks();
+
+private:
+    std::ostream *m_out_p;
+    compression_t m_compression;
+    std::string m_name;
+    BlockBuffer m_buffer;
+
+    // The blocks waiting to be compressed and the compressed blocks waiting
+    // to be written, indexed by their order. At most m_max_blocks blocks
+    // are held altogether.
+    std::deque< std::pair<size_t, std::string> > m_pending;
+    std::map<size_t, std::string> m_compressed;
+    size_t m_n_blocks;
+    size_t m_n_held;
+    size_t m_max_blocks;
+    bool m_closing;
+    // The first block which could not be compressed, the blocks from it on
+    // are not written.
+    size_t m_first_failed;
+    std::string m_error;
+    boost::mutex m_mutex;
+    boost::condition_variable m_blocks_changed;
+    boost::thread_group m_compressors;
+    boost::thread m_writer;
+};
+
+}
+
+#endif
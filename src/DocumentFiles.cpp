@@ -0,0 +1,122 @@
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <stdexcept>
+#include <boost/filesystem.hpp>
+
+#include "DocumentFiles.hpp"
+#include "input_file.hpp"
+#include "output_file.hpp"
+#include "jsonl.hpp"
+#include "messages.hpp"
+
+using namespace std;
+namespace fs = boost::filesystem;
+
+namespace trtok {
+
+void DocumentFiles::clean_document(istream *input_p, string const &id) {
+  document_t document;
+  document.end_of_file = false;
+  document.id = id;
+  m_documents.push(document);
+  if (m_classifier_p != NULL)
+    m_document_files.push(m_new_file);
+  m_new_file.clear();
+
+  m_input_cleaner.setup(input_p);
+  ProfiledWork<TextCleaner>(m_input_cleaner, m_profile_p,
+                            TEXT_CLEANER_STAGE)();
+}
+
+void DocumentFiles::read_file(string const &input_file) {
+  clog << "trtok: Processing file " << input_file << endl;
+
+  istream *input_stream_p = &cin;
+  if (input_file != "-") {
+    input_stream_p = (m_prefetcher_p != NULL)
+                       ? m_prefetcher_p->open(input_file)
+                       : open_input_file(input_file);
+  }
+  m_new_file = input_file;
+
+  if (!m_jsonl) {
+    clean_document(input_stream_p, "");
+  } else {
+    // Every record is a document, blank lines and malformed records are
+    // skipped.
+    istringstream document_in;
+    jsonl_record_t record;
+    string line;
+    size_t line_number = 0;
+    while (getline(*input_stream_p, line)) {
+      line_number++;
+      if (line.find_first_not_of(" \t\r") == string::npos)
+        continue;
+      try {
+        parse_jsonl_record(line, record);
+      } catch (invalid_argument const &exc) {
+        SIGNAL_WARNING(input_file << ":" << line_number, exc.what()
+            << " Skipping the record.");
+        continue;
+      }
+      document_in.clear();
+      document_in.str(record.text);
+      clean_document(&document_in, record.id);
+    }
+  }
+
+  document_t end_of_file;
+  end_of_file.end_of_file = true;
+  m_documents.push(end_of_file);
+
+  if (input_file != "-") {
+    if (m_profile_p != NULL)
+      m_profile_p->add_counts(TEXT_CLEANER_STAGE, 0,
+                              fs::file_size(input_file), 0);
+    if (m_prefetcher_p != NULL) {
+      m_prefetcher_p->close(input_file, input_stream_p);
+    } else {
+      delete input_stream_p;
+    }
+  }
+}
+
+void DocumentFiles::write_file(string const &input_file,
+                               string const &output_file) {
+  ostream *output_stream_p = (input_file == "-") ? &cout
+                                  : open_output_file(output_file);
+
+  ostringstream document_out;
+  jsonl_record_t record;
+  document_t document;
+  m_documents.pop(document);
+  while (!document.end_of_file) {
+    m_output_documents.next_document();
+    m_encoder.setup(m_jsonl ? &document_out : output_stream_p);
+    ProfiledWork<Encoder>(m_encoder, m_profile_p, ENCODER_STAGE)();
+    if (m_jsonl) {
+      record.id = document.id;
+      record.text = document_out.str();
+      document_out.str("");
+      write_jsonl_record(*output_stream_p, record);
+    }
+    m_documents.pop(document);
+  }
+
+  output_stream_p->flush();
+  if (input_file != "-") {
+    if (m_profile_p != NULL)
+      m_profile_p->add_counts(ENCODER_STAGE, 0, 0, output_stream_p->tellp());
+    delete output_stream_p;
+  }
+}
+
+void DocumentFiles::start_document() {
+  string file;
+  m_document_files.pop(file);
+  if (!file.empty())
+    m_classifier_p->start_file(file);
+}
+
+}
@@ -0,0 +1,92 @@
+#ifndef DOCUMENT_FILES_INCLUDE_GUARD
+#define DOCUMENT_FILES_INCLUDE_GUARD
+
+#include <string>
+#include <tbb/concurrent_queue.h>
+#include <boost/noncopyable.hpp>
+
+#include "TextCleaner.hpp"
+#include "Encoder.hpp"
+#include "Classifier.hpp"
+#include "DocumentStream.hpp"
+#include "FilePrefetcher.hpp"
+#include "Profile.hpp"
+
+namespace trtok {
+
+/* DocumentFiles feeds the files of the 'prepare' and 'tokenize' modes to
+   a pipeline which runs once over all of them. read_file is run by the
+   thread of the TextCleaner and cleans the documents of an input file one
+   after another, write_file is run by the thread of the Encoder and writes
+   the same documents, as they come out of the pipeline, to the output file.
+   The whole file is a single document, unless it is a JSONL container,
+   whose every record is a document. The Classifier is told which file its
+   documents come from. */
+class DocumentFiles: public DocumentListener, private boost::noncopyable {
+
+public:
+    DocumentFiles(TextCleaner &input_cleaner,
+                  /* The Encoder reads the documents from output_documents */
+                  Encoder &encoder,
+                  DocumentStream &output_documents,
+                  /* The Classifier is NULL when it is not in the pipeline */
+                  Classifier *classifier_p,
+                  FilePrefetcher *prefetcher_p,
+                  Profile *profile_p,
+                  bool jsonl):
+        m_input_cleaner(input_cleaner),
+        m_encoder(encoder),
+        m_output_documents(output_documents),
+        m_classifier_p(classifier_p),
+        m_prefetcher_p(prefetcher_p),
+        m_profile_p(profile_p),
+        m_jsonl(jsonl)
+    {}
+
+    // read_file cleans the documents of input_file, "-" being the standard
+    // input.
+    void read_file(std::string const &input_file);
+
+    // write_file writes the documents of input_file to output_file, "-"
+    // being the standard output. It must be called for the files in the
+    // order in which they were read.
+    void write_file(std::string const &input_file,
+                    std::string const &output_file);
+
+    // start_document tells the Classifier the name of the file when its
+    // first document starts.
+    virtual void start_document();
+    virtual void end_document() {}
+
+private:
+    // The documents read and not yet written, the last document of every
+    // file is followed by an entry with end_of_file set.
+    struct document_t {
+      bool end_of_file;
+      // The JSON value of the "id" member of a JSONL record.
+      std::string id;
+    };
+
+    // clean_document sends a document through the TextCleaner.
+    void clean_document(std::istream *input_p, std::string const &id);
+
+    TextCleaner &m_input_cleaner;
+    Encoder &m_encoder;
+    DocumentStream &m_output_documents;
+    Classifier *m_classifier_p;
+    FilePrefetcher *m_prefetcher_p;
+    Profile *m_profile_p;
+    bool m_jsonl;
+
+    tbb::concurrent_bounded_queue<document_t> m_documents;
+    // The file of every document read and not yet started by the
+    // Classifier, empty if it is the file of the document before.
+    tbb::concurrent_bounded_queue<std::string> m_document_files;
+    // The name of the file being read until its first document is cleaned,
+    // empty afterwards.
+    std::string m_new_file;
+};
+
+}
+
+#endif
@@ -0,0 +1,71 @@
+#include <cstring>
+#include <algorithm>
+#include <streambuf>
+
+#include "DocumentStream.hpp"
+
+using namespace std;
+
+namespace trtok {
+
+DocumentStream::DocumentBuffer::DocumentBuffer(streambuf *source_p):
+    m_source_p(source_p),
+    m_next_begin(m_data),
+    m_next_end(m_data),
+    m_at_end(true)
+{
+  setg(m_data, m_data, m_data);
+}
+
+void DocumentStream::DocumentBuffer::show(char *begin, char *end) {
+  char *marker = (char*)memchr(begin, END_OF_DOCUMENT, end - begin);
+  if (marker == NULL) {
+    setg(begin, begin, end);
+    m_next_begin = m_next_end = m_data;
+  } else {
+    setg(begin, begin, marker);
+    m_next_begin = marker + 1;
+    m_next_end = end;
+    m_at_end = true;
+  }
+}
+
+bool DocumentStream::DocumentBuffer::next_document() {
+  while (!traits_type::eq_int_type(underflow(), traits_type::eof())) {
+    setg(eback(), egptr(), egptr());
+  }
+
+  m_at_end = false;
+  if (m_next_begin != m_next_end) {
+    show(m_next_begin, m_next_end);
+    return true;
+  }
+  setg(m_data, m_data, m_data);
+  if (traits_type::eq_int_type(m_source_p->sgetc(), traits_type::eof())) {
+    m_at_end = true;
+    return false;
+  }
+  return true;
+}
+
+DocumentStream::DocumentBuffer::int_type
+DocumentStream::DocumentBuffer::underflow() {
+  if (gptr() != egptr())
+    return traits_type::to_int_type(*gptr());
+  if (m_at_end)
+    return traits_type::eof();
+
+  // The first byte is waited for, the rest is only taken if it is ready.
+  if (traits_type::eq_int_type(m_source_p->sgetc(), traits_type::eof())) {
+    m_at_end = true;
+    return traits_type::eof();
+  }
+  streamsize n_ready = min<streamsize>(max<streamsize>(
+                                         m_source_p->in_avail(), 1),
+                                       BUFFER_SIZE);
+  show(m_data, m_data + m_source_p->sgetn(m_data, n_ready));
+  return (gptr() != egptr()) ? traits_type::to_int_type(*gptr())
+                             : traits_type::eof();
+}
+
+}
@@ -0,0 +1,64 @@
+#ifndef DOCUMENT_STREAM_INCLUDE_GUARD
+#define DOCUMENT_STREAM_INCLUDE_GUARD
+
+#include <istream>
+#include <streambuf>
+
+namespace trtok {
+
+// END_OF_DOCUMENT follows every document in the streams of UTF-8 text
+// passed between the stages of a pipeline, so that many documents can flow
+// through a single run of it. The byte never occurs in UTF-8.
+char const END_OF_DOCUMENT = '\xFF';
+
+/* DocumentStream reads the documents of a source stream, each of them
+   followed by END_OF_DOCUMENT, as if they were separate streams. The stream
+   ends with every document, next_document then starts reading the next one.
+   Only the bytes the source has ready are read ahead, so a reader never
+   waits for the next document before the current one has been read. */
+class DocumentStream: public std::istream {
+
+public:
+    DocumentStream(std::istream &source):
+        std::istream(&m_buffer),
+        m_buffer(source.rdbuf())
+    {}
+
+    // next_document skips the rest of the current document and starts
+    // reading the next one. It returns false if the source has ended
+    // instead. Before the first call, the stream is empty.
+    bool next_document() {
+      clear();
+      return m_buffer.next_document();
+    }
+
+private:
+    class DocumentBuffer: public std::streambuf {
+    public:
+        DocumentBuffer(std::streambuf *source_p);
+        bool next_document();
+
+    protected:
+        virtual int_type underflow();
+
+    private:
+        // show makes the bytes from begin to end available up to the first
+        // END_OF_DOCUMENT, those after it are kept for the next documents.
+        void show(char *begin, char *end);
+
+        static int const BUFFER_SIZE = 4096;
+        std::streambuf *m_source_p;
+        char m_data[BUFFER_SIZE];
+        // The bytes read past the end of the current document.
+        char *m_next_begin;
+        char *m_next_end;
+        // Whether the end of the current document has been read.
+        bool m_at_end;
+    };
+
+    DocumentBuffer m_buffer;
+};
+
+}
+
+#endif
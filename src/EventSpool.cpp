@@ -0,0 +1,119 @@
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+
+#include "EventSpool.hpp"
+
+using namespace std;
+
+namespace trtok {
+
+EventSpool::~EventSpool() {
+  if (m_spool_file.is_open()) {
+    m_spool_file.close();
+    remove(m_spool_path.c_str());
+  }
+}
+
+void EventSpool::spool_to(string const &spool_path, size_t block_size) {
+  m_spool_path = spool_path;
+  m_block_size = block_size;
+  m_spool_file.open(spool_path.c_str(), ios::binary | ios::trunc);
+  if (!m_spool_file) {
+    throw runtime_error(spool_path + ": Cannot create the event spool.");
+  }
+}
+
+void EventSpool::add_event(uint32_t outcome, uint32_t count,
+                           features_t const &features) {
+  m_block.offsets.push_back(m_block.data.size());
+  m_block.data.push_back(outcome);
+  m_block.data.push_back(count);
+  m_block.data.push_back(features.size());
+  for (features_t::const_iterator feature = features.begin();
+       feature != features.end(); feature++) {
+    m_block.data.push_back(feature->first);
+    m_block.data.push_back(float_to_word(feature->second));
+  }
+
+  m_n_events++;
+  m_total_count += count;
+
+  if (m_spool_file.is_open() && (m_block.data.size() >= m_block_size)) {
+    write_block();
+  }
+}
+
+void EventSpool::add_block(event_list_t const &block) {
+  size_t base = m_block.data.size();
+  m_block.data.insert(m_block.data.end(), block.data.begin(),
+                      block.data.end());
+  for (size_t e = 0; e != block.size(); e++) {
+    m_block.offsets.push_back(base + block.offsets[e]);
+    m_total_count += block.data[block.offsets[e] + 1];
+  }
+  m_n_events += block.size();
+
+  if (m_spool_file.is_open() && (m_block.data.size() >= m_block_size)) {
+    write_block();
+  }
+}
+
+void EventSpool::write_block() {
+  write_event_block(m_spool_file, m_block);
+  m_spool_file.flush();
+  if (!m_spool_file) {
+    throw runtime_error(m_spool_path + ": Cannot write to the event spool.");
+  }
+
+  m_n_spooled_blocks++;
+  m_block.clear();
+}
+
+/* A spooled block consists of the number of its events, the number of
+   32-bit words making up the events and the words themselves. The offsets
+   are not stored, they are recomputed when reading the block. */
+void write_event_block(ostream &out, event_list_t const &block,
+                       size_t first, size_t end) {
+  end = min(end, block.size());
+  first = min(first, end);
+  size_t data_first = (first < block.size()) ? block.offsets[first]
+                                             : block.data.size();
+  size_t data_end = (end < block.size()) ? block.offsets[end]
+                                         : block.data.size();
+
+  uint32_t header[2];
+  header[0] = end - first;
+  header[1] = data_end - data_first;
+  out.write((char const*)header, sizeof(header));
+  if (data_end > data_first) {
+    out.write((char const*)&block.data[data_first],
+              (data_end - data_first) * sizeof(uint32_t));
+  }
+}
+
+bool read_event_block(istream &in, event_list_t &block) {
+  uint32_t header[2];
+  if (!in.read((char*)header, sizeof(header)))
+    return false;
+  block.data.resize(header[1]);
+  if (header[1] > 0)
+    in.read((char*)&block.data[0], header[1] * sizeof(uint32_t));
+  if (!in)
+    return false;
+
+  block.offsets.resize(header[0]);
+  size_t offset = 0;
+  for (uint32_t e = 0; e != header[0]; e++) {
+    if (offset + 3 > block.data.size())
+      return false;
+    block.offsets[e] = offset;
+    offset += 3 + 2 * block.data[offset + 2];
+  }
+  return offset == block.data.size();
+}
+
+}
@@ -0,0 +1,185 @@
+#ifndef EVENT_SPOOL_INCLUDE_GUARD
+#define EVENT_SPOOL_INCLUDE_GUARD
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <stdexcept>
+#include <iostream>
+#include <fstream>
+#include <boost/noncopyable.hpp>
+#include <boost/cstdint.hpp>
+typedef boost::uint32_t uint32_t;
+
+namespace trtok {
+
+/* A compact list of events. Every event is stored in the flat data buffer
+   as its outcome id, its count, the number of its features and then
+   a (predicate id, value) pair for every feature, the values being stored
+   as the bit patterns of floats. The offsets vector points to the start
+   of every event inside the buffer. */
+struct event_list_t {
+  std::vector<uint32_t> data;
+  std::vector<size_t> offsets;
+
+  size_t size() const { return offsets.size(); }
+
+  void clear() {
+    data.clear();
+    offsets.clear();
+  }
+};
+
+inline uint32_t float_to_word(float value) {
+  union { float f; uint32_t w; } u;
+  u.f = value;
+  return u.w;
+}
+
+inline float word_to_float(uint32_t word) {
+  union { float f; uint32_t w; } u;
+  u.w = word;
+  return u.f;
+}
+
+// write_event_block writes the block in the binary format of the spool
+// files, read_event_block reads it back and returns false at the end of
+// the stream. If a range is given, only the events first to end
+// (exclusive) of the block are written, as a block of their own.
+void write_event_block(std::ostream &out, event_list_t const &block,
+                       size_t first = 0, size_t end = (size_t)-1);
+bool read_event_block(std::istream &in, event_list_t &block);
+
+/* RangeVisitor passes the events of the blocks it is given which lie
+   within first_event to end_event (exclusive), or outside of them, on to
+   a visitor as ranges of events inside the blocks. The events are numbered
+   across the blocks in the order in which they are given. */
+template <class Visitor>
+class RangeVisitor {
+
+public:
+    RangeVisitor(Visitor &visitor, size_t first_event, size_t end_event,
+                 bool outside):
+        m_visitor(visitor),
+        m_first_event(first_event),
+        m_end_event(end_event),
+        m_outside(outside),
+        m_n_seen(0)
+    {}
+
+    void operator()(event_list_t const &block) {
+      size_t block_first = m_n_seen;
+      size_t block_end = m_n_seen + block.size();
+      m_n_seen = block_end;
+      if (m_outside) {
+        visit(block, block_first, block_first, std::min(block_end,
+                                                        m_first_event));
+        visit(block, block_first, std::max(block_first, m_end_event),
+              block_end);
+      } else {
+        visit(block, block_first, std::max(block_first, m_first_event),
+              std::min(block_end, m_end_event));
+      }
+    }
+
+private:
+    void visit(event_list_t const &block, size_t block_first,
+               size_t first, size_t end) {
+      if (first < end)
+        m_visitor(block, first - block_first, end - block_first);
+    }
+
+    Visitor &m_visitor;
+    size_t m_first_event;
+    size_t m_end_event;
+    bool m_outside;
+    size_t m_n_seen;
+};
+
+/* EventSpool is an append-only store of events which are handed out in
+   blocks (event_list_t). By default, all the events are kept in a single
+   block in memory. After spool_to is called, every block which grows over
+   the given size is written to a binary spool file and only the last block
+   is kept in memory, so that the memory needed for storing the events does
+   not depend on the size of the training data. */
+class EventSpool: private boost::noncopyable {
+
+public:
+    typedef std::vector< std::pair<uint32_t, float> > features_t;
+
+    EventSpool():
+        m_block_size(0),
+        m_n_events(0),
+        m_total_count(0),
+        m_n_spooled_blocks(0)
+    {}
+
+    ~EventSpool();
+
+    // spool_to makes the spool write every block which exceeds block_size
+    // 32-bit words to the file at spool_path. The file is removed when the
+    // spool is destroyed.
+    void spool_to(std::string const &spool_path, size_t block_size);
+
+    void add_event(uint32_t outcome, uint32_t count,
+                   features_t const &features);
+
+    // add_block appends all the events of the block.
+    void add_block(event_list_t const &block);
+
+    // The number of events and the sum of their counts.
+    size_t size() const { return m_n_events; }
+    size_t total_count() const { return m_total_count; }
+
+    // for_each_block calls the visitor on every block of events in the order
+    // in which the events were added, reading spooled blocks from disk.
+    template <class Visitor>
+    void for_each_block(Visitor &visitor) const {
+      if (m_n_spooled_blocks > 0) {
+        std::ifstream spool_file(m_spool_path.c_str(), std::ios::binary);
+        event_list_t block;
+        for (size_t b = 0; b != m_n_spooled_blocks; b++) {
+          if (!read_event_block(spool_file, block))
+            throw std::runtime_error(m_spool_path
+                                     + ": Event spool truncated.");
+          visitor(block);
+        }
+      }
+      if (m_block.size() > 0) {
+        visitor(m_block);
+      }
+    }
+
+    // for_each_range calls visitor(block, first, end) for the events
+    // first_event to end_event (exclusive) of the spool, first and end
+    // being their indices inside the block, see RangeVisitor. If outside
+    // is true, the visitor is called for the rest of the events instead.
+    template <class Visitor>
+    void for_each_range(Visitor &visitor, size_t first_event = 0,
+                        size_t end_event = (size_t)-1,
+                        bool outside = false) const {
+      RangeVisitor<Visitor> range_visitor(visitor, first_event, end_event,
+                                          outside);
+      for_each_block(range_visitor);
+    }
+
+private:
+    void write_block();
+
+private:
+    // Configuration
+    std::string m_spool_path;
+    size_t m_block_size;
+
+    // State
+    event_list_t m_block;
+    size_t m_n_events;
+    size_t m_total_count;
+    size_t m_n_spooled_blocks;
+    std::ofstream m_spool_file;
+};
+
+}
+
+#endif
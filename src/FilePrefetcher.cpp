@@ -0,0 +1,203 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <exception>
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/iostreams/device/array.hpp>
+#include <boost/iostreams/stream.hpp>
+#include <boost/thread.hpp>
+#include <boost/bind.hpp>
+
+#include "FilePrefetcher.hpp"
+#include "input_file.hpp"
+#if defined(USE_MMAP) && defined(HAVE_MADVISE)
+#include <sys/mman.h>
+#endif
+
+using namespace std;
+namespace fs = boost::filesystem;
+
+namespace trtok {
+
+namespace {
+
+// The stream reading a file held in memory. It is seekable, just like
+// the file stream.
+typedef boost::iostreams::stream<boost::iostreams::array_source>
+        memory_stream_t;
+
+}
+
+
+FilePrefetcher::FilePrefetcher(size_t max_files, size_t max_bytes):
+    m_max_files(max_files),
+    m_max_bytes(max_bytes),
+    m_n_ahead(0),
+    m_n_bytes(0),
+    m_stopping(false)
+{}
+
+FilePrefetcher::~FilePrefetcher() {
+  if (!m_thread.joinable())
+    return;
+  {
+    boost::mutex::scoped_lock lock(m_mutex);
+    m_stopping = true;
+    m_files_changed.notify_all();
+  }
+  m_thread.join();
+}
+
+void FilePrefetcher::add(string const &path) {
+  // A file listed twice is read ahead only for the first time.
+  if (m_file_indices.find(path) != m_file_indices.end())
+    return;
+  m_file_indices[path] = m_files.size();
+  m_files.push_back(file_entry_t(path));
+}
+
+void FilePrefetcher::start() {
+  m_thread = boost::thread(boost::bind(&FilePrefetcher::read_files, this));
+}
+
+istream *FilePrefetcher::open(string const &path) {
+  {
+    boost::mutex::scoped_lock lock(m_mutex);
+    boost::unordered_map<string, size_t>::const_iterator
+      lookup = m_file_indices.find(path);
+    if (lookup != m_file_indices.end()) {
+      file_entry_t &file = m_files[lookup->second];
+      while (file.state == READING) {
+        m_files_changed.wait(lock);
+      }
+      if (file.state == PENDING) {
+        // The background thread has not got to the file yet and will
+        // skip it.
+        file.state = DIRECT;
+      } else if (file.state == READY) {
+        file.state = IN_USE;
+#if defined(USE_MMAP) && defined(HAVE_MADVISE)
+        file.stream_p = open_input_file(file.mapping, path);
+#else
+        file.stream_p = decompressed(
+            new memory_stream_t(file.contents.data(), file.contents.size()),
+            path);
+#endif
+        m_n_ahead--;
+        m_files_changed.notify_all();
+        return file.stream_p;
+      }
+    }
+  }
+  return open_input_file(path);
+}
+
+void FilePrefetcher::close(string const &path, istream *stream_p) {
+  delete stream_p;
+
+  boost::mutex::scoped_lock lock(m_mutex);
+  boost::unordered_map<string, size_t>::const_iterator
+    lookup = m_file_indices.find(path);
+  if (lookup == m_file_indices.end())
+    return;
+  file_entry_t &file = m_files[lookup->second];
+  if ((file.state == IN_USE) && (file.stream_p == stream_p)) {
+    release(file);
+    file.stream_p = NULL;
+    file.state = DIRECT;
+    m_files_changed.notify_all();
+  }
+}
+
+void FilePrefetcher::read_files() {
+  for (size_t f = 0; f != m_files.size(); f++) {
+    file_entry_t &file = m_files[f];
+    boost::system::error_code error;
+    boost::uintmax_t size = fs::file_size(file.path, error);
+
+    {
+      boost::mutex::scoped_lock lock(m_mutex);
+      if (error || (size > m_max_bytes)) {
+        if (file.state == PENDING)
+          file.state = DIRECT;
+        continue;
+      }
+      // A file bigger than what is left of the budget is only read when
+      // nothing else is held.
+      while (!m_stopping && (file.state == PENDING)
+             && ((m_n_ahead >= m_max_files)
+                 || ((m_n_bytes > 0) && (m_n_bytes + size > m_max_bytes)))) {
+        m_files_changed.wait(lock);
+      }
+      if (m_stopping)
+        return;
+      if (file.state != PENDING)
+        continue;
+      file.state = READING;
+      file.size = size;
+      m_n_ahead++;
+      m_n_bytes += size;
+    }
+
+    // The file is read without holding the lock, so that the files read
+    // before can be opened and closed meanwhile.
+    bool complete = read_file(file);
+
+    boost::mutex::scoped_lock lock(m_mutex);
+    if (complete) {
+      file.state = READY;
+    } else {
+      // The file will be opened instead.
+      m_n_ahead--;
+      release(file);
+      file.state = DIRECT;
+    }
+    m_files_changed.notify_all();
+  }
+}
+
+#if defined(USE_MMAP) && defined(HAVE_MADVISE)
+
+bool FilePrefetcher::read_file(file_entry_t &file) {
+  // Empty files cannot be mapped.
+  if (file.size == 0)
+    return false;
+  try {
+    file.mapping.open(file.path);
+  } catch (exception const &) {
+    return false;
+  }
+  if (file.mapping.size() != file.size)
+    return false;
+  // The pages are read by the kernel in the background.
+  madvise(const_cast<char*>(file.mapping.data()), file.size, MADV_WILLNEED);
+  return true;
+}
+
+void FilePrefetcher::release(file_entry_t &file) {
+  m_n_bytes -= file.size;
+  file.size = 0;
+  // The streams reading the file share the mapping, it is unmapped when
+  // the last of them is gone.
+  file.mapping = boost::iostreams::mapped_file_source();
+}
+
+#else
+
+bool FilePrefetcher::read_file(file_entry_t &file) {
+  file.contents.resize(file.size);
+  fs::ifstream stream(fs::path(file.path), ios::in | ios::binary);
+  stream.read(&file.contents[0], file.size);
+  return stream && (stream.peek() == EOF);
+}
+
+void FilePrefetcher::release(file_entry_t &file) {
+  m_n_bytes -= file.size;
+  file.size = 0;
+  string().swap(file.contents);
+}
+
+#endif
+
+}
@@ -0,0 +1,114 @@
+#ifndef FILE_PREFETCHER_INCLUDE_GUARD
+#define FILE_PREFETCHER_INCLUDE_GUARD
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <boost/unordered_map.hpp>
+#include <boost/thread.hpp>
+#include <boost/noncopyable.hpp>
+
+#include "configuration.hpp"
+#if defined(USE_MMAP) && defined(HAVE_MADVISE)
+#include <boost/iostreams/device/mapped_file.hpp>
+#endif
+
+namespace trtok {
+
+/* FilePrefetcher reads the input files into memory in a background thread
+   while the files before them are being processed, so that the pipeline
+   does not wait for the disk (or the network) between the files. The files
+   are read in the order in which they were added, at most max_files of them
+   ahead of the ones being processed and at most max_bytes bytes of them
+   held in memory altogether. Files which do not fit in the budget, or which
+   are opened before the prefetcher gets to them, are opened by
+   open_input_file.
+
+   If trtok is configured with USE_MMAP and the system has madvise, the
+   files are not copied but memory-mapped, and the kernel is told to read
+   the mapped pages ahead (MADV_WILLNEED). The mapping is then handed over
+   to open_input_file. */
+class FilePrefetcher: private boost::noncopyable {
+
+public:
+    FilePrefetcher(size_t max_files, size_t max_bytes);
+
+    // The destructor stops the background thread.
+    ~FilePrefetcher();
+
+    // add appends a file to the files to be read ahead. The files should be
+    // added in the order in which they will be opened and all of them must
+    // be added before start is called.
+    void add(std::string const &path);
+
+    // start starts reading the files in the background.
+    void start();
+
+    // open returns a stream reading the file at path. The stream reads the
+    // file from memory if it has been read ahead, otherwise the file itself
+    // is opened. Either way, the stream must be given back to close.
+    std::istream *open(std::string const &path);
+
+    // close deletes a stream returned by open and frees the memory holding
+    // the file's contents.
+    void close(std::string const &path, std::istream *stream_p);
+
+private:
+    enum file_state_t {
+      PENDING,
+      READING,
+      READY,
+      IN_USE,
+      // The file is opened directly, it is not (or no longer) held in
+      // memory.
+      DIRECT
+    };
+
+    struct file_entry_t {
+      std::string path;
+      file_state_t state;
+#if defined(USE_MMAP) && defined(HAVE_MADVISE)
+      boost::iostreams::mapped_file_source mapping;
+#else
+      std::string contents;
+#endif
+      // The bytes counted against the budget for the file.
+      size_t size;
+      // The stream reading the contents while the file is IN_USE.
+      std::istream *stream_p;
+
+      file_entry_t(std::string const &path_):
+        path(path_), state(PENDING), size(0), stream_p(NULL)
+      {}
+    };
+
+    void read_files();
+
+    // read_file reads the file ahead, it returns false if the file could
+    // not be read or has changed. The lock is not held meanwhile.
+    bool read_file(file_entry_t &file);
+
+    // release frees the memory holding the file's contents and gives the
+    // bytes back to the budget.
+    void release(file_entry_t &file);
+
+private:
+    size_t m_max_files;
+    size_t m_max_bytes;
+
+    std::vector<file_entry_t> m_files;
+    boost::unordered_map<std::string, size_t> m_file_indices;
+
+    // The files being read or read and not yet opened.
+    size_t m_n_ahead;
+    // The bytes held by the files being read, read or in use.
+    size_t m_n_bytes;
+    bool m_stopping;
+    boost::mutex m_mutex;
+    boost::condition_variable m_files_changed;
+    boost::thread m_thread;
+};
+
+}
+
+#endif
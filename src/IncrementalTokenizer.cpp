@@ -0,0 +1,217 @@
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "IncrementalTokenizer.hpp"
+
+using namespace std;
+
+namespace trtok {
+
+namespace {
+
+bool same_token(token_t const &a, token_t const &b) {
+  return (a.text == b.text) && (a.n_newlines == b.n_newlines)
+      && ((a.decision_flags & (MAY_SPLIT_FLAG | MAY_JOIN_FLAG
+                               | MAY_BREAK_SENTENCE_FLAG))
+          == (b.decision_flags & (MAY_SPLIT_FLAG | MAY_JOIN_FLAG
+                                  | MAY_BREAK_SENTENCE_FLAG)));
+}
+
+}
+
+
+void IncrementalTokenizer::start_lexing(string const &text, size_t begin) {
+  m_text_p = &text;
+  m_text_buffer.set(text.data() + begin, text.data() + text.length());
+  m_input.clear();
+  m_wrapper_p->setup(&m_input, "UTF-8");
+  m_position = begin;
+  m_first_token = true;
+}
+
+bool IncrementalTokenizer::next_token(token_t &token, size_t &offset) {
+  // The same as in RoughTokenizer, the blank tokens at the start of the
+  // input are skipped and the flags and whitespace following a token
+  // piece belong to it.
+  if (m_first_token) {
+    do {
+      m_last_rough_tok = m_wrapper_p->receive();
+    } while ((m_last_rough_tok.type_id != TOKEN_PIECE_ID)
+          && (m_last_rough_tok.type_id != TERMINATION_ID));
+    m_first_token = false;
+  }
+  if (m_last_rough_tok.type_id == TERMINATION_ID)
+    return false;
+
+  token = token_t();
+  token.text = m_last_rough_tok.text;
+  // Only whitespace is left out between the token pieces.
+  offset = m_text_p->find(token.text, m_position);
+  if (offset == string::npos)
+    offset = m_position;
+  m_position = offset + token.text.length();
+
+  m_last_rough_tok = m_wrapper_p->receive();
+  while ((m_last_rough_tok.type_id != TOKEN_PIECE_ID)
+      && (m_last_rough_tok.type_id != TERMINATION_ID)) {
+    switch (m_last_rough_tok.type_id) {
+      case MAY_SPLIT_ID:
+        token.decision_flags = (decision_flags_t)
+              (token.decision_flags | MAY_SPLIT_FLAG);
+        break;
+      case MAY_JOIN_ID:
+        token.decision_flags = (decision_flags_t)
+              (token.decision_flags | MAY_JOIN_FLAG);
+        break;
+      case MAY_BREAK_SENTENCE_ID:
+        token.decision_flags = (decision_flags_t)
+              (token.decision_flags | MAY_BREAK_SENTENCE_FLAG);
+        break;
+      case WHITESPACE_ID:
+        token.n_newlines = m_last_rough_tok.n_newlines;
+        break;
+      default:
+        break;
+    }
+    m_last_rough_tok = m_wrapper_p->receive();
+  }
+  return true;
+}
+
+void IncrementalTokenizer::extract_features(vector<token_t> &tokens,
+                                            size_t first, size_t end) {
+  chunk_t chunk;
+  chunk.tokens.resize(end - first);
+  for (size_t t = first; t != end; t++) {
+    chunk.tokens[t - first].text.swap(tokens[t].text);
+  }
+  m_feature_extractor(&chunk);
+  for (size_t t = first; t != end; t++) {
+    tokens[t].text.swap(chunk.tokens[t - first].text);
+    tokens[t].property_flags.swap(chunk.tokens[t - first].property_flags);
+  }
+}
+
+void IncrementalTokenizer::tokenize(string const &text,
+                                    tokenization_t &result) {
+  result.text = text;
+  result.tokens.clear();
+  result.offsets.clear();
+
+  start_lexing(result.text, 0);
+  token_t token;
+  size_t offset;
+  while (next_token(token, offset)) {
+    result.tokens.push_back(token);
+    result.offsets.push_back(offset);
+  }
+  extract_features(result.tokens, 0, result.tokens.size());
+
+  m_n_lexed = result.tokens.size();
+  m_n_decided = m_classifier.redecide(result.tokens, 0,
+                                      result.tokens.size());
+}
+
+void IncrementalTokenizer::retokenize(tokenization_t &result,
+                                      size_t edit_begin, size_t edit_end,
+                                      string const &replacement) {
+  vector<token_t> &tokens = result.tokens;
+  vector<size_t> &offsets = result.offsets;
+  long delta = (long)replacement.length() - (long)(edit_end - edit_begin);
+  size_t new_edit_end = edit_begin + replacement.length();
+
+  // The last token starting at or before the edit may be extended by it.
+  size_t touched = upper_bound(offsets.begin(), offsets.end(), edit_begin)
+                   - offsets.begin();
+  if (touched > 0)
+    touched--;
+
+  // The lexer is restarted some tokens before the edit, at a token which
+  // follows whitespace.
+  size_t restart = (touched > m_lexer_margin)
+                   ? touched - m_lexer_margin : 0;
+  while ((restart > 0) && (tokens[restart - 1].n_newlines < 0))
+    restart--;
+
+  result.text.replace(edit_begin, edit_end - edit_begin, replacement);
+  start_lexing(result.text, (restart > 0) ? offsets[restart] : 0);
+
+  // The new tokens are lexed until m_lexer_margin of them in a row after the
+  // edit are the same as the old ones, from old_end on the old tokens are
+  // kept.
+  vector<token_t> new_tokens;
+  vector<size_t> new_offsets;
+  size_t old_end = tokens.size();
+  size_t n_matching = 0;
+  size_t last_match = 0;
+  token_t token;
+  size_t offset;
+  while (next_token(token, offset)) {
+    new_tokens.push_back(token);
+    new_offsets.push_back(offset);
+    if (offset < new_edit_end)
+      continue;
+
+    size_t old_offset = offset - delta;
+    size_t match = lower_bound(offsets.begin(), offsets.end(), old_offset)
+                   - offsets.begin();
+    if ((match < tokens.size()) && (offsets[match] == old_offset)
+        && same_token(tokens[match], token)) {
+      n_matching = ((n_matching > 0) && (match == last_match + 1))
+                   ? n_matching + 1 : 1;
+      last_match = match;
+      if (n_matching == m_lexer_margin) {
+        old_end = match + 1;
+        break;
+      }
+    } else {
+      n_matching = 0;
+    }
+  }
+
+  // The tokens before the edit must not be affected by restarting the
+  // lexer. The ones closest to the edit may still change due to the
+  // lexer's lookahead.
+  size_t changed_begin = restart;
+  while ((changed_begin - restart < new_tokens.size())
+         && (changed_begin < touched)
+         && (new_offsets[changed_begin - restart] == offsets[changed_begin])
+         && same_token(new_tokens[changed_begin - restart],
+                       tokens[changed_begin])) {
+    changed_begin++;
+  }
+  if ((restart > 0)
+      && (changed_begin - restart < min(touched - restart,
+                                        m_lexer_margin / 2))) {
+    string text;
+    text.swap(result.text);
+    tokenize(text, result);
+    return;
+  }
+
+  // Splicing the new tokens in place of the old ones (the tokens before
+  // changed_begin keep their decisions),...
+  for (size_t t = restart; t != changed_begin; t++) {
+    new_tokens[t - restart].decision_flags = tokens[t].decision_flags;
+  }
+  extract_features(new_tokens, 0, new_tokens.size());
+  tokens.erase(tokens.begin() + restart, tokens.begin() + old_end);
+  tokens.insert(tokens.begin() + restart,
+                new_tokens.begin(), new_tokens.end());
+  offsets.erase(offsets.begin() + restart, offsets.begin() + old_end);
+  offsets.insert(offsets.begin() + restart,
+                 new_offsets.begin(), new_offsets.end());
+  size_t changed_end = restart + new_tokens.size();
+  for (size_t t = changed_end; t != offsets.size(); t++) {
+    offsets[t] += delta;
+  }
+
+  // and deciding again the tokens whose context has changed.
+  size_t first = (changed_begin > (size_t)m_postcontext)
+                 ? changed_begin - m_postcontext : 0;
+  m_n_lexed = new_tokens.size();
+  m_n_decided = m_classifier.redecide(tokens, first, changed_end) - first;
+}
+
+}
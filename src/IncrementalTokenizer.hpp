@@ -0,0 +1,116 @@
+#ifndef INCREMENTAL_TOKENIZER_INCLUDE_GUARD
+#define INCREMENTAL_TOKENIZER_INCLUDE_GUARD
+
+#include <string>
+#include <vector>
+#include <istream>
+
+#include "roughtok/roughtok_wrapper.hpp"
+#include "token_t.hpp"
+#include "FeatureExtractor.hpp"
+#include "Classifier.hpp"
+#include "MemoryBuffer.hpp"
+
+namespace trtok {
+
+/* tokenization_t is the result of tokenizing a text with an
+   IncrementalTokenizer: the rough tokens of the text along with the
+   classifier's decisions and the byte offset of every token in the text. */
+struct tokenization_t {
+  std::string text;
+  std::vector<token_t> tokens;
+  std::vector<size_t> offsets;
+};
+
+/* IncrementalTokenizer tokenizes a text held in memory outside of the
+   pipeline and, when the text is edited, updates the tokenization by
+   processing only the region affected by the edit.
+
+   The rough lexer is restarted lexer_margin tokens before the edit, at
+   a token preceded by whitespace, and it runs until it is back in step with
+   the old tokens for lexer_margin tokens after the edit. If the restarted
+   lexer does not reproduce the tokens before the edit, the whole text is
+   tokenized again. The tokens whose context has changed are then decided
+   again by the Classifier (see Classifier::redecide), which stops as soon
+   as the decisions no longer differ from the old ones.
+
+   The result is the same as that of tokenizing the edited text from
+   scratch as long as the decision points the lexer finds depend on no more
+   than lexer_margin tokens around them. The lexer's rules are not
+   inspected, so a scheme whose .split, .join or .break contexts span more
+   tokens than the default LEXER_MARGIN needs a larger margin. The margin
+   is checked against the lexers of the bundled schemes by
+   trtok_incremental_test.
+
+   The text is expected in UTF-8 and without XML markup or entities, i.e.
+   in the form produced by the TextCleaner. The Classifier must be in
+   TOKENIZE_MODE and have its model loaded. */
+class IncrementalTokenizer {
+
+public:
+    IncrementalTokenizer(IRoughLexerWrapper *wrapper_p,
+                         FeatureExtractor &feature_extractor,
+                         Classifier &classifier,
+                         int precontext,
+                         int postcontext,
+                         int lexer_margin = LEXER_MARGIN):
+        m_wrapper_p(wrapper_p),
+        m_feature_extractor(feature_extractor),
+        m_classifier(classifier),
+        m_precontext(precontext),
+        m_postcontext(postcontext),
+        m_lexer_margin(lexer_margin),
+        m_text_p(NULL),
+        m_input(&m_text_buffer),
+        m_n_lexed(0),
+        m_n_decided(0)
+    {}
+
+    // tokenize tokenizes the whole text.
+    void tokenize(std::string const &text, tokenization_t &result);
+
+    // retokenize replaces the bytes [edit_begin, edit_end) of result.text
+    // with replacement and updates the tokenization accordingly.
+    void retokenize(tokenization_t &result, size_t edit_begin,
+                    size_t edit_end, std::string const &replacement);
+
+    // The number of tokens lexed and decided by the last call to tokenize
+    // or retokenize.
+    size_t n_lexed() const { return m_n_lexed; }
+    size_t n_decided() const { return m_n_decided; }
+
+    // The default lexer_margin.
+    static int const LEXER_MARGIN = 8;
+
+private:
+    // start_lexing makes the lexer read text from offset begin on.
+    void start_lexing(std::string const &text, size_t begin);
+    // next_token reads the next token and its offset in the text, it
+    // returns false at the end of the text.
+    bool next_token(token_t &token, size_t &offset);
+    void extract_features(std::vector<token_t> &tokens, size_t first,
+                          size_t end);
+
+    // Configuration
+    IRoughLexerWrapper *m_wrapper_p;
+    FeatureExtractor &m_feature_extractor;
+    Classifier &m_classifier;
+    int m_precontext;
+    int m_postcontext;
+    size_t m_lexer_margin;
+
+    // State of the lexing
+    std::string const *m_text_p;
+    MemoryBuffer m_text_buffer;
+    std::istream m_input;
+    size_t m_position;
+    rough_token_t m_last_rough_tok;
+    bool m_first_token;
+
+    size_t m_n_lexed;
+    size_t m_n_decided;
+};
+
+}
+
+#endif
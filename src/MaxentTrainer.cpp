@@ -0,0 +1,1334 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+#include <cmath>
+#include <boost/unordered_map.hpp>
+#include "tbb/task_scheduler_init.h"
+#include "tbb/parallel_for.h"
+#include "tbb/blocked_range.h"
+#include "tbb/partitioner.h"
+
+#include "MaxentTrainer.hpp"
+#include "CompactModel.hpp"
+#include "feature_hash.hpp"
+
+using namespace std;
+
+namespace trtok {
+
+namespace {
+
+inline double dot(vector<double> const &a, vector<double> const &b) {
+  double sum = 0.0;
+  for (size_t i = 0; i != a.size(); i++) {
+    sum += a[i] * b[i];
+  }
+  return sum;
+}
+
+// The contribution of a single shard of events to the log-likelihood and
+// to the expectations of the parameters.
+struct shard_result_t {
+  double loglik;
+  size_t n_correct;
+  vector<double> expected;
+};
+
+/* ShardEvaluator is the body of the tbb::parallel_for which processes the
+   shards of a range of events inside a block. Every shard is a contiguous
+   part of the range and the results are accumulated per shard over all the
+   blocks so that they can be summed up in a fixed order, which makes
+   training deterministic for a given number of shards. */
+class ShardEvaluator {
+
+public:
+    ShardEvaluator(event_list_t const &events,
+                   size_t first_event, size_t end_event,
+                   vector<size_t> const &param_offsets,
+                   vector<uint32_t> const &param_outcomes,
+                   vector<double> const &theta,
+                   size_t n_outcomes,
+                   bool compute_expected,
+                   vector<shard_result_t> &results):
+        m_events(events),
+        m_first_event(first_event),
+        m_end_event(end_event),
+        m_param_offsets(param_offsets),
+        m_param_outcomes(param_outcomes),
+        m_theta(theta),
+        m_n_outcomes(n_outcomes),
+        m_compute_expected(compute_expected),
+        m_results(results)
+    {}
+
+    void operator()(tbb::blocked_range<size_t> const &shards) const {
+      for (size_t shard = shards.begin(); shard != shards.end(); shard++) {
+        evaluate_shard(shard);
+      }
+    }
+
+private:
+    void evaluate_shard(size_t shard) const {
+      size_t n_shards = m_results.size();
+      size_t n_events = m_end_event - m_first_event;
+      size_t begin = m_first_event + n_events * shard / n_shards;
+      size_t end = m_first_event + n_events * (shard + 1) / n_shards;
+      size_t n_preds = m_param_offsets.size() - 1;
+
+      shard_result_t &result = m_results[shard];
+
+      vector<double> scores(m_n_outcomes);
+      for (size_t e = begin; e != end; e++) {
+        uint32_t const *event = &m_events.data[m_events.offsets[e]];
+        uint32_t outcome = event[0];
+        double count = event[1];
+        uint32_t n_features = event[2];
+        uint32_t const *features = event + 3;
+
+        fill(scores.begin(), scores.end(), 0.0);
+        for (uint32_t f = 0; f != n_features; f++) {
+          uint32_t pred = features[2 * f];
+          if (pred >= n_preds)
+            continue;
+          float value = word_to_float(features[2 * f + 1]);
+          for (size_t k = m_param_offsets[pred];
+               k != m_param_offsets[pred + 1]; k++) {
+            scores[m_param_outcomes[k]] += value * m_theta[k];
+          }
+        }
+
+        size_t best = 0;
+        for (size_t o = 1; o != m_n_outcomes; o++) {
+          if (scores[o] > scores[best])
+            best = o;
+        }
+        double max_score = scores[best];
+        double normalizer = 0.0;
+        for (size_t o = 0; o != m_n_outcomes; o++) {
+          scores[o] = exp(scores[o] - max_score);
+          normalizer += scores[o];
+        }
+
+        // scores now hold unnormalized probabilities
+        result.loglik += count * log(scores[outcome] / normalizer);
+        if (best == outcome) {
+          result.n_correct += event[1];
+        }
+
+        if (m_compute_expected) {
+          for (size_t o = 0; o != m_n_outcomes; o++) {
+            scores[o] /= normalizer;
+          }
+          for (uint32_t f = 0; f != n_features; f++) {
+            uint32_t pred = features[2 * f];
+            if (pred >= n_preds)
+              continue;
+            double weight = count * word_to_float(features[2 * f + 1]);
+            for (size_t k = m_param_offsets[pred];
+                 k != m_param_offsets[pred + 1]; k++) {
+              result.expected[k] += weight * scores[m_param_outcomes[k]];
+            }
+          }
+        }
+      }
+    }
+
+    event_list_t const &m_events;
+    size_t m_first_event;
+    size_t m_end_event;
+    vector<size_t> const &m_param_offsets;
+    vector<uint32_t> const &m_param_outcomes;
+    vector<double> const &m_theta;
+    size_t m_n_outcomes;
+    bool m_compute_expected;
+    vector<shard_result_t> &m_results;
+};
+
+/* BlockEvaluator hands every range of events to a ShardEvaluator. */
+class BlockEvaluator {
+
+public:
+    BlockEvaluator(vector<size_t> const &param_offsets,
+                   vector<uint32_t> const &param_outcomes,
+                   vector<double> const &theta,
+                   size_t n_outcomes,
+                   bool compute_expected,
+                   vector<shard_result_t> &results):
+        m_param_offsets(param_offsets),
+        m_param_outcomes(param_outcomes),
+        m_theta(theta),
+        m_n_outcomes(n_outcomes),
+        m_compute_expected(compute_expected),
+        m_results(results)
+    {}
+
+    void operator()(event_list_t const &block, size_t first, size_t end) {
+      ShardEvaluator evaluator(block, first, end,
+                               m_param_offsets, m_param_outcomes,
+                               m_theta, m_n_outcomes, m_compute_expected,
+                               m_results);
+      tbb::parallel_for(tbb::blocked_range<size_t>(0, m_results.size(), 1),
+                        evaluator, tbb::simple_partitioner());
+    }
+
+private:
+    vector<size_t> const &m_param_offsets;
+    vector<uint32_t> const &m_param_outcomes;
+    vector<double> const &m_theta;
+    size_t m_n_outcomes;
+    bool m_compute_expected;
+    vector<shard_result_t> &m_results;
+};
+
+/* OutcomeCollector finds the outcomes seen with every predicate which
+   survives the cutoff. */
+class OutcomeCollector {
+
+public:
+    OutcomeCollector(vector<size_t> const &pred_counts, size_t event_cutoff,
+                     vector< vector<uint32_t> > &pred_outcomes):
+        m_pred_counts(pred_counts),
+        m_event_cutoff(event_cutoff),
+        m_pred_outcomes(pred_outcomes)
+    {}
+
+    void operator()(event_list_t const &block, size_t first, size_t end) {
+      for (size_t e = first; e != end; e++) {
+        uint32_t const *event = &block.data[block.offsets[e]];
+        uint32_t outcome = event[0];
+        uint32_t n_features = event[2];
+        for (uint32_t f = 0; f != n_features; f++) {
+          uint32_t pred = event[3 + 2 * f];
+          if (m_pred_counts[pred] < m_event_cutoff)
+            continue;
+          vector<uint32_t> &outcomes = m_pred_outcomes[pred];
+          if (find(outcomes.begin(), outcomes.end(), outcome)
+                == outcomes.end())
+            outcomes.push_back(outcome);
+        }
+      }
+    }
+
+private:
+    vector<size_t> const &m_pred_counts;
+    size_t m_event_cutoff;
+    vector< vector<uint32_t> > &m_pred_outcomes;
+};
+
+/* ObservedCounter computes the empirical expectations of the parameters. */
+class ObservedCounter {
+
+public:
+    ObservedCounter(vector<size_t> const &param_offsets,
+                    vector<uint32_t> const &param_outcomes,
+                    vector<double> &observed):
+        m_param_offsets(param_offsets),
+        m_param_outcomes(param_outcomes),
+        m_observed(observed)
+    {}
+
+    void operator()(event_list_t const &block, size_t first, size_t end) {
+      for (size_t e = first; e != end; e++) {
+        uint32_t const *event = &block.data[block.offsets[e]];
+        uint32_t outcome = event[0];
+        uint32_t n_features = event[2];
+        for (uint32_t f = 0; f != n_features; f++) {
+          uint32_t pred = event[3 + 2 * f];
+          for (size_t k = m_param_offsets[pred];
+               k != m_param_offsets[pred + 1]; k++) {
+            if (m_param_outcomes[k] == outcome) {
+              m_observed[k] += event[1] * word_to_float(event[4 + 2 * f]);
+            }
+          }
+        }
+      }
+    }
+
+private:
+    vector<size_t> const &m_param_offsets;
+    vector<uint32_t> const &m_param_outcomes;
+    vector<double> &m_observed;
+};
+
+/* CountRemover takes the predicates of the events out of the predicate
+   counts and sums up the counts of the events. */
+class CountRemover {
+
+public:
+    CountRemover(vector<size_t> &pred_counts):
+        m_pred_counts(pred_counts),
+        m_total_count(0)
+    {}
+
+    void operator()(event_list_t const &block, size_t first, size_t end) {
+      for (size_t e = first; e != end; e++) {
+        uint32_t const *event = &block.data[block.offsets[e]];
+        for (uint32_t f = 0; f != event[2]; f++) {
+          m_pred_counts[event[3 + 2 * f]] -= event[1];
+        }
+        m_total_count += event[1];
+      }
+    }
+
+    size_t total_count() const { return m_total_count; }
+
+private:
+    vector<size_t> &m_pred_counts;
+    size_t m_total_count;
+};
+
+/* EventMerger copies the events of another trainer, translating their
+   predicate and outcome ids. Features whose predicates are mapped to
+   no_pred are dropped. */
+class EventMerger {
+
+public:
+    static const uint32_t no_pred = 0xffffffff;
+
+    EventMerger(vector<uint32_t> const &pred_map,
+                vector<uint32_t> const &outcome_map,
+                vector<size_t> *pred_counts_p,
+                EventSpool &events):
+        m_pred_map(pred_map),
+        m_outcome_map(outcome_map),
+        m_pred_counts_p(pred_counts_p),
+        m_events(events)
+    {}
+
+    void operator()(event_list_t const &block, size_t first, size_t end) {
+      for (size_t e = first; e != end; e++) {
+        uint32_t const *event = &block.data[block.offsets[e]];
+        m_features.clear();
+        for (uint32_t f = 0; f != event[2]; f++) {
+          uint32_t pred = m_pred_map[event[3 + 2 * f]];
+          if (pred == no_pred)
+            continue;
+          if (m_pred_counts_p != NULL)
+            (*m_pred_counts_p)[pred] += event[1];
+          m_features.push_back(make_pair(pred,
+                                         word_to_float(event[4 + 2 * f])));
+        }
+        m_events.add_event(m_outcome_map[event[0]], event[1], m_features);
+      }
+    }
+
+private:
+    vector<uint32_t> const &m_pred_map;
+    vector<uint32_t> const &m_outcome_map;
+    vector<size_t> *m_pred_counts_p;
+    EventSpool &m_events;
+    EventSpool::features_t m_features;
+};
+
+/* BlockWriter writes every range of events to a stream as a block. */
+class BlockWriter {
+
+public:
+    BlockWriter(ostream &out): m_out(out) {}
+
+    void operator()(event_list_t const &block, size_t first, size_t end) {
+      write_event_block(m_out, block, first, end);
+    }
+
+private:
+    ostream &m_out;
+};
+
+// The strings in an events file are stored as their length followed by
+// their bytes.
+void write_string(ostream &out, string const &str) {
+  uint32_t length = str.length();
+  out.write((char const*)&length, sizeof(length));
+  out.write(str.data(), length);
+}
+
+bool read_string(istream &in, string &str) {
+  uint32_t length;
+  if (!in.read((char*)&length, sizeof(length)))
+    return false;
+  str.resize(length);
+  return (length == 0) || in.read(&str[0], length);
+}
+
+/* HeldoutClassifier finds the most probable outcome of every event and
+   records it in the evaluation statistics. */
+class HeldoutClassifier {
+
+public:
+    HeldoutClassifier(vector<size_t> const &param_offsets,
+                      vector<uint32_t> const &param_outcomes,
+                      vector<double> const &theta,
+                      vector<string> const &outcome_names,
+                      uint32_t break_pred,
+                      uint32_t split_pred,
+                      uint32_t join_pred,
+                      evaluation_stats_t &stats):
+        m_param_offsets(param_offsets),
+        m_param_outcomes(param_outcomes),
+        m_theta(theta),
+        m_break_pred(break_pred),
+        m_split_pred(split_pred),
+        m_join_pred(join_pred),
+        m_stats(stats),
+        m_scores(outcome_names.size())
+    {
+      for (size_t o = 0; o != outcome_names.size(); o++) {
+        m_outcomes.push_back(outcome_from_name(outcome_names[o]));
+      }
+    }
+
+    void operator()(event_list_t const &block, size_t first, size_t end) {
+      size_t n_preds = m_param_offsets.size() - 1;
+      for (size_t e = first; e != end; e++) {
+        uint32_t const *event = &block.data[block.offsets[e]];
+        uint32_t n_features = event[2];
+        uint32_t const *features = event + 3;
+
+        bool segmentation_decision = false;
+        bool tokenization_decision = false;
+        fill(m_scores.begin(), m_scores.end(), 0.0);
+        for (uint32_t f = 0; f != n_features; f++) {
+          uint32_t pred = features[2 * f];
+          if (pred == m_break_pred)
+            segmentation_decision = true;
+          if ((pred == m_split_pred) || (pred == m_join_pred))
+            tokenization_decision = true;
+          if (pred >= n_preds)
+            continue;
+          float value = word_to_float(features[2 * f + 1]);
+          for (size_t k = m_param_offsets[pred];
+               k != m_param_offsets[pred + 1]; k++) {
+            m_scores[m_param_outcomes[k]] += value * m_theta[k];
+          }
+        }
+
+        size_t best = 0;
+        for (size_t o = 1; o != m_scores.size(); o++) {
+          if (m_scores[o] > m_scores[best])
+            best = o;
+        }
+        for (uint32_t n = 0; n != event[1]; n++) {
+          m_stats.add(m_outcomes[best], m_outcomes[event[0]],
+                      segmentation_decision, tokenization_decision);
+        }
+      }
+    }
+
+private:
+    vector<size_t> const &m_param_offsets;
+    vector<uint32_t> const &m_param_outcomes;
+    vector<double> const &m_theta;
+    vector<outcome_t> m_outcomes;
+    uint32_t m_break_pred;
+    uint32_t m_split_pred;
+    uint32_t m_join_pred;
+    evaluation_stats_t &m_stats;
+    vector<double> m_scores;
+};
+
+/* CorrectionFinder finds the GIS correction constant, which is the largest
+   total value of active features in any event. */
+class CorrectionFinder {
+
+public:
+    CorrectionFinder(vector<size_t> const &param_offsets):
+        m_param_offsets(param_offsets),
+        m_correction(0.0)
+    {}
+
+    void operator()(event_list_t const &block, size_t first, size_t end) {
+      for (size_t e = first; e != end; e++) {
+        uint32_t const *event = &block.data[block.offsets[e]];
+        double total = 0.0;
+        for (uint32_t f = 0; f != event[2]; f++) {
+          uint32_t pred = event[3 + 2 * f];
+          if (m_param_offsets[pred] != m_param_offsets[pred + 1])
+            total += word_to_float(event[4 + 2 * f]);
+        }
+        m_correction = max(m_correction, total);
+      }
+    }
+
+    double correction() const { return m_correction; }
+
+private:
+    vector<size_t> const &m_param_offsets;
+    double m_correction;
+};
+
+}
+
+
+template <class Visitor>
+void MaxentTrainer::for_each_range(bool heldout, Visitor &visitor) const {
+  MaxentTrainer const &source = event_source();
+  if (m_first_heldout != m_end_heldout) {
+    source.m_events.for_each_range(visitor, m_first_heldout, m_end_heldout,
+                                   !heldout);
+  } else {
+    (heldout ? source.m_heldout_events : source.m_events)
+      .for_each_range(visitor);
+  }
+}
+
+size_t MaxentTrainer::n_events() const {
+  MaxentTrainer const &source = event_source();
+  return source.m_events.size() - (m_end_heldout - m_first_heldout);
+}
+
+size_t MaxentTrainer::n_heldout_events() const {
+  MaxentTrainer const &source = event_source();
+  return (m_first_heldout != m_end_heldout)
+           ? m_end_heldout - m_first_heldout
+           : source.m_heldout_events.size();
+}
+
+size_t MaxentTrainer::total_count(bool heldout) const {
+  MaxentTrainer const &source = event_source();
+  if (heldout) {
+    return (m_first_heldout != m_end_heldout)
+             ? m_heldout_count : source.m_heldout_events.total_count();
+  } else {
+    return source.m_events.total_count() - m_heldout_count;
+  }
+}
+
+uint32_t MaxentTrainer::outcome_id(string const &outcome) {
+  boost::unordered_map<string, uint32_t>::const_iterator
+    lookup = m_outcome_ids.find(outcome);
+  if (lookup != m_outcome_ids.end()) {
+    return lookup->second;
+  }
+  uint32_t id = m_outcome_names.size();
+  m_outcome_ids[outcome] = id;
+  m_outcome_names.push_back(outcome);
+  return id;
+}
+
+uint32_t MaxentTrainer::pred_id(string const &pred) {
+  boost::unordered_map<string, uint32_t>::const_iterator
+    lookup = m_pred_ids.find(pred);
+  if (lookup != m_pred_ids.end()) {
+    return lookup->second;
+  }
+  uint32_t id = m_pred_names.size();
+  m_pred_ids[pred] = id;
+  m_pred_names.push_back(pred);
+  m_pred_counts.push_back(0);
+  return id;
+}
+
+void MaxentTrainer::add_event(context_t const &context,
+                              string const &outcome,
+                              bool heldout) {
+  m_features.clear();
+  for (context_t::const_iterator feature = context.begin();
+       feature != context.end(); feature++) {
+    boost::unordered_map<string, uint32_t>::const_iterator
+      lookup = m_pred_ids.find(feature->first);
+    uint32_t pred;
+    if (lookup != m_pred_ids.end()) {
+      pred = lookup->second;
+    } else if (heldout) {
+      // Predicates never seen in training have no parameters.
+      continue;
+    } else {
+      pred = m_pred_names.size();
+      m_pred_ids[feature->first] = pred;
+      m_pred_names.push_back(feature->first);
+      m_pred_counts.push_back(0);
+    }
+    if (!heldout) {
+      m_pred_counts[pred]++;
+    }
+    m_features.push_back(make_pair(pred, feature->second));
+  }
+
+  EventSpool &events = heldout ? m_heldout_events : m_events;
+  events.add_event(outcome_id(outcome), 1, m_features);
+}
+
+void MaxentTrainer::add_events(MaxentTrainer const &other, bool heldout) {
+  // New predicates are numbered in the order of their ids in the other
+  // trainer, which is the order in which they were first seen. Merging
+  // trainers filled from consecutive parts of the data therefore gives
+  // the same ids as adding all the events to a single trainer.
+  vector<uint32_t> pred_map(other.m_pred_names.size());
+  for (size_t p = 0; p != other.m_pred_names.size(); p++) {
+    string const &name = other.m_pred_names[p];
+    boost::unordered_map<string, uint32_t>::const_iterator
+      lookup = m_pred_ids.find(name);
+    if (lookup != m_pred_ids.end()) {
+      pred_map[p] = lookup->second;
+    } else if (heldout) {
+      pred_map[p] = EventMerger::no_pred;
+    } else {
+      pred_map[p] = m_pred_names.size();
+      m_pred_ids[name] = pred_map[p];
+      m_pred_names.push_back(name);
+      m_pred_counts.push_back(0);
+    }
+  }
+
+  vector<uint32_t> outcome_map(other.m_outcome_names.size());
+  for (size_t o = 0; o != other.m_outcome_names.size(); o++) {
+    outcome_map[o] = outcome_id(other.m_outcome_names[o]);
+  }
+
+  EventMerger merger(pred_map, outcome_map,
+                     heldout ? NULL : &m_pred_counts,
+                     heldout ? m_heldout_events : m_events);
+  other.for_each_range(false, merger);
+}
+
+void MaxentTrainer::add_heldout_events(MaxentTrainer const &other) {
+  vector<uint32_t> pred_map(other.m_pred_names.size());
+  for (size_t p = 0; p != other.m_pred_names.size(); p++) {
+    boost::unordered_map<string, uint32_t>::const_iterator
+      lookup = m_pred_ids.find(other.m_pred_names[p]);
+    pred_map[p] = (lookup != m_pred_ids.end()) ? lookup->second
+                                               : EventMerger::no_pred;
+  }
+
+  vector<uint32_t> outcome_map(other.m_outcome_names.size());
+  for (size_t o = 0; o != other.m_outcome_names.size(); o++) {
+    outcome_map[o] = outcome_id(other.m_outcome_names[o]);
+  }
+
+  EventMerger merger(pred_map, outcome_map, NULL, m_heldout_events);
+  other.for_each_range(true, merger);
+}
+
+void MaxentTrainer::share_events(MaxentTrainer const &source) {
+  m_pred_ids = source.m_pred_ids;
+  m_pred_names = source.m_pred_names;
+  m_pred_counts = source.m_pred_counts;
+  m_outcome_ids = source.m_outcome_ids;
+  m_outcome_names = source.m_outcome_names;
+  m_initial_preds = source.m_initial_preds;
+  m_initial_params = source.m_initial_params;
+  m_source_p = &source;
+  m_first_heldout = m_end_heldout = 0;
+  m_heldout_count = 0;
+}
+
+void MaxentTrainer::share_events(MaxentTrainer const &source,
+                                 size_t first_heldout, size_t end_heldout) {
+  share_events(source);
+  end_heldout = min(end_heldout, source.n_events());
+  if (first_heldout >= end_heldout)
+    return;
+
+  m_first_heldout = first_heldout;
+  m_end_heldout = end_heldout;
+  CountRemover remover(m_pred_counts);
+  source.m_events.for_each_range(remover, first_heldout, end_heldout);
+  m_heldout_count = remover.total_count();
+}
+
+void MaxentTrainer::spool_to(string const &events_path,
+                             string const &heldout_events_path,
+                             size_t block_size) {
+  m_events.spool_to(events_path, block_size);
+  m_heldout_events.spool_to(heldout_events_path, block_size);
+}
+
+/* An events file starts with EVENTS_FILE_MAGIC and the number of events,
+   followed by the number of outcomes and their names and the number of
+   predicates and their names and counts. The rest are blocks of events in
+   the format of the event spool files. */
+static const uint32_t EVENTS_FILE_MAGIC = 0x31567274; // "trV1"
+
+void MaxentTrainer::save_events(string const &events_path) const {
+  ofstream events_file(events_path.c_str(), ios::binary | ios::trunc);
+  uint32_t header[3];
+  header[0] = EVENTS_FILE_MAGIC;
+  header[1] = n_events();
+  header[2] = m_outcome_names.size();
+  events_file.write((char const*)header, sizeof(header));
+  for (size_t o = 0; o != m_outcome_names.size(); o++) {
+    write_string(events_file, m_outcome_names[o]);
+  }
+  uint32_t n_preds = m_pred_names.size();
+  events_file.write((char const*)&n_preds, sizeof(n_preds));
+  for (size_t p = 0; p != m_pred_names.size(); p++) {
+    uint32_t count = m_pred_counts[p];
+    events_file.write((char const*)&count, sizeof(count));
+    write_string(events_file, m_pred_names[p]);
+  }
+  BlockWriter writer(events_file);
+  for_each_range(false, writer);
+
+  events_file.close();
+  if (!events_file) {
+    throw runtime_error(events_path + ": Cannot write the events.");
+  }
+}
+
+size_t MaxentTrainer::read_events_header(istream &events_file,
+                                         string const &events_path,
+                                         vector<uint32_t> &outcome_map,
+                                         vector<uint32_t> &pred_map) {
+  string const corrupt = events_path + ": Not a valid events file.";
+  uint32_t header[3];
+  if (!events_file.read((char*)header, sizeof(header))
+      || (header[0] != EVENTS_FILE_MAGIC)) {
+    throw runtime_error(corrupt);
+  }
+
+  outcome_map.resize(header[2]);
+  string name;
+  for (uint32_t o = 0; o != header[2]; o++) {
+    if (!read_string(events_file, name))
+      throw runtime_error(corrupt);
+    outcome_map[o] = outcome_id(name);
+  }
+  uint32_t n_preds;
+  if (!events_file.read((char*)&n_preds, sizeof(n_preds)))
+    throw runtime_error(corrupt);
+  pred_map.resize(n_preds);
+  for (uint32_t p = 0; p != n_preds; p++) {
+    uint32_t count;
+    if (!events_file.read((char*)&count, sizeof(count))
+        || !read_string(events_file, name))
+      throw runtime_error(corrupt);
+    pred_map[p] = pred_id(name);
+    m_pred_counts[pred_map[p]] += count;
+  }
+  return header[1];
+}
+
+void MaxentTrainer::load_events(string const &events_path) {
+  ifstream events_file(events_path.c_str(), ios::binary);
+  string const corrupt = events_path + ": Not a valid events file.";
+
+  // The ids of the file are translated to the ids of this trainer. If the
+  // trainer is empty, they are the same.
+  bool same_ids = (m_outcome_names.size() == 0) && (m_pred_names.size() == 0);
+  vector<uint32_t> outcome_map, pred_map;
+  size_t n_file_events = read_events_header(events_file, events_path,
+                                            outcome_map, pred_map);
+  uint32_t n_preds = pred_map.size();
+
+  EventMerger merger(pred_map, outcome_map, NULL, m_events);
+  event_list_t block;
+  size_t n_events = 0;
+  while (events_file.peek() != char_traits<char>::eof()) {
+    if (!read_event_block(events_file, block))
+      throw runtime_error(corrupt);
+    for (size_t e = 0; e != block.size(); e++) {
+      uint32_t const *event = &block.data[block.offsets[e]];
+      if (event[0] >= outcome_map.size())
+        throw runtime_error(corrupt);
+      for (uint32_t f = 0; f != event[2]; f++) {
+        if (event[3 + 2 * f] >= n_preds)
+          throw runtime_error(corrupt);
+      }
+    }
+    if (same_ids) {
+      m_events.add_block(block);
+    } else {
+      merger(block, 0, block.size());
+    }
+    n_events += block.size();
+  }
+  if (n_events != n_file_events) {
+    throw runtime_error(corrupt);
+  }
+}
+
+// read_model parses a model in the Maxent toolkit's text format into
+// the names of its predicates and their parameters as (outcome id, value)
+// pairs. The outcomes of the model are added to the trainer's outcomes.
+void MaxentTrainer::read_model(string const &model_path,
+                               vector<string> &preds,
+                               vector< vector< pair<uint32_t, double> > >
+                                 &params) {
+  ifstream model_file(model_path.c_str());
+  string line;
+  getline(model_file, line);
+  if (line != "#txt,maxent") {
+    throw runtime_error(model_path + ": Not a model in the Maxent toolkit's "
+                        "text format.");
+  }
+
+  size_t n_preds;
+  model_file >> n_preds;
+  getline(model_file, line);
+  preds.resize(n_preds);
+  for (size_t p = 0; p != n_preds; p++) {
+    getline(model_file, preds[p]);
+  }
+
+  size_t n_outcomes;
+  model_file >> n_outcomes;
+  getline(model_file, line);
+  vector<uint32_t> outcome_ids(n_outcomes);
+  for (size_t o = 0; o != n_outcomes; o++) {
+    getline(model_file, line);
+    outcome_ids[o] = outcome_id(line);
+  }
+
+  params.assign(n_preds, vector< pair<uint32_t, double> >());
+  for (size_t p = 0; p != n_preds; p++) {
+    size_t n_params;
+    model_file >> n_params;
+    for (size_t k = 0; k != n_params; k++) {
+      size_t outcome;
+      model_file >> outcome;
+      if (outcome >= n_outcomes)
+        model_file.setstate(ios::failbit);
+      else
+        params[p].push_back(make_pair(outcome_ids[outcome], 0.0));
+    }
+  }
+
+  size_t n_theta;
+  model_file >> n_theta;
+  for (size_t p = 0; p != n_preds; p++) {
+    for (size_t k = 0; k != params[p].size(); k++) {
+      model_file >> params[p][k].second;
+    }
+  }
+
+  if (!model_file) {
+    throw runtime_error(model_path + ": Malformed model.");
+  }
+}
+
+void MaxentTrainer::warm_start(string const &model_path) {
+  try {
+    read_model(model_path, m_initial_preds, m_initial_params);
+  } catch (runtime_error const &exc) {
+    m_initial_preds.clear();
+    m_initial_params.clear();
+    throw;
+  }
+}
+
+void MaxentTrainer::load_event_counts(string const &events_path) {
+  ifstream events_file(events_path.c_str(), ios::binary);
+  vector<uint32_t> outcome_map, pred_map;
+  read_events_header(events_file, events_path, outcome_map, pred_map);
+}
+
+void MaxentTrainer::load_counts(string const &counts_path) {
+  ifstream counts_file(counts_path.c_str());
+  if (!counts_file) {
+    throw runtime_error(counts_path + ": Cannot read the predicate counts.");
+  }
+  size_t count;
+  string pred;
+  while ((counts_file >> count) && (counts_file.get() == ' ')
+         && getline(counts_file, pred)) {
+    m_pred_counts[pred_id(pred)] += count;
+  }
+}
+
+
+void MaxentTrainer::build_parameters(size_t event_cutoff) {
+  // The predicates of the initial model get their parameters even if they
+  // do not occur in the events.
+  vector<uint32_t> initial_pred_ids(m_initial_preds.size());
+  for (size_t i = 0; i != m_initial_preds.size(); i++) {
+    initial_pred_ids[i] = pred_id(m_initial_preds[i]);
+  }
+
+  size_t n_preds = m_pred_names.size();
+
+  // Every predicate which survives the cutoff gets a parameter for every
+  // outcome it has been seen with in the training data.
+  vector< vector<uint32_t> > pred_outcomes(n_preds);
+  OutcomeCollector collector(m_pred_counts, event_cutoff, pred_outcomes);
+  for_each_range(false, collector);
+  for (size_t i = 0; i != m_initial_preds.size(); i++) {
+    vector<uint32_t> &outcomes = pred_outcomes[initial_pred_ids[i]];
+    for (size_t k = 0; k != m_initial_params[i].size(); k++) {
+      uint32_t outcome = m_initial_params[i][k].first;
+      if (find(outcomes.begin(), outcomes.end(), outcome) == outcomes.end())
+        outcomes.push_back(outcome);
+    }
+  }
+
+  m_param_offsets.assign(n_preds + 1, 0);
+  m_param_outcomes.clear();
+  for (size_t pred = 0; pred != n_preds; pred++) {
+    sort(pred_outcomes[pred].begin(), pred_outcomes[pred].end());
+    m_param_offsets[pred] = m_param_outcomes.size();
+    m_param_outcomes.insert(m_param_outcomes.end(),
+                            pred_outcomes[pred].begin(),
+                            pred_outcomes[pred].end());
+  }
+  m_param_offsets[n_preds] = m_param_outcomes.size();
+
+  // The empirical expectations of the parameters.
+  m_observed.assign(m_param_outcomes.size(), 0.0);
+  ObservedCounter counter(m_param_offsets, m_param_outcomes, m_observed);
+  for_each_range(false, counter);
+
+  m_theta.assign(m_param_outcomes.size(), 0.0);
+  for (size_t i = 0; i != m_initial_preds.size(); i++) {
+    uint32_t pred = initial_pred_ids[i];
+    for (size_t k = 0; k != m_initial_params[i].size(); k++) {
+      for (size_t param = m_param_offsets[pred];
+           param != m_param_offsets[pred + 1]; param++) {
+        if (m_param_outcomes[param] == m_initial_params[i][k].first)
+          m_theta[param] = m_initial_params[i][k].second;
+      }
+    }
+  }
+
+  // The Gaussian prior is centered on the initial parameters, so that a
+  // warm-started model keeps what it has learned from the files it is not
+  // trained on again unless the new data say otherwise.
+  m_prior_means = m_theta;
+}
+
+double MaxentTrainer::evaluate(bool heldout,
+                               vector<double> const &theta,
+                               vector<double> *expected_p,
+                               size_t &n_correct) const {
+  vector<shard_result_t> results(m_n_shards);
+  for (size_t shard = 0; shard != m_n_shards; shard++) {
+    results[shard].loglik = 0.0;
+    results[shard].n_correct = 0;
+    if (expected_p != NULL) {
+      results[shard].expected.assign(theta.size(), 0.0);
+    }
+  }
+  BlockEvaluator evaluator(m_param_offsets, m_param_outcomes, theta,
+                           m_outcome_names.size(), expected_p != NULL,
+                           results);
+  for_each_range(heldout, evaluator);
+
+  double loglik = 0.0;
+  n_correct = 0;
+  if (expected_p != NULL) {
+    expected_p->assign(theta.size(), 0.0);
+  }
+  for (size_t shard = 0; shard != m_n_shards; shard++) {
+    loglik += results[shard].loglik;
+    n_correct += results[shard].n_correct;
+    if (expected_p != NULL) {
+      for (size_t k = 0; k != theta.size(); k++) {
+        (*expected_p)[k] += results[shard].expected[k];
+      }
+    }
+  }
+  return loglik;
+}
+
+double MaxentTrainer::objective(vector<double> const &theta,
+                                vector<double> &gradient,
+                                double sigma2, double &loglik,
+                                size_t &n_correct) const {
+  // We minimize the negative log-likelihood penalized by a Gaussian prior
+  // centered on m_prior_means.
+  loglik = evaluate(false, theta, &gradient, n_correct);
+  double value = -loglik;
+  for (size_t k = 0; k != theta.size(); k++) {
+    gradient[k] -= m_observed[k];
+    if (sigma2 > 0.0) {
+      double deviation = theta[k] - m_prior_means[k];
+      value += deviation * deviation / (2 * sigma2);
+      gradient[k] += deviation / sigma2;
+    }
+  }
+  return value;
+}
+
+void MaxentTrainer::report(size_t iteration, double loglik,
+                           size_t n_correct) const {
+  if (!m_verbose)
+    return;
+
+  size_t n_total = total_count(false);
+  cerr << "trtok: Iteration " << iteration
+       << ": log-likelihood=" << loglik / max<size_t>(n_total, 1)
+       << " accuracy=" << (double)n_correct / max<size_t>(n_total, 1);
+
+  if (n_heldout_events() > 0) {
+    size_t n_heldout_correct;
+    double heldout_loglik =
+        evaluate(true, m_theta, NULL, n_heldout_correct);
+    size_t n_heldout_total = total_count(true);
+    cerr << " heldout log-likelihood="
+         << heldout_loglik / max<size_t>(n_heldout_total, 1)
+         << " heldout accuracy="
+         << (double)n_heldout_correct / max<size_t>(n_heldout_total, 1);
+  }
+  cerr << endl;
+}
+
+void MaxentTrainer::train_lbfgs(training_parameters_t const &params) {
+  // The number of corrections kept for approximating the inverse Hessian.
+  const size_t memory = 5;
+  double sigma2 = params.smoothing_coefficient * params.smoothing_coefficient;
+  size_t n = m_theta.size();
+
+  vector<double> gradient(n), new_theta(n), new_gradient(n), direction(n);
+  vector< vector<double> > s_list, y_list;
+  vector<double> rho_list, alpha(memory);
+
+  double loglik;
+  size_t n_correct;
+  double value = objective(m_theta, gradient, sigma2, loglik, n_correct);
+
+  for (size_t iteration = 1; iteration <= params.n_iterations; iteration++) {
+    // The two-loop recursion computes the search direction from the
+    // stored corrections.
+    for (size_t k = 0; k != n; k++) {
+      direction[k] = -gradient[k];
+    }
+    for (size_t i = s_list.size(); i-- > 0; ) {
+      alpha[i] = rho_list[i] * dot(s_list[i], direction);
+      for (size_t k = 0; k != n; k++) {
+        direction[k] -= alpha[i] * y_list[i][k];
+      }
+    }
+    double scale = s_list.empty()
+        ? 1.0 / max(sqrt(dot(gradient, gradient)), 1e-10)
+        : 1.0 / (rho_list.back() * dot(y_list.back(), y_list.back()));
+    for (size_t k = 0; k != n; k++) {
+      direction[k] *= scale;
+    }
+    for (size_t i = 0; i != s_list.size(); i++) {
+      double beta = rho_list[i] * dot(y_list[i], direction);
+      for (size_t k = 0; k != n; k++) {
+        direction[k] += s_list[i][k] * (alpha[i] - beta);
+      }
+    }
+
+    double slope = dot(gradient, direction);
+    if (slope >= 0.0) {
+      // Not a descent direction, we start over with steepest descent.
+      s_list.clear();
+      y_list.clear();
+      rho_list.clear();
+      double norm = max(sqrt(dot(gradient, gradient)), 1e-10);
+      for (size_t k = 0; k != n; k++) {
+        direction[k] = -gradient[k] / norm;
+      }
+      slope = dot(gradient, direction);
+    }
+    if (slope == 0.0)
+      break;
+
+    // Backtracking line search satisfying the Armijo condition.
+    double step = 1.0;
+    double new_value = value;
+    bool found_step = false;
+    for (int trial = 0; trial != 30; trial++) {
+      for (size_t k = 0; k != n; k++) {
+        new_theta[k] = m_theta[k] + step * direction[k];
+      }
+      new_value = objective(new_theta, new_gradient, sigma2, loglik,
+                            n_correct);
+      if (new_value <= value + 1e-4 * step * slope) {
+        found_step = true;
+        break;
+      }
+      step *= 0.5;
+    }
+    if (!found_step)
+      break;
+
+    vector<double> s(n), y(n);
+    for (size_t k = 0; k != n; k++) {
+      s[k] = new_theta[k] - m_theta[k];
+      y[k] = new_gradient[k] - gradient[k];
+    }
+    double sy = dot(s, y);
+    if (sy > 1e-10) {
+      if (s_list.size() == memory) {
+        s_list.erase(s_list.begin());
+        y_list.erase(y_list.begin());
+        rho_list.erase(rho_list.begin());
+      }
+      s_list.push_back(s);
+      y_list.push_back(y);
+      rho_list.push_back(1.0 / sy);
+    }
+
+    double old_value = value;
+    m_theta.swap(new_theta);
+    gradient.swap(new_gradient);
+    value = new_value;
+
+    report(iteration, loglik, n_correct);
+
+    if (fabs(old_value - value)
+          <= params.convergence_tolerance * max(fabs(old_value), 1.0))
+      break;
+  }
+}
+
+void MaxentTrainer::train_gis(training_parameters_t const &params) {
+  double sigma2 = params.smoothing_coefficient * params.smoothing_coefficient;
+
+  CorrectionFinder finder(m_param_offsets);
+  for_each_range(false, finder);
+  double correction = finder.correction();
+  if (correction <= 0.0)
+    return;
+
+  vector<double> expected;
+  double old_loglik = 0.0;
+  for (size_t iteration = 1; iteration <= params.n_iterations; iteration++) {
+    size_t n_correct;
+    double loglik = evaluate(false, m_theta, &expected, n_correct);
+    report(iteration, loglik, n_correct);
+
+    for (size_t k = 0; k != m_theta.size(); k++) {
+      if ((expected[k] <= 0.0) || (m_observed[k] <= 0.0))
+        continue;
+      double delta = 0.0;
+      if (sigma2 > 0.0) {
+        // With a Gaussian prior the update has no closed form, so we find
+        // it using Newton's method.
+        for (int newton_step = 0; newton_step != 20; newton_step++) {
+          double predicted = expected[k] * exp(correction * delta);
+          double f = m_observed[k]
+                     - (m_theta[k] + delta - m_prior_means[k]) / sigma2
+                     - predicted;
+          double df = -1.0 / sigma2 - correction * predicted;
+          double change = f / df;
+          delta -= change;
+          if (fabs(change) < 1e-10)
+            break;
+        }
+      } else {
+        delta = log(m_observed[k] / expected[k]) / correction;
+      }
+      m_theta[k] += delta;
+    }
+
+    if ((iteration > 1) && (fabs(old_loglik - loglik)
+          <= params.convergence_tolerance * max(fabs(old_loglik), 1.0)))
+      break;
+    old_loglik = loglik;
+  }
+}
+
+void MaxentTrainer::train(training_parameters_t const &params,
+                          bool verbose) {
+  if ((params.method_name != "lbfgs") && (params.method_name != "gis")) {
+    throw invalid_argument("Unknown training method " + params.method_name
+                           + ", use either lbfgs or gis.");
+  }
+
+  m_verbose = verbose;
+  m_n_shards = (params.n_threads > 0) ? params.n_threads
+              : tbb::task_scheduler_init::default_num_threads();
+
+  build_parameters(params.event_cutoff);
+  if (m_theta.empty())
+    return;
+
+  if (params.method_name == "lbfgs") {
+    train_lbfgs(params);
+  } else {
+    train_gis(params);
+  }
+}
+
+size_t MaxentTrainer::n_active_predicates() const {
+  size_t n_active_preds = 0;
+  for (size_t pred = 0; pred + 1 < m_param_offsets.size(); pred++) {
+    if (m_param_offsets[pred] != m_param_offsets[pred + 1])
+      n_active_preds++;
+  }
+  return n_active_preds;
+}
+
+void MaxentTrainer::load(string const &model_path) {
+  vector<string> preds;
+  vector< vector< pair<uint32_t, double> > > params;
+  read_model(model_path, preds, params);
+
+  vector< vector< pair<uint32_t, double> > >
+    pred_params(m_pred_names.size() + preds.size());
+  for (size_t i = 0; i != preds.size(); i++) {
+    pred_params[pred_id(preds[i])] = params[i];
+  }
+  size_t n_preds = m_pred_names.size();
+
+  m_param_offsets.assign(n_preds + 1, 0);
+  m_param_outcomes.clear();
+  m_theta.clear();
+  for (size_t pred = 0; pred != n_preds; pred++) {
+    sort(pred_params[pred].begin(), pred_params[pred].end());
+    m_param_offsets[pred] = m_theta.size();
+    for (size_t k = 0; k != pred_params[pred].size(); k++) {
+      m_param_outcomes.push_back(pred_params[pred][k].first);
+      m_theta.push_back(pred_params[pred][k].second);
+    }
+  }
+  m_param_offsets[n_preds] = m_theta.size();
+  m_observed.clear();
+}
+
+void MaxentTrainer::prune(double min_weight, size_t min_count) {
+  if (m_param_offsets.empty())
+    return;
+
+  size_t n_preds = m_param_offsets.size() - 1;
+  vector<size_t> param_offsets(n_preds + 1);
+  vector<uint32_t> param_outcomes;
+  vector<double> theta;
+  for (size_t pred = 0; pred != n_preds; pred++) {
+    param_offsets[pred] = theta.size();
+    if (m_pred_counts[pred] < min_count)
+      continue;
+    for (size_t k = m_param_offsets[pred];
+         k != m_param_offsets[pred + 1]; k++) {
+      if (fabs(m_theta[k]) < min_weight)
+        continue;
+      param_outcomes.push_back(m_param_outcomes[k]);
+      theta.push_back(m_theta[k]);
+    }
+  }
+  param_offsets[n_preds] = theta.size();
+
+  m_param_offsets.swap(param_offsets);
+  m_param_outcomes.swap(param_outcomes);
+  m_theta.swap(theta);
+  m_observed.clear();
+}
+
+void MaxentTrainer::save(string const &model_path) const {
+  ofstream model_file(model_path.c_str());
+
+  model_file << "#txt,maxent" << endl;
+
+  // Only predicates which have some parameters make it into the model.
+  model_file << n_active_predicates() << endl;
+  for (size_t pred = 0; pred + 1 < m_param_offsets.size(); pred++) {
+    if (m_param_offsets[pred] != m_param_offsets[pred + 1])
+      model_file << m_pred_names[pred] << endl;
+  }
+
+  model_file << m_outcome_names.size() << endl;
+  for (size_t o = 0; o != m_outcome_names.size(); o++) {
+    model_file << m_outcome_names[o] << endl;
+  }
+
+  for (size_t pred = 0; pred + 1 < m_param_offsets.size(); pred++) {
+    if (m_param_offsets[pred] == m_param_offsets[pred + 1])
+      continue;
+    model_file << m_param_offsets[pred + 1] - m_param_offsets[pred];
+    for (size_t k = m_param_offsets[pred]; k != m_param_offsets[pred + 1];
+         k++) {
+      model_file << ' ' << m_param_outcomes[k];
+    }
+    model_file << endl;
+  }
+
+  model_file << m_theta.size() << endl;
+  model_file.precision(20);
+  for (size_t k = 0; k != m_theta.size(); k++) {
+    model_file << m_theta[k] << endl;
+  }
+
+  model_file.close();
+}
+
+void MaxentTrainer::save_counts(string const &counts_path) const {
+  ofstream counts_file(counts_path.c_str());
+  for (size_t pred = 0; pred + 1 < m_param_offsets.size(); pred++) {
+    if (m_param_offsets[pred] != m_param_offsets[pred + 1])
+      counts_file << m_pred_counts[pred] << ' ' << m_pred_names[pred] << '\n';
+  }
+  if (!counts_file) {
+    throw runtime_error(counts_path + ": Cannot write the predicate counts.");
+  }
+}
+
+void MaxentTrainer::save_compact(string const &model_path,
+                                 unsigned weight_bits) const {
+  CompactModel::write(model_path, weight_bits, m_outcome_names, m_pred_names,
+                      m_param_offsets, m_param_outcomes, m_theta);
+}
+
+void MaxentTrainer::classify_heldout(string const &break_pred,
+                                     string const &split_pred,
+                                     string const &join_pred,
+                                     evaluation_stats_t &stats) const {
+  if (m_outcome_names.empty() || m_param_offsets.empty())
+    return;
+
+  uint32_t pred_ids[3];
+  string const *pred_names[3] = { &break_pred, &split_pred, &join_pred };
+  for (int i = 0; i != 3; i++) {
+    boost::unordered_map<string, uint32_t>::const_iterator
+      lookup = m_pred_ids.find(*pred_names[i]);
+    pred_ids[i] = (lookup != m_pred_ids.end()) ? lookup->second
+                                               : EventMerger::no_pred;
+  }
+
+  HeldoutClassifier classifier(m_param_offsets, m_param_outcomes, m_theta,
+                               m_outcome_names, pred_ids[0], pred_ids[1],
+                               pred_ids[2], stats);
+  for_each_range(true, classifier);
+}
+
+void MaxentTrainer::classify_heldout(size_t n_feature_buckets,
+                                     evaluation_stats_t &stats) const {
+  string preds[3] = { "0:%MAY_BREAK_SENTENCE", "0:%MAY_SPLIT", "0:%MAY_JOIN" };
+  if (n_feature_buckets > 0) {
+    for (int i = 0; i != 3; i++) {
+      preds[i] = hashed_feature_name(preds[i], n_feature_buckets);
+    }
+  }
+  classify_heldout(preds[0], preds[1], preds[2], stats);
+}
+
+void MaxentTrainer::report_compact_models(string const &model_path) const {
+  bool use_heldout = n_heldout_events() > 0;
+  if ((!use_heldout && (n_events() == 0)) || m_theta.empty())
+    return;
+
+  size_t n_active_preds = n_active_predicates();
+  size_t outcome_names_size = 0;
+  for (size_t o = 0; o != m_outcome_names.size(); o++) {
+    outcome_names_size += m_outcome_names[o].size() + 1;
+  }
+
+  ifstream model_file(model_path.c_str(), ios::binary | ios::ate);
+  size_t model_size = model_file.tellg();
+  model_file.close();
+
+  size_t n_correct;
+  evaluate(use_heldout, m_theta, NULL, n_correct);
+  clog << "trtok: Accuracy on the " << (use_heldout ? "heldout" : "training")
+       << " events and size of the model:" << endl;
+  clog << "    full precision: accuracy="
+       << (double)n_correct / total_count(use_heldout)
+       << " size=" << model_size << " bytes" << endl;
+
+  unsigned const weight_bits[] = { 16, 8 };
+  for (size_t b = 0; b != 2; b++) {
+    vector<float> scales;
+    vector<int> weights;
+    CompactModel::quantize(weight_bits[b], m_outcome_names.size(),
+                           m_param_outcomes, m_theta, scales, weights);
+    vector<double> theta(m_theta.size());
+    for (size_t k = 0; k != theta.size(); k++) {
+      theta[k] = weights[k] * scales[m_param_outcomes[k]];
+    }
+    evaluate(use_heldout, theta, NULL, n_correct);
+    clog << "    " << weight_bits[b] << "-bit compact: accuracy="
+         << (double)n_correct / total_count(use_heldout)
+         << " size=" << CompactModel::file_size(weight_bits[b],
+                                                m_outcome_names.size(),
+                                                outcome_names_size,
+                                                n_active_preds,
+                                                m_theta.size())
+         << " bytes" << endl;
+  }
+}
+
+}
@@ -0,0 +1,258 @@
+#ifndef MAXENT_TRAINER_INCLUDE_GUARD
+#define MAXENT_TRAINER_INCLUDE_GUARD
+
+#include <istream>
+#include <string>
+#include <vector>
+#include <utility>
+#include <boost/unordered_map.hpp>
+#include <boost/cstdint.hpp>
+typedef boost::uint32_t uint32_t;
+
+#include "EventSpool.hpp"
+#include "evaluation_stats.hpp"
+
+namespace trtok {
+
+struct training_parameters_t {
+  size_t event_cutoff;
+  size_t n_iterations;
+  std::string method_name;
+  double smoothing_coefficient;
+  double convergence_tolerance;
+  // The number of shards the events are split into when computing
+  // expectations; 0 lets TBB pick the number of available cores.
+  size_t n_threads;
+
+  training_parameters_t():
+    event_cutoff(1),
+    n_iterations(15),
+    method_name("lbfgs"),
+    smoothing_coefficient(0.0),
+    convergence_tolerance(1e-05),
+    n_threads(0)
+  {}
+};
+
+/* MaxentTrainer collects the events produced by the Classifier and estimates
+   the parameters of a conditional maximum entropy model from them. Only the
+   predicate strings and their counts are kept in memory, the events
+   themselves are stored in an EventSpool and are read in blocks during
+   every pass over the data. The events of every block are split into shards
+   whose contributions to the log-likelihood and the model's expectations
+   are computed in parallel using TBB. The resulting model is written in the
+   text format of the Maxent toolkit so that it can be loaded by
+   maxent::MaxentModel. */
+class MaxentTrainer {
+
+public:
+    typedef std::vector< std::pair<std::string, float> > context_t;
+
+    MaxentTrainer():
+        m_n_shards(1),
+        m_verbose(false),
+        m_source_p(NULL),
+        m_first_heldout(0),
+        m_end_heldout(0),
+        m_heldout_count(0)
+    {}
+
+    // add_event stores a context along with its outcome. Heldout events
+    // are only used to report the performance of the model during training
+    // and must be added after all the training events.
+    void add_event(context_t const &context, std::string const &outcome,
+                   bool heldout = false);
+
+    // add_events appends the training events of another trainer, as if
+    // they were added to this one by add_event. The other trainer's heldout
+    // events are ignored.
+    void add_events(MaxentTrainer const &other, bool heldout = false);
+
+    // add_heldout_events appends the heldout events of another trainer to
+    // the heldout events of this one. Predicates unknown to this trainer
+    // are left out of them.
+    void add_heldout_events(MaxentTrainer const &other);
+
+    // share_events makes an empty trainer train on the events of source
+    // without copying them, so that several models can be trained on the
+    // same events at once. The predicates, their counts and the outcomes
+    // are copied, the events are read from source, which must hold its own
+    // events, must outlive this trainer and must not get any more events.
+    // No events may be added to this trainer. The heldout events are those
+    // of source, unless a range of source's training events is given: the
+    // events first_heldout to end_heldout (exclusive) are then the heldout
+    // events, the rest are the training events and the predicate counts
+    // are those of the rest.
+    void share_events(MaxentTrainer const &source);
+    void share_events(MaxentTrainer const &source, size_t first_heldout,
+                      size_t end_heldout);
+
+    // save_events writes the training events along with their predicates
+    // and outcomes to a binary file, load_events adds the events stored
+    // in such a file as if they were added by add_event. They are used to
+    // cache the events extracted from the training files.
+    void save_events(std::string const &events_path) const;
+    void load_events(std::string const &events_path);
+
+    // spool_to makes the trainer keep its events in spool files instead of
+    // memory, see EventSpool.
+    void spool_to(std::string const &events_path,
+                  std::string const &heldout_events_path,
+                  size_t block_size);
+
+    size_t n_events() const;
+    size_t n_heldout_events() const;
+
+    // The size of the trained model: the number of predicates which have
+    // some parameters and the number of parameters.
+    size_t n_active_predicates() const;
+    size_t n_parameters() const { return m_theta.size(); }
+
+    // warm_start makes train start from the parameters of an existing model
+    // stored in the Maxent toolkit's text format instead of zeros. All the
+    // parameters of that model are kept, even those of predicates which do
+    // not occur in the events, and the smoothing pulls the parameters
+    // towards their values in that model rather than towards zero.
+    void warm_start(std::string const &model_path);
+
+    // load_counts adds the predicate counts stored by save_counts to the
+    // counts of the predicates. The counts decide which predicates pass the
+    // event cutoff and which are removed by prune.
+    void load_counts(std::string const &counts_path);
+
+    // load_event_counts adds the predicate counts of an events file written
+    // by save_events to the counts of the predicates, without its events.
+    void load_event_counts(std::string const &events_path);
+
+    // train estimates the model's parameters using the method given in the
+    // training parameters (either lbfgs or gis).
+    void train(training_parameters_t const &training_parameters,
+               bool verbose = false);
+
+    // load makes the trainer hold an existing model stored in the Maxent
+    // toolkit's text format, as if it had trained it. It must be called
+    // before any events are added.
+    void load(std::string const &model_path);
+
+    // prune removes the parameters whose absolute value is less than
+    // min_weight and all the parameters of predicates which have been seen
+    // fewer than min_count times.
+    void prune(double min_weight, size_t min_count);
+
+    // save writes the trained model in the Maxent toolkit's text format.
+    void save(std::string const &model_path) const;
+
+    // save_counts writes the counts of the model's predicates.
+    void save_counts(std::string const &counts_path) const;
+
+    // save_compact writes the trained model as a CompactModel with weights
+    // quantized to weight_bits (8 or 16) bits.
+    void save_compact(std::string const &model_path,
+                      unsigned weight_bits) const;
+
+    // classify_heldout classifies the heldout events using the trained
+    // model and adds the outcomes to stats. Events having the predicate
+    // break_pred count as segmentation decisions, those having split_pred
+    // or join_pred as tokenization decisions.
+    void classify_heldout(std::string const &break_pred,
+                          std::string const &split_pred,
+                          std::string const &join_pred,
+                          evaluation_stats_t &stats) const;
+
+    // This classify_heldout recognizes the decisions by the predicates which
+    // the Classifier adds for the MAY_BREAK_SENTENCE, MAY_SPLIT and MAY_JOIN
+    // flags of the token in the center, hashed if the features were hashed
+    // into n_feature_buckets buckets.
+    void classify_heldout(size_t n_feature_buckets,
+                          evaluation_stats_t &stats) const;
+
+    // report_compact_models compares the accuracy and the size of the model
+    // saved at model_path with those of its compact versions, using the
+    // heldout events if there are any and the training events otherwise.
+    void report_compact_models(std::string const &model_path) const;
+
+private:
+    uint32_t outcome_id(std::string const &outcome);
+    uint32_t pred_id(std::string const &pred);
+    void read_model(std::string const &model_path,
+                    std::vector<std::string> &preds,
+                    std::vector< std::vector< std::pair<uint32_t, double> > >
+                      &params);
+    // read_events_header reads the outcomes and the predicates of an events
+    // file, adding the predicates' counts, and maps their ids in the file to
+    // the ids of this trainer. It returns the number of events in the file.
+    size_t read_events_header(std::istream &events_file,
+                              std::string const &events_path,
+                              std::vector<uint32_t> &outcome_map,
+                              std::vector<uint32_t> &pred_map);
+    // event_source is the trainer which holds the events, see
+    // share_events.
+    MaxentTrainer const &event_source() const {
+      return (m_source_p != NULL) ? *m_source_p : *this;
+    }
+    // for_each_range calls visitor(block, first, end) for all the training
+    // or heldout events, see EventSpool::for_each_range.
+    template <class Visitor>
+    void for_each_range(bool heldout, Visitor &visitor) const;
+    // total_count is the sum of the counts of the training or heldout
+    // events.
+    size_t total_count(bool heldout) const;
+    void build_parameters(size_t event_cutoff);
+    double evaluate(bool heldout,
+                    std::vector<double> const &theta,
+                    std::vector<double> *expected_p,
+                    size_t &n_correct) const;
+    double objective(std::vector<double> const &theta,
+                     std::vector<double> &gradient,
+                     double sigma2, double &loglik,
+                     size_t &n_correct) const;
+    void report(size_t iteration, double loglik, size_t n_correct) const;
+    void train_lbfgs(training_parameters_t const &training_parameters);
+    void train_gis(training_parameters_t const &training_parameters);
+
+private:
+    // Configuration
+    size_t m_n_shards;
+    bool m_verbose;
+
+    // Events
+    boost::unordered_map<std::string, uint32_t> m_pred_ids;
+    std::vector<std::string> m_pred_names;
+    std::vector<size_t> m_pred_counts;
+    boost::unordered_map<std::string, uint32_t> m_outcome_ids;
+    std::vector<std::string> m_outcome_names;
+    EventSpool m_events;
+    EventSpool m_heldout_events;
+    EventSpool::features_t m_features;
+    // The trainer whose events are used instead of m_events and
+    // m_heldout_events after share_events, NULL before. If m_first_heldout
+    // and m_end_heldout differ, they delimit the heldout events within its
+    // training events and m_heldout_count is the sum of their counts.
+    MaxentTrainer const *m_source_p;
+    size_t m_first_heldout;
+    size_t m_end_heldout;
+    size_t m_heldout_count;
+
+    // The predicates of the model given to warm_start, along with their
+    // parameters as (outcome id, value) pairs.
+    std::vector<std::string> m_initial_preds;
+    std::vector< std::vector< std::pair<uint32_t, double> > >
+      m_initial_params;
+
+    // Model
+    // The parameters of predicate p are stored at indices
+    // m_param_offsets[p] to m_param_offsets[p+1] (exclusive) of m_theta,
+    // m_param_outcomes and m_observed. This is the order in which the
+    // Maxent toolkit stores its parameters.
+    std::vector<size_t> m_param_offsets;
+    std::vector<uint32_t> m_param_outcomes;
+    std::vector<double> m_observed;
+    std::vector<double> m_theta;
+    // The means of the Gaussian prior on the parameters: the parameters of
+    // the model given to warm_start, zero for the rest.
+    std::vector<double> m_prior_means;
+};
+
+}
+
+#endif
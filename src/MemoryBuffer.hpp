@@ -0,0 +1,27 @@
+#ifndef MEMORY_BUFFER_INCLUDE_GUARD
+#define MEMORY_BUFFER_INCLUDE_GUARD
+
+#include <string>
+#include <streambuf>
+
+namespace trtok {
+
+/* MemoryBuffer is a stream buffer reading bytes held in memory in place,
+   without a copy, so that a stream can be pointed at them again and again.
+   The bytes must outlive their reading. */
+class MemoryBuffer: public std::streambuf {
+
+public:
+    void set(char const *begin, char const *end) {
+      setg(const_cast<char*>(begin), const_cast<char*>(begin),
+           const_cast<char*>(end));
+    }
+
+    void set(std::string const &text) {
+      set(text.data(), text.data() + text.length());
+    }
+};
+
+}
+
+#endif
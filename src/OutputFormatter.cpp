@@ -1,16 +1,34 @@
 #include <vector>
 #include <boost/cstdint.hpp>
 typedef boost::uint8_t uint8_t;
+#include <boost/date_time/posix_time/posix_time_types.hpp>
 
 #include "OutputFormatter.hpp"
 #include "token_t.hpp"
 #include "cutout_t.hpp"
+#include "DocumentStream.hpp"
+#include "utils.hpp"
 
 namespace trtok {
 
+void OutputFormatter::pop_cutout() {
+  // The cutouts of the next document are left for the next document.
+  if (m_have_cutout && (m_last_cutout.type == DOCUMENT_END_MARK))
+    return;
+  // The clock is only read when the queue is empty and we have to wait
+  // for the TextCleaner.
+  if (!m_cutout_queue_p->try_pop(m_last_cutout)) {
+    boost::posix_time::ptime start =
+      boost::posix_time::microsec_clock::universal_time();
+    m_cutout_queue_p->pop(m_last_cutout);
+    m_cutout_wait += boost::posix_time::microsec_clock::universal_time()
+                     - start;
+  }
+}
+
 void* OutputFormatter::operator() (void *input_p) {
   if (!m_have_cutout) {
-    m_cutout_queue_p->pop(m_last_cutout);
+    pop_cutout();
     m_have_cutout = true;
   }
 
@@ -19,39 +37,49 @@ void* OutputFormatter::operator() (void *input_p) {
   typedef std::vector<token_t>::const_iterator token_iter;
   for (token_iter token = chunk_p->tokens.begin();
        token != chunk_p->tokens.end(); token++) {
-    
-    bool replacing_entity = false;
-    typedef std::string::const_iterator char_iter;
-    for (char_iter ch = token->text.begin(); ch != token->text.end(); ch++) {
-      // Chars are signed, so we cast them to uint8_t for our purposes
-      uint8_t uchar = (uint8_t)(*ch);
-      if (uchar >> 6 == 2) {
-        // A continuation byte in UTF-8.
+
+    // Most tokens have no cutouts inside of them and are written at once.
+    char const *text_begin = token->text.data();
+    char const *text_end = text_begin + token->text.length();
+    long n_chars = utf8_length(text_begin, text_end);
+    if ((m_last_cutout.position < m_position)
+        || (m_last_cutout.position >= m_position + n_chars)) {
+      m_output_stream_p->write(text_begin, token->text.length());
+      m_position += n_chars;
+    } else {
+      bool replacing_entity = false;
+      typedef std::string::const_iterator char_iter;
+      for (char_iter ch = token->text.begin(); ch != token->text.end(); ch++) {
+        // Chars are signed, so we cast them to uint8_t for our purposes
+        uint8_t uchar = (uint8_t)(*ch);
+        if (uchar >> 6 == 2) {
+          // A continuation byte in UTF-8.
+          if (!replacing_entity) {
+            // Write the character, but only if it won't
+            // be replaced by an entity
+            *m_output_stream_p << *ch;
+          }
+          continue;
+        }
+        replacing_entity = false;
+        while (m_last_cutout.position == m_position) {
+          if (m_last_cutout.type == XML_CUTOUT) {
+            *m_output_stream_p << m_last_cutout.text;
+          }
+          if (m_last_cutout.type == ENTITY_CUTOUT) {
+            // We will be replacing this character with an entity.
+            *m_output_stream_p << m_last_cutout.text;
+            replacing_entity = true;
+          }
+          pop_cutout();
+        }
         if (!replacing_entity) {
           // Write the character, but only if it won't
           // be replaced by an entity
           *m_output_stream_p << *ch;
         }
-        continue;
-      }
-      replacing_entity = false;
-      while (m_last_cutout.position == m_position) {
-        if (m_last_cutout.type == XML_CUTOUT) {
-          *m_output_stream_p << m_last_cutout.text;
-        }
-        if (m_last_cutout.type == ENTITY_CUTOUT) {
-          // We will be replacing this character with an entity.
-          *m_output_stream_p << m_last_cutout.text;
-          replacing_entity = true;
-        }
-        m_cutout_queue_p->pop(m_last_cutout);
-      }
-      if (!replacing_entity) {
-        // Write the character, but only if it won't
-        // be replaced by an entity
-        *m_output_stream_p << *ch;
+        m_position++;
       }
-      m_position++;
     }
 
     // If this token is followed by XML closing tags, we print them
@@ -67,7 +95,7 @@ void* OutputFormatter::operator() (void *input_p) {
           // Opening tags are left for the next token.
           break;
       }
-      m_cutout_queue_p->pop(m_last_cutout);
+      pop_cutout();
     }
 
     std::string token_sep = "";
@@ -106,9 +134,14 @@ void* OutputFormatter::operator() (void *input_p) {
   }
 
   if (chunk_p->is_final) {
-    // If this is the final chunk, we send an EOF to the converter
-    // so it can flush and stop.
-    m_output_stream_p->close();
+    // If this is the final chunk of a document, we skip the cutouts left
+    // in it and tell the encoder so that it can flush and go on with the
+    // next document.
+    while (m_last_cutout.type != DOCUMENT_END_MARK)
+      pop_cutout();
+    *m_output_stream_p << END_OF_DOCUMENT;
+    m_output_stream_p->flush();
+    reset();
   }
 
   // TODO: This could be optimized by sending the pointer back to
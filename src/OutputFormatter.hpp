@@ -3,6 +3,7 @@
 
 #include "tbb/pipeline.h"
 #include "tbb/concurrent_queue.h"
+#include <boost/date_time/posix_time/posix_time_types.hpp>
 
 #include "pipes/pipe.hpp"
 
@@ -15,8 +16,7 @@ class OutputFormatter: public tbb::filter {
 
 public:
     OutputFormatter(/* the pipestream to which the output is written,
-                       it is closed, and so signals an EOF, after processing
-                       the final chunk */
+                       every document is followed by END_OF_DOCUMENT */
                     pipes::opipestream *output_stream_p,
                     /* whether tokenization decisions (JOIN, SPLIT) are to
                        be ignored */
@@ -45,17 +45,24 @@ public:
         reset();
     }
     
-    // reset prepares the OutputFormatter for processing a different file
+    // reset prepares the OutputFormatter for processing another document
     void reset() {
         m_position = 0;
         m_have_cutout = false;
     }
 
+    // The time spent waiting for the cutouts from the TextCleaner.
+    double cutout_wait_seconds() const {
+        return m_cutout_wait.total_microseconds() / 1e6;
+    }
+
     // the invoke operator takes a chunk pointer and sends its contents
     // along with the mandated whitespace down the output stream
     virtual void* operator()(void *input_p);
 
 private:
+    void pop_cutout();
+
     // Configuration
     pipes::opipestream *m_output_stream_p;
     tbb::concurrent_bounded_queue<cutout_t> *m_cutout_queue_p;
@@ -66,6 +73,7 @@ private:
     long m_position;
     bool m_have_cutout;
     cutout_t m_last_cutout;
+    boost::posix_time::time_duration m_cutout_wait;
 };
 
 }
@@ -0,0 +1,170 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include "tbb/pipeline.h"
+#include <boost/thread/mutex.hpp>
+
+#include "Profile.hpp"
+#include "token_t.hpp"
+
+using namespace std;
+
+namespace trtok {
+
+char const *profiled_stage_names[N_PROFILED_STAGES] = {
+  "TextCleaner",
+  "RoughTokenizer",
+  "FeatureExtractor",
+  "Classifier",
+  "OutputFormatter",
+  "Encoder"
+};
+
+namespace {
+
+tbb::filter::mode mode_of(tbb::filter const &filter) {
+  if (!filter.is_serial())
+    return tbb::filter::parallel;
+  return filter.is_ordered() ? tbb::filter::serial_in_order
+                             : tbb::filter::serial_out_of_order;
+}
+
+/* ProfiledFilter runs another filter in the same mode and records the time
+   it takes and the chunks and tokens passing through. The tokens are
+   counted on the input of the filter, or on its output for the first
+   filter of the pipeline. */
+class ProfiledFilter: public tbb::filter {
+
+public:
+    ProfiledFilter(tbb::filter &filter, Profile &profile,
+                   profiled_stage_t stage):
+        tbb::filter(mode_of(filter)),
+        m_filter(filter),
+        m_profile(profile),
+        m_stage(stage)
+    {}
+
+    virtual void* operator()(void *input_p) {
+      size_t n_tokens = 0;
+      if (input_p != NULL)
+        n_tokens = ((chunk_t*)input_p)->tokens.size();
+
+      boost::posix_time::ptime start = Profile::now();
+      void *output_p = m_filter(input_p);
+      double seconds = Profile::seconds_since(start);
+
+      if ((input_p == NULL) && (output_p != NULL))
+        n_tokens = ((chunk_t*)output_p)->tokens.size();
+      m_profile.add_time(m_stage, seconds,
+                         ((input_p != NULL) || (output_p != NULL)) ? 1 : 0,
+                         n_tokens);
+      return output_p;
+    }
+
+    virtual void finalize(void *item_p) {
+      m_filter.finalize(item_p);
+    }
+
+private:
+    tbb::filter &m_filter;
+    Profile &m_profile;
+    profiled_stage_t m_stage;
+};
+
+}
+
+
+Profile::~Profile() {
+  for (size_t w = 0; w != m_wrappers.size(); w++) {
+    delete m_wrappers[w];
+  }
+}
+
+void Profile::add_time(profiled_stage_t stage, double seconds,
+                       size_t n_chunks, size_t n_tokens) {
+  boost::mutex::scoped_lock lock(m_mutex);
+  m_stages[stage].seconds += seconds;
+  m_stages[stage].n_chunks += n_chunks;
+  m_stages[stage].n_tokens += n_tokens;
+}
+
+void Profile::add_wait(profiled_stage_t stage, double wait_seconds) {
+  boost::mutex::scoped_lock lock(m_mutex);
+  m_stages[stage].wait_seconds += wait_seconds;
+}
+
+void Profile::add_counts(profiled_stage_t stage, size_t n_decisions,
+                         uint64_t bytes_in, uint64_t bytes_out) {
+  boost::mutex::scoped_lock lock(m_mutex);
+  m_stages[stage].n_decisions += n_decisions;
+  m_stages[stage].bytes_in += bytes_in;
+  m_stages[stage].bytes_out += bytes_out;
+}
+
+tbb::filter &Profile::wrap(tbb::filter &filter, profiled_stage_t stage) {
+  boost::mutex::scoped_lock lock(m_mutex);
+  m_wrappers.push_back(new ProfiledFilter(filter, *this, stage));
+  return *m_wrappers.back();
+}
+
+void Profile::print(ostream &out) const {
+  boost::mutex::scoped_lock lock(m_mutex);
+  ios::fmtflags flags = out.flags();
+  streamsize precision = out.precision();
+
+  out << setw(18) << "stage" << setw(10) << "time (s)"
+      << setw(10) << "busy (s)" << setw(10) << "wait (s)"
+      << setw(10) << "chunks" << setw(12) << "tokens"
+      << setw(12) << "decisions" << setw(10) << "MB in"
+      << setw(10) << "MB out" << endl;
+  out << fixed;
+  for (int s = 0; s != N_PROFILED_STAGES; s++) {
+    stage_profile_t const &stage = m_stages[s];
+    out << setw(18) << profiled_stage_names[s]
+        << setprecision(3)
+        << setw(10) << stage.seconds
+        << setw(10) << max(0.0, stage.seconds - stage.wait_seconds)
+        << setw(10) << stage.wait_seconds
+        << setw(10) << stage.n_chunks
+        << setw(12) << stage.n_tokens
+        << setw(12) << stage.n_decisions
+        << setprecision(2)
+        << setw(10) << stage.bytes_in / 1e6
+        << setw(10) << stage.bytes_out / 1e6 << endl;
+  }
+  out << "Wall-clock time: " << setprecision(3)
+      << seconds_since(m_start) << " s" << endl;
+
+  out.flags(flags);
+  out.precision(precision);
+}
+
+void Profile::print_json(ostream &out) const {
+  boost::mutex::scoped_lock lock(m_mutex);
+  ios::fmtflags flags = out.flags();
+  streamsize precision = out.precision();
+
+  out << fixed << setprecision(6);
+  out << "{\"wall_seconds\": " << seconds_since(m_start)
+      << ", \"stages\": [";
+  for (int s = 0; s != N_PROFILED_STAGES; s++) {
+    stage_profile_t const &stage = m_stages[s];
+    out << ((s == 0) ? "\n" : ",\n")
+        << "  {\"stage\": \"" << profiled_stage_names[s] << "\""
+        << ", \"seconds\": " << stage.seconds
+        << ", \"busy_seconds\": "
+        << max(0.0, stage.seconds - stage.wait_seconds)
+        << ", \"wait_seconds\": " << stage.wait_seconds
+        << ", \"chunks\": " << stage.n_chunks
+        << ", \"tokens\": " << stage.n_tokens
+        << ", \"decisions\": " << stage.n_decisions
+        << ", \"bytes_in\": " << stage.bytes_in
+        << ", \"bytes_out\": " << stage.bytes_out << "}";
+  }
+  out << "\n]}" << endl;
+
+  out.flags(flags);
+  out.precision(precision);
+}
+
+}
@@ -0,0 +1,120 @@
+#ifndef PROFILE_INCLUDE_GUARD
+#define PROFILE_INCLUDE_GUARD
+
+#include <iostream>
+#include <vector>
+#include "tbb/pipeline.h"
+#include <boost/thread/mutex.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/cstdint.hpp>
+typedef boost::uint64_t uint64_t;
+
+#include "token_t.hpp"
+
+namespace trtok {
+
+enum profiled_stage_t {
+  TEXT_CLEANER_STAGE,
+  ROUGH_TOKENIZER_STAGE,
+  FEATURE_EXTRACTOR_STAGE,
+  CLASSIFIER_STAGE,
+  OUTPUT_FORMATTER_STAGE,
+  ENCODER_STAGE,
+  N_PROFILED_STAGES
+};
+
+extern char const *profiled_stage_names[N_PROFILED_STAGES];
+
+/* What a stage of the pipeline has done. The seconds are the time spent
+   in the stage, summed over all the threads running it, and include the
+   seconds spent waiting for the neighbouring stages. */
+struct stage_profile_t {
+  stage_profile_t():
+    seconds(0.0), wait_seconds(0.0), n_chunks(0), n_tokens(0),
+    n_decisions(0), bytes_in(0), bytes_out(0)
+  {}
+
+  double seconds;
+  double wait_seconds;
+  size_t n_chunks;
+  size_t n_tokens;
+  size_t n_decisions;
+  uint64_t bytes_in;
+  uint64_t bytes_out;
+};
+
+/* Profile collects the stage_profile_t of every stage of the pipeline for
+   the --profile option. It may be updated from several threads at once. */
+class Profile: private boost::noncopyable {
+
+public:
+    Profile(): m_start(now()) {}
+    ~Profile();
+
+    void add_time(profiled_stage_t stage, double seconds,
+                  size_t n_chunks, size_t n_tokens);
+    void add_wait(profiled_stage_t stage, double wait_seconds);
+    void add_counts(profiled_stage_t stage, size_t n_decisions,
+                    uint64_t bytes_in, uint64_t bytes_out);
+
+    // wrap returns a filter which runs the given filter and records
+    // the time it takes and the chunks and tokens passing through. The
+    // wrapper is owned by the Profile.
+    tbb::filter &wrap(tbb::filter &filter, profiled_stage_t stage);
+
+    // print outputs a table of the stages and the wall-clock time since
+    // the Profile was created, print_json outputs the same as JSON.
+    void print(std::ostream &out) const;
+    void print_json(std::ostream &out) const;
+
+    static boost::posix_time::ptime now() {
+      return boost::posix_time::microsec_clock::universal_time();
+    }
+
+    static double seconds_since(boost::posix_time::ptime start) {
+      return (now() - start).total_microseconds() / 1e6;
+    }
+
+private:
+    boost::posix_time::ptime m_start;
+    stage_profile_t m_stages[N_PROFILED_STAGES];
+    std::vector<tbb::filter*> m_wrappers;
+    mutable boost::mutex m_mutex;
+};
+
+// profiled wraps the filter if profile_p is not NULL.
+inline tbb::filter &profiled(Profile *profile_p, tbb::filter &filter,
+                             profiled_stage_t stage) {
+  return (profile_p != NULL) ? profile_p->wrap(filter, stage) : filter;
+}
+
+/* ProfiledWork runs the do_work method of a stage running in its own
+   thread (TextCleaner, Encoder) and records the time it takes. */
+template <class Worker>
+class ProfiledWork {
+
+public:
+    ProfiledWork(Worker &worker, Profile *profile_p,
+                 profiled_stage_t stage):
+        m_worker(worker),
+        m_profile_p(profile_p),
+        m_stage(stage)
+    {}
+
+    void operator()() {
+      boost::posix_time::ptime start = Profile::now();
+      m_worker.do_work();
+      if (m_profile_p != NULL)
+        m_profile_p->add_time(m_stage, Profile::seconds_since(start), 0, 0);
+    }
+
+private:
+    Worker &m_worker;
+    Profile *m_profile_p;
+    profiled_stage_t m_stage;
+};
+
+}
+
+#endif
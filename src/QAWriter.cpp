@@ -0,0 +1,69 @@
+#include <iostream>
+#include <string>
+#include <deque>
+#include <boost/thread.hpp>
+#include <boost/bind.hpp>
+
+#include "QAWriter.hpp"
+
+using namespace std;
+
+namespace trtok {
+
+QAWriter::QAWriter(ostream *out_p, size_t block_size):
+    std::ostream(NULL),
+    m_out_p(out_p),
+    m_buffer(*this, ios_base::out, block_size),
+    m_max_blocks(4),
+    m_closing(false)
+{
+  rdbuf(&m_buffer);
+  m_thread = boost::thread(boost::bind(&QAWriter::write_blocks, this));
+}
+
+QAWriter::~QAWriter() {
+  close();
+}
+
+void QAWriter::close() {
+  if (!m_thread.joinable())
+    return;
+  m_buffer.hand_over();
+  {
+    boost::mutex::scoped_lock lock(m_mutex);
+    m_closing = true;
+    m_blocks_changed.notify_all();
+  }
+  m_thread.join();
+  m_out_p->flush();
+}
+
+void QAWriter::push_block(string &block) {
+  boost::mutex::scoped_lock lock(m_mutex);
+  while (m_blocks.size() >= m_max_blocks) {
+    m_blocks_changed.wait(lock);
+  }
+  m_blocks.push_back(string());
+  m_blocks.back().swap(block);
+  m_blocks_changed.notify_all();
+}
+
+void QAWriter::write_blocks() {
+  string block;
+  while (true) {
+    {
+      boost::mutex::scoped_lock lock(m_mutex);
+      while (m_blocks.empty() && !m_closing) {
+        m_blocks_changed.wait(lock);
+      }
+      if (m_blocks.empty())
+        return;
+      block.swap(m_blocks.front());
+      m_blocks.pop_front();
+      m_blocks_changed.notify_all();
+    }
+    m_out_p->write(block.data(), block.size());
+  }
+}
+
+}
@@ -0,0 +1,53 @@
+#ifndef QA_WRITER_INCLUDE_GUARD
+#define QA_WRITER_INCLUDE_GUARD
+
+#include <iostream>
+#include <streambuf>
+#include <string>
+#include <deque>
+#include <boost/thread.hpp>
+#include <boost/noncopyable.hpp>
+
+#include "BlockBuffer.hpp"
+
+namespace trtok {
+
+/* QAWriter is the output stream for the questions and answers. The output
+   is collected in large blocks which are written to the underlying stream
+   by a background thread, so that the Classifier, which is a serial stage
+   of the pipeline, never waits for the disk unless the writer falls behind
+   by several blocks. Flushing the QAWriter only hands the current block
+   over to the background thread. */
+class QAWriter: public std::ostream, private BlockQueue,
+                private boost::noncopyable {
+
+public:
+    QAWriter(std::ostream *out_p, size_t block_size);
+
+    // The destructor closes the writer.
+    ~QAWriter();
+
+    // close writes out everything written so far, stops the background
+    // thread and flushes the underlying stream.
+    void close();
+
+private:
+    virtual void push_block(std::string &block);
+    void write_blocks();
+
+private:
+    std::ostream *m_out_p;
+    BlockBuffer m_buffer;
+
+    // The blocks waiting to be written, at most m_max_blocks of them.
+    std::deque<std::string> m_blocks;
+    size_t m_max_blocks;
+    bool m_closing;
+    boost::mutex m_mutex;
+    boost::condition_variable m_blocks_changed;
+    boost::thread m_thread;
+};
+
+}
+
+#endif
@@ -9,9 +9,15 @@
 namespace trtok {
 
 void* RoughTokenizer::operator()(void*) {
-  if (m_hit_end) {
-    // Returing NULL signifies the end of processing to TBB
-    return NULL;
+  if (!m_in_document) {
+    if (!m_input_p->next_document()) {
+      // Returing NULL signifies the end of processing to TBB
+      return NULL;
+    }
+    // The lexer is started afresh on every document
+    m_wrapper_p->reset();
+    m_first_chunk = true;
+    m_in_document = true;
   }
 
   // TODO: This repeated allocation could be diminished by using some sort
@@ -73,10 +79,10 @@ void* RoughTokenizer::operator()(void*) {
   }
 
   if (m_last_rough_tok.type_id == TERMINATION_ID) {
-    m_hit_end = true;
+    m_in_document = false;
   }
   
-  chunk_p->is_final = m_hit_end;
+  chunk_p->is_final = !m_in_document;
   return chunk_p;
 }
 
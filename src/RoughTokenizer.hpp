@@ -5,13 +5,15 @@
 
 #include "roughtok/roughtok_wrapper.hpp"
 #include "token_t.hpp"
+#include "DocumentStream.hpp"
 
 namespace trtok {
 
 /* RoughTokenizer connects the dynamically loaded rough tokenizer to the
    input stream. It then calls the loaded tokenizer, interprets its output
    and builds a stream of our rich token_t tokens which it bundles in
-   a chunk to be processed in the rest of the pipeline.*/
+   a chunk to be processed in the rest of the pipeline. The input is read
+   a document at a time and the last chunk of every document is final.*/
 class RoughTokenizer: public tbb::filter {
 
 public:
@@ -19,38 +21,35 @@ public:
                    IRoughLexerWrapper *wrapper_p ):
                 tbb::filter(tbb::filter::serial_in_order),
                 m_wrapper_p(wrapper_p),
-                m_hit_end(false),
-                m_first_chunk(true)
+                m_input_p(NULL),
+                m_first_chunk(true),
+                m_in_document(false)
     {}
 
-    // setup prepares the RoughTokenizer to read from an encoded stream
-    // and produce UTF-8 rough tokens.
-    void setup(istream* in_p, char const *encoding) {
+    // setup prepares the RoughTokenizer to read the documents of an encoded
+    // stream and produce UTF-8 rough tokens.
+    void setup(DocumentStream* in_p, char const *encoding) {
       m_wrapper_p->setup(in_p, encoding);
+      m_input_p = in_p;
       m_first_chunk = true;
-      m_hit_end = false;
-    }
-
-    // reset prepares the RoughTokenizer to process another file.
-    void reset() {
-      m_wrapper_p->reset();
-      m_first_chunk = true;
-      m_hit_end = false;
+      m_in_document = false;
     }
 
     // The invoke operator repeatedly calls receive on the in the loaded
     // tokenizer until it gets a decent amount of tokens (constant CHUNK_SIZE
     // specified during compilation) and then sends them down the pipeline
-    // as a chunk_t.
+    // as a chunk_t. When the input stream has no more documents, it ends
+    // the pipeline.
     virtual void* operator()(void*);
 
 private:
     // Configuration
     IRoughLexerWrapper *m_wrapper_p;
+    DocumentStream *m_input_p;
 
     // State
     bool m_first_chunk;
-    bool m_hit_end;
+    bool m_in_document;
     rough_token_t m_last_rough_tok;
 };
 
@@ -1,4 +1,5 @@
 #include <cstdlib>
+#include <climits>
 #include <string>
 #include <boost/unordered_map.hpp>
 #include <boost/cstdint.hpp>
@@ -8,6 +9,7 @@ typedef boost::uint32_t uint32_t;
 #include "trtok_clean_entities_EntityCleaner"
 #include "trtok_clean_xml_XmlCleaner"
 #include "cutout_t.hpp"
+#include "DocumentStream.hpp"
 #include "utils.hpp"
 
 /* Due to the nature of XML (contains whitespace) and Quex, one of two
@@ -84,12 +86,12 @@ typedef boost::uint32_t uint32_t;
       }\
     } while (token_p->type_id() != token_prefix##TERMINATION);\
     \
-    /* In the end we send a SYNC_MARK to tell the output formatter
-     * to not expect any more cutouts. */\
+    /* In the end we send a DOCUMENT_END_MARK to tell the output formatter
+     * to not expect any more cutouts in this document. */\
     if (m_cutout_queue_p != NULL) {\
       cutout_t cutout;\
-      cutout.type = SYNC_MARK;\
-      cutout.position = position + 1;\
+      cutout.type = DOCUMENT_END_MARK;\
+      cutout.position = LONG_MAX;\
       cutout.text = "";\
       m_cutout_queue_p->push(cutout);\
     }\
@@ -132,7 +134,8 @@ void TextCleaner::do_work()
   } else {
     TEXTCLEANER(clean_xml, XmlCleaner, QUEX_PREPROC_WITHXML_);
   }
-  m_output_stream_p->close();
+  m_output_stream_p->put(END_OF_DOCUMENT);
+  m_output_stream_p->flush();
 }
 
 void TextCleaner::prepare_entity_map()
@@ -24,7 +24,8 @@ class TextCleaner
 
 public:
   TextCleaner(/* The pipestream to which the cleaned text in UTF-8 is sent;
-                 the pipestream is closed after processing all of the input */
+                 every input is followed by END_OF_DOCUMENT and the
+                 pipestream is only closed by close */
               pipes::opipestream *output_stream_p,
               /* The name of the input encoding */
               std::string const &input_encoding,
@@ -59,9 +60,14 @@ public:
   }
 
   // do_word reads everything from the input stream and writes the cleaned
-  // vesion to the output stream.
+  // vesion to the output stream, followed by END_OF_DOCUMENT.
   void do_work();
 
+  // close closes the output stream after the last input.
+  void close() {
+    m_output_stream_p->close();
+  }
+
 private:
   void prepare_entity_map();
   bool expand_entity(std::string const &entity, uint32_t &expanded_str);
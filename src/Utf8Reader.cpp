@@ -0,0 +1,64 @@
+#include <istream>
+#include <vector>
+#include <cstring>
+#include <stdexcept>
+
+#include "Utf8Reader.hpp"
+#include "utils.hpp"
+
+using namespace std;
+
+namespace trtok {
+
+namespace {
+
+size_t const BLOCK_SIZE = 65536;
+
+}
+
+
+void Utf8Reader::setup(istream *input_stream_p) {
+  m_input_stream_p = input_stream_p;
+  m_buffer.resize(BLOCK_SIZE);
+  m_begin = 0;
+  m_end = 0;
+}
+
+bool Utf8Reader::refill(size_t n_bytes) {
+  if (m_input_stream_p == NULL)
+    return false;
+
+  // The bytes not consumed yet are moved to the start of the buffer and
+  // the rest of it is filled from the stream.
+  memmove(&m_buffer[0], &m_buffer[m_begin], m_end - m_begin);
+  m_end -= m_begin;
+  m_begin = 0;
+  if (n_bytes > BLOCK_SIZE)
+    n_bytes = BLOCK_SIZE;
+  while ((m_end < n_bytes) && m_input_stream_p->good()) {
+    m_input_stream_p->read(&m_buffer[m_end], BLOCK_SIZE - m_end);
+    m_end += m_input_stream_p->gcount();
+  }
+  return m_end > 0;
+}
+
+uint32_t Utf8Reader::peek(size_t &n_bytes) {
+  n_bytes = 0;
+  if (!fill(1))
+    return 0;
+  uint8_t lead = (uint8_t)m_buffer[m_begin];
+  if (lead < 0x80) {
+    n_bytes = 1;
+    return lead;
+  }
+
+  size_t length = utf8_sequence_length(lead);
+  if ((length == 0) || !fill(length) || (available() < length))
+    throw domain_error("buffer does not hold a valid UTF-8 character.");
+  size_t offset = m_begin;
+  uint32_t c = utf8char_to_unicode(&m_buffer[0], offset);
+  n_bytes = length;
+  return c;
+}
+
+}
@@ -0,0 +1,80 @@
+#ifndef UTF8_READER_INCLUDE_GUARD
+#define UTF8_READER_INCLUDE_GUARD
+
+#include <istream>
+#include <vector>
+#include <boost/cstdint.hpp>
+typedef boost::uint32_t uint32_t;
+
+namespace trtok {
+
+/* Utf8Reader reads a UTF-8 encoded stream in large blocks. The bytes read
+   ahead can be compared with other text directly, the characters are only
+   decoded when asked for using peek or get. */
+class Utf8Reader {
+
+public:
+    Utf8Reader():
+        m_input_stream_p(NULL),
+        m_begin(0),
+        m_end(0)
+    {}
+
+    // setup starts reading a new stream, anything left from the previous
+    // one is dropped.
+    void setup(std::istream *input_stream_p);
+
+    // fill reads more of the stream, if needed, so that at least n_bytes
+    // bytes (but no more than a block) are available. It returns false if
+    // there are no bytes left at all.
+    bool fill(size_t n_bytes = 1) {
+      return (m_end - m_begin >= n_bytes) || refill(n_bytes);
+    }
+
+    // The bytes which have been read ahead of the current position.
+    char const *data() const {
+      return &m_buffer[m_begin];
+    }
+
+    size_t available() const {
+      return m_end - m_begin;
+    }
+
+    void advance(size_t n_bytes) {
+      m_begin += n_bytes;
+    }
+
+    bool at_end() {
+      return !fill();
+    }
+
+    // peek decodes the character at the current position and stores the
+    // length of its encoding in n_bytes. At the end of the stream, it
+    // returns 0.
+    uint32_t peek(size_t &n_bytes);
+
+    uint32_t peek() {
+      size_t n_bytes;
+      return peek(n_bytes);
+    }
+
+    // get returns the next character, or 0 at the end of the stream.
+    uint32_t get() {
+      size_t n_bytes;
+      uint32_t c = peek(n_bytes);
+      m_begin += n_bytes;
+      return c;
+    }
+
+private:
+    bool refill(size_t n_bytes);
+
+    std::istream *m_input_stream_p;
+    std::vector<char> m_buffer;
+    size_t m_begin;
+    size_t m_end;
+};
+
+}
+
+#endif
@@ -0,0 +1,62 @@
+#include <deque>
+#include <boost/thread.hpp>
+#include <boost/bind.hpp>
+
+#include "WorkerThread.hpp"
+
+using namespace std;
+
+namespace trtok {
+
+WorkerThread::WorkerThread():
+    m_busy(false),
+    m_stopping(false)
+{
+  m_thread = boost::thread(boost::bind(&WorkerThread::run_tasks, this));
+}
+
+WorkerThread::~WorkerThread() {
+  {
+    boost::mutex::scoped_lock lock(m_mutex);
+    m_stopping = true;
+    m_tasks_changed.notify_all();
+  }
+  m_thread.join();
+}
+
+void WorkerThread::post(task_t const &task) {
+  boost::mutex::scoped_lock lock(m_mutex);
+  m_tasks.push_back(task);
+  m_tasks_changed.notify_all();
+}
+
+void WorkerThread::wait() {
+  boost::mutex::scoped_lock lock(m_mutex);
+  while (!m_tasks.empty() || m_busy) {
+    m_tasks_changed.wait(lock);
+  }
+}
+
+void WorkerThread::run_tasks() {
+  task_t task;
+  while (true) {
+    {
+      boost::mutex::scoped_lock lock(m_mutex);
+      m_busy = false;
+      m_tasks_changed.notify_all();
+      while (m_tasks.empty() && !m_stopping) {
+        m_tasks_changed.wait(lock);
+      }
+      // The queued tasks are run before stopping.
+      if (m_tasks.empty())
+        return;
+      task.swap(m_tasks.front());
+      m_tasks.pop_front();
+      m_busy = true;
+    }
+    task();
+    task.clear();
+  }
+}
+
+}
@@ -0,0 +1,46 @@
+#ifndef WORKER_THREAD_INCLUDE_GUARD
+#define WORKER_THREAD_INCLUDE_GUARD
+
+#include <deque>
+#include <boost/thread.hpp>
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+
+namespace trtok {
+
+/* WorkerThread is a thread which lives as long as the object and runs the
+   tasks queued for it one after another. The stages which run in their own
+   threads (TextCleaner, Encoder) are given to WorkerThreads for every file,
+   so that no thread has to be started and joined per file. */
+class WorkerThread: private boost::noncopyable {
+
+public:
+    typedef boost::function<void ()> task_t;
+
+    WorkerThread();
+
+    // The destructor waits for the queued tasks and stops the thread.
+    ~WorkerThread();
+
+    // post queues a task to be run by the thread.
+    void post(task_t const &task);
+
+    // wait blocks until all the tasks posted so far have been run.
+    void wait();
+
+private:
+    void run_tasks();
+
+private:
+    std::deque<task_t> m_tasks;
+    // Whether the thread is running a task taken off the queue.
+    bool m_busy;
+    bool m_stopping;
+    boost::mutex m_mutex;
+    boost::condition_variable m_tasks_changed;
+    boost::thread m_thread;
+};
+
+}
+
+#endif
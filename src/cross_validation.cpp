@@ -0,0 +1,130 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <boost/thread.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+#include "cross_validation.hpp"
+#include "task_queue.hpp"
+
+using namespace std;
+
+namespace trtok {
+
+namespace {
+
+/* FoldTask trains and evaluates a fold, it is run by run_tasks for every
+   fold. */
+class FoldTask {
+
+public:
+    FoldTask(MaxentTrainer const &trainer,
+             training_parameters_t const &training_parameters,
+             size_t n_feature_buckets,
+             vector<fold_result_t> &results):
+        m_trainer(trainer),
+        m_training_parameters(training_parameters),
+        m_n_feature_buckets(n_feature_buckets),
+        m_results(results)
+    {}
+
+    void operator()(size_t fold) {
+      boost::posix_time::ptime start =
+        boost::posix_time::microsec_clock::universal_time();
+
+      size_t n_events = m_trainer.n_events();
+      size_t n_folds = m_results.size();
+      size_t first_event = n_events * fold / n_folds;
+      size_t end_event = n_events * (fold + 1) / n_folds;
+
+      // The fold is trained on the events of the trainer, which are only
+      // read, so that the folds trained at the same time do not keep
+      // copies of them.
+      MaxentTrainer fold_trainer;
+      fold_trainer.share_events(m_trainer, first_event, end_event);
+
+      fold_result_t &result = m_results[fold];
+      result.n_training_events = fold_trainer.n_events();
+      result.n_test_events = fold_trainer.n_heldout_events();
+      if (fold_trainer.n_events() > 0) {
+        fold_trainer.train(m_training_parameters);
+        fold_trainer.classify_heldout(m_n_feature_buckets, result.stats);
+      }
+
+      boost::posix_time::time_duration elapsed =
+        boost::posix_time::microsec_clock::universal_time() - start;
+      result.seconds = elapsed.total_microseconds() / 1e6;
+
+      boost::mutex::scoped_lock lock(m_log_mutex);
+      clog << "trtok: Fold " << fold + 1 << " of " << n_folds << " done in "
+           << result.seconds << " s" << endl;
+    }
+
+private:
+    MaxentTrainer const &m_trainer;
+    training_parameters_t const &m_training_parameters;
+    size_t m_n_feature_buckets;
+    vector<fold_result_t> &m_results;
+    boost::mutex m_log_mutex;
+};
+}
+
+
+void cross_validate(MaxentTrainer const &trainer, size_t n_folds,
+                    training_parameters_t const &training_parameters,
+                    size_t n_feature_buckets, size_t n_workers,
+                    vector<fold_result_t> &results) {
+  results.assign(n_folds, fold_result_t());
+
+  FoldTask task(trainer, training_parameters, n_feature_buckets, results);
+  run_tasks(task, n_folds, n_workers);
+}
+
+void print_cross_validation(vector<fold_result_t> const &results,
+                            ostream &out) {
+  ios::fmtflags flags = out.flags();
+  streamsize precision = out.precision();
+  out << fixed << setprecision(4);
+
+  out << setw(6) << "fold" << setw(12) << "test events";
+  for (size_t m = 0; m != N_TABLE_METRICS; m++) {
+    out << setw(10) << table_metric_headings[m];
+  }
+  out << setw(10) << "time (s)" << endl;
+
+  // The averages are taken over the folds for which the metric is defined.
+  vector<double> sums(N_TABLE_METRICS, 0.0);
+  vector<size_t> counts(N_TABLE_METRICS, 0);
+  size_t n_test_events = 0;
+  double seconds = 0.0;
+
+  for (size_t fold = 0; fold != results.size(); fold++) {
+    fold_result_t const &result = results[fold];
+    out << setw(6) << fold + 1 << setw(12) << result.n_test_events;
+    for (size_t m = 0; m != N_TABLE_METRICS; m++) {
+      double value = result.stats.metric(table_metrics[m]);
+      print_metric(out, value, 10);
+      if (value != NO_DATA) {
+        sums[m] += value;
+        counts[m]++;
+      }
+    }
+    out << setw(10) << result.seconds << endl;
+    n_test_events += result.n_test_events;
+    seconds += result.seconds;
+  }
+
+  if (!results.empty()) {
+    out << setw(6) << "mean" << setw(12) << n_test_events / results.size();
+    for (size_t m = 0; m != N_TABLE_METRICS; m++) {
+      print_metric(out, (counts[m] > 0) ? sums[m] / counts[m] : NO_DATA, 10);
+    }
+    out << setw(10) << seconds / results.size() << endl;
+  }
+
+  out.flags(flags);
+  out.precision(precision);
+}
+
+}
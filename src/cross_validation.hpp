@@ -0,0 +1,39 @@
+#ifndef CROSS_VALIDATION_INCLUDE_GUARD
+#define CROSS_VALIDATION_INCLUDE_GUARD
+
+#include <vector>
+#include <iostream>
+
+#include "MaxentTrainer.hpp"
+#include "evaluation_stats.hpp"
+
+namespace trtok {
+
+struct fold_result_t {
+  size_t n_training_events;
+  size_t n_test_events;
+  evaluation_stats_t stats;
+  // The wall-clock time spent on training and evaluating the fold.
+  double seconds;
+};
+
+// cross_validate splits the training events of trainer into n_folds folds
+// of consecutive events. For every fold, a model is trained on the other
+// folds and the fold is classified by it. The events are the ones collected
+// by the Classifier, so the input is tokenized and aligned only once for all
+// the folds. Up to n_workers folds are processed at the same time. If the
+// features were hashed into n_feature_buckets buckets, the same must be
+// given here so that the decision points can be recognized.
+void cross_validate(MaxentTrainer const &trainer, size_t n_folds,
+                    training_parameters_t const &training_parameters,
+                    size_t n_feature_buckets, size_t n_workers,
+                    std::vector<fold_result_t> &results);
+
+// print_cross_validation outputs a table with the metrics of every fold and
+// their averages.
+void print_cross_validation(std::vector<fold_result_t> const &results,
+                            std::ostream &out);
+
+}
+
+#endif
@@ -0,0 +1,167 @@
+#include <string>
+#include <vector>
+#include <iostream>
+#include <iomanip>
+
+#include "evaluation_stats.hpp"
+
+using namespace std;
+
+namespace trtok {
+
+char const *outcome_names[N_OUTCOMES] = {
+  "",
+  "SPLIT",
+  "JOIN",
+  "BREAK_SENTENCE"
+};
+
+char const *evaluation_metric_names[N_EVALUATION_METRICS] = {
+  "Effective accuracy",
+  "Segmentation accuracy",
+  "Segmentation precision",
+  "Segmentation recall",
+  "Segmentation F-measure",
+  "Tokenization accuracy",
+  "Tokenization precision",
+  "Tokenization recall",
+  "Tokenization F-measure"
+};
+
+evaluation_metric_t const table_metrics[N_TABLE_METRICS] = {
+  EFFECTIVE_ACCURACY,
+  SEGMENTATION_PRECISION,
+  SEGMENTATION_RECALL,
+  SEGMENTATION_F_MEASURE,
+  TOKENIZATION_PRECISION,
+  TOKENIZATION_RECALL,
+  TOKENIZATION_F_MEASURE
+};
+
+char const *table_metric_headings[N_TABLE_METRICS] = {
+  "accuracy", "seg. P", "seg. R", "seg. F", "tok. P", "tok. R", "tok. F"
+};
+
+namespace {
+
+double ratio(size_t numerator, size_t denominator) {
+  return (denominator > 0) ? (double)numerator / denominator : NO_DATA;
+}
+
+double f_measure(double precision, double recall) {
+  if ((precision == NO_DATA) || (recall == NO_DATA)
+      || (precision + recall == 0.0))
+    return NO_DATA;
+  return 2 * precision * recall / (precision + recall);
+}
+
+}
+
+
+outcome_t outcome_from_name(string const &name) {
+  for (int o = SPLIT_OUTCOME; o != N_OUTCOMES; o++) {
+    if (name == outcome_names[o])
+      return (outcome_t)o;
+  }
+  return NO_OUTCOME;
+}
+
+evaluation_stats_t &evaluation_stats_t::operator+=(
+    evaluation_stats_t const &other) {
+  n_events += other.n_events;
+  n_correct += other.n_correct;
+  seg_tp += other.seg_tp;
+  seg_fp += other.seg_fp;
+  seg_tn += other.seg_tn;
+  seg_fn += other.seg_fn;
+  tok_tp += other.tok_tp;
+  tok_fp += other.tok_fp;
+  tok_tn += other.tok_tn;
+  tok_fn += other.tok_fn;
+  return *this;
+}
+
+double evaluation_stats_t::metric(evaluation_metric_t which) const {
+  switch (which) {
+    case EFFECTIVE_ACCURACY:
+      return ratio(n_correct, n_events);
+    case SEGMENTATION_ACCURACY:
+      return ratio(seg_tp + seg_tn, seg_tp + seg_tn + seg_fp + seg_fn);
+    case SEGMENTATION_PRECISION:
+      return ratio(seg_tp, seg_tp + seg_fp);
+    case SEGMENTATION_RECALL:
+      return ratio(seg_tp, seg_tp + seg_fn);
+    case SEGMENTATION_F_MEASURE:
+      return f_measure(metric(SEGMENTATION_PRECISION),
+                       metric(SEGMENTATION_RECALL));
+    case TOKENIZATION_ACCURACY:
+      return ratio(tok_tp + tok_tn, tok_tp + tok_tn + tok_fp + tok_fn);
+    case TOKENIZATION_PRECISION:
+      return ratio(tok_tp, tok_tp + tok_fp);
+    case TOKENIZATION_RECALL:
+      return ratio(tok_tp, tok_tp + tok_fn);
+    case TOKENIZATION_F_MEASURE:
+      return f_measure(metric(TOKENIZATION_PRECISION),
+                       metric(TOKENIZATION_RECALL));
+    default:
+      return NO_DATA;
+  }
+}
+
+void evaluation_stats_t::print(ostream &out) const {
+  out << "Number of events: " << n_events << endl;
+  for (int m = 0; m != N_EVALUATION_METRICS; m++) {
+    // The metrics are grouped the same way as in the analyze script.
+    if ((m == EFFECTIVE_ACCURACY) || (m == SEGMENTATION_ACCURACY)
+        || (m == TOKENIZATION_ACCURACY))
+      out << endl;
+    double value = metric((evaluation_metric_t)m);
+    out << evaluation_metric_names[m] << ": ";
+    if (value == NO_DATA)
+      out << "no data";
+    else
+      out << value;
+    out << endl;
+  }
+}
+
+void print_metric(ostream &out, double value, int width) {
+  if (value == NO_DATA)
+    out << setw(width) << "-";
+  else
+    out << setw(width) << value;
+}
+
+void print_evaluation_report(vector<string> const &file_names,
+                             vector<evaluation_stats_t> const &file_stats,
+                             ostream &out) {
+  evaluation_stats_t total;
+  for (size_t f = 0; f != file_stats.size(); f++) {
+    total += file_stats[f];
+  }
+  total.print(out);
+  out << endl;
+
+  ios::fmtflags flags = out.flags();
+  streamsize precision = out.precision();
+  out << fixed << setprecision(4);
+
+  out << setw(10) << "events";
+  for (size_t m = 0; m != N_TABLE_METRICS; m++) {
+    out << setw(10) << table_metric_headings[m];
+  }
+  out << "  file" << endl;
+
+  for (size_t f = 0; f != file_stats.size(); f++) {
+    out << setw(10) << file_stats[f].n_events;
+    for (size_t m = 0; m != N_TABLE_METRICS; m++) {
+      print_metric(out, file_stats[f].metric(table_metrics[m]), 10);
+    }
+    out << "  " << file_names[f] << endl;
+  }
+
+  out.flags(flags);
+  out.precision(precision);
+}
+
+}
@@ -0,0 +1,119 @@
+#ifndef EVALUATION_STATS_INCLUDE_GUARD
+#define EVALUATION_STATS_INCLUDE_GUARD
+
+#include <string>
+#include <vector>
+#include <iostream>
+
+namespace trtok {
+
+// The outcomes of the classifier's decisions. NO_OUTCOME stands for the
+// outcome which is not known in the current mode.
+enum outcome_t {
+  NO_OUTCOME,
+  SPLIT_OUTCOME,
+  JOIN_OUTCOME,
+  BREAK_SENTENCE_OUTCOME,
+  N_OUTCOMES
+};
+
+// The names of the outcomes as used by the maxent model.
+extern char const *outcome_names[N_OUTCOMES];
+
+// outcome_from_name maps the name of an outcome to the outcome,
+// NO_OUTCOME if it is not a known name.
+outcome_t outcome_from_name(std::string const &name);
+
+enum evaluation_metric_t {
+  EFFECTIVE_ACCURACY,
+  SEGMENTATION_ACCURACY,
+  SEGMENTATION_PRECISION,
+  SEGMENTATION_RECALL,
+  SEGMENTATION_F_MEASURE,
+  TOKENIZATION_ACCURACY,
+  TOKENIZATION_PRECISION,
+  TOKENIZATION_RECALL,
+  TOKENIZATION_F_MEASURE,
+  N_EVALUATION_METRICS
+};
+
+// The value of a metric which cannot be computed for lack of data.
+const double NO_DATA = -1.0;
+
+// The names of the metrics as printed by evaluation_stats_t::print.
+extern char const *evaluation_metric_names[N_EVALUATION_METRICS];
+
+// The metrics shown in tables comparing several evaluations, along with
+// their column headings.
+size_t const N_TABLE_METRICS = 7;
+extern evaluation_metric_t const table_metrics[N_TABLE_METRICS];
+extern char const *table_metric_headings[N_TABLE_METRICS];
+
+/* evaluation_stats_t counts the outcomes of the classifier's decisions and
+   computes the same metrics as the analyze script. A decision is
+   a segmentation decision if the token in the center may break a sentence;
+   breaking the sentence is the positive outcome. A decision is
+   a tokenization decision if the token in the center may be split or
+   joined; any outcome other than JOIN is positive. */
+struct evaluation_stats_t {
+  size_t n_events;
+  size_t n_correct;
+  size_t seg_tp, seg_fp, seg_tn, seg_fn;
+  size_t tok_tp, tok_fp, tok_tn, tok_fn;
+
+  evaluation_stats_t():
+    n_events(0), n_correct(0),
+    seg_tp(0), seg_fp(0), seg_tn(0), seg_fn(0),
+    tok_tp(0), tok_fp(0), tok_tn(0), tok_fn(0)
+  {}
+
+  void add(outcome_t predicted_outcome, outcome_t true_outcome,
+           bool segmentation_decision, bool tokenization_decision) {
+    n_events++;
+    if (predicted_outcome == true_outcome)
+      n_correct++;
+
+    if (segmentation_decision) {
+      bool predicted = (predicted_outcome == BREAK_SENTENCE_OUTCOME);
+      bool correct = (true_outcome == BREAK_SENTENCE_OUTCOME);
+      if (predicted) {
+        if (correct) seg_tp++; else seg_fp++;
+      } else {
+        if (correct) seg_fn++; else seg_tn++;
+      }
+    }
+
+    if (tokenization_decision) {
+      bool predicted = (predicted_outcome != JOIN_OUTCOME);
+      bool correct = (true_outcome != JOIN_OUTCOME);
+      if (predicted) {
+        if (correct) tok_tp++; else tok_fp++;
+      } else {
+        if (correct) tok_fn++; else tok_tn++;
+      }
+    }
+  }
+
+  evaluation_stats_t &operator+=(evaluation_stats_t const &other);
+
+  // metric returns the value of the metric or NO_DATA.
+  double metric(evaluation_metric_t which) const;
+
+  // print outputs the number of events and all the metrics in the format
+  // of the analyze script.
+  void print(std::ostream &out) const;
+};
+
+// print_metric outputs the value of a metric right-aligned in a column of
+// the given width, or "-" if the value is NO_DATA.
+void print_metric(std::ostream &out, double value, int width);
+
+// print_evaluation_report prints the metrics of the whole evaluation
+// followed by a table of the metrics for every file.
+void print_evaluation_report(std::vector<std::string> const &file_names,
+                             std::vector<evaluation_stats_t> const &file_stats,
+                             std::ostream &out);
+
+}
+
+#endif
@@ -0,0 +1,95 @@
+#ifndef FEATURE_HASH_INCLUDE_GUARD
+#define FEATURE_HASH_INCLUDE_GUARD
+
+#include <string>
+#include <boost/lexical_cast.hpp>
+#include <boost/cstdint.hpp>
+typedef boost::uint64_t uint64_t;
+
+namespace trtok {
+
+/* Feature strings are hashed using a polynomial rolling hash modulo 2^64.
+   The hash of a concatenation can be computed from the hashes of its parts
+   (see feature_hash_concat), so the hash of a feature built from several
+   pieces does not require building the feature string. Before the hash is
+   reduced to a bucket, its bits are mixed by the MurmurHash3 finalizer,
+   since the low bits of the polynomial hash depend only on the last few
+   bytes of the string. */
+const uint64_t FEATURE_HASH_BASE = 0x100000001b3ULL;
+
+inline uint64_t feature_hash(char const *data, size_t length,
+                             uint64_t hash = 0) {
+  for (size_t i = 0; i != length; i++) {
+    hash = hash * FEATURE_HASH_BASE + (unsigned char)data[i];
+  }
+  return hash;
+}
+
+inline uint64_t feature_hash(std::string const &str, uint64_t hash = 0) {
+  return feature_hash(str.data(), str.length(), hash);
+}
+
+// feature_hash_decimal continues the hash with the decimal digits of value,
+// as if hashing boost::lexical_cast<std::string>(value).
+inline uint64_t feature_hash_decimal(size_t value, uint64_t hash = 0) {
+  char digits[24];
+  int n_digits = 0;
+  do {
+    digits[n_digits++] = '0' + value % 10;
+    value /= 10;
+  } while (value > 0);
+  while (n_digits > 0) {
+    hash = hash * FEATURE_HASH_BASE + (unsigned char)digits[--n_digits];
+  }
+  return hash;
+}
+
+// feature_hash_power computes FEATURE_HASH_BASE^length.
+inline uint64_t feature_hash_power(size_t length) {
+  uint64_t power = 1;
+  uint64_t base = FEATURE_HASH_BASE;
+  while (length > 0) {
+    if (length & 1)
+      power *= base;
+    base *= base;
+    length >>= 1;
+  }
+  return power;
+}
+
+// feature_hash_concat computes the hash of a concatenated string from the
+// hash of its prefix and the hash and length of its suffix.
+inline uint64_t feature_hash_concat(uint64_t prefix_hash,
+                                    uint64_t suffix_hash,
+                                    size_t suffix_length) {
+  return prefix_hash * feature_hash_power(suffix_length) + suffix_hash;
+}
+
+inline uint64_t mix_feature_hash(uint64_t hash) {
+  hash ^= hash >> 33;
+  hash *= 0xff51afd7ed558ccdULL;
+  hash ^= hash >> 33;
+  hash *= 0xc4ceb9fe1a85ec53ULL;
+  hash ^= hash >> 33;
+  return hash;
+}
+
+inline size_t feature_bucket(uint64_t hash, size_t n_buckets) {
+  return mix_feature_hash(hash) % n_buckets;
+}
+
+// hashed_feature_name is the name of the predicate which stands for
+// a feature with the given hash in the hashed-feature mode.
+inline std::string hashed_feature_name(uint64_t hash, size_t n_buckets) {
+  return "#" + boost::lexical_cast<std::string>(
+                   feature_bucket(hash, n_buckets));
+}
+
+inline std::string hashed_feature_name(std::string const &feature,
+                                       size_t n_buckets) {
+  return hashed_feature_name(feature_hash(feature), n_buckets);
+}
+
+}
+
+#endif
@@ -0,0 +1,322 @@
+/* trtok_incremental_test checks that IncrementalTokenizer::retokenize gives
+ * the same tokens, offsets and decisions as tokenizing the edited text from
+ * scratch. Generated texts are edited at random places and decided by
+ * a model trained on random decisions, so that the decisions depend on the
+ * context of the tokens. It is built and run by make check.
+ *
+ * Without arguments, the texts are lexed by the WordLexer below. Given the
+ * path of a rough lexer compiled by trtok from a scheme
+ * ($TRTOK_PATH/build/<scheme>/roughtok), they are lexed by that one, which
+ * checks IncrementalTokenizer::LEXER_MARGIN against the scheme's rules. If
+ * the lexer cannot be loaded, e.g. because trtok has not been run with the
+ * scheme yet, the test is skipped. */
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <utility>
+#include <cctype>
+#include <boost/filesystem.hpp>
+#include <ltdl.h>
+
+#include "roughtok/roughtok_wrapper.hpp"
+#include "token_t.hpp"
+#include "FeatureExtractor.hpp"
+#include "Classifier.hpp"
+#include "IncrementalTokenizer.hpp"
+#include "test_support.hpp"
+
+using namespace std;
+using namespace trtok;
+namespace fs = boost::filesystem;
+
+
+int const N_DOCUMENTS = 100;
+int const N_EDITS = 20;
+int const N_DOCUMENT_BYTES = 1000;
+int const N_TRAINING_TOKENS = 20000;
+
+// The exit status of a skipped test (see SKIP_RETURN_CODE in CMake).
+int const SKIPPED = 77;
+
+
+// The words of the generated texts. Besides ASCII, there are words in
+// Czech and the no-break spaces added by TestGenerator, so that the offsets
+// of the edits fall into multi-byte characters too.
+char const *const words[] = {
+  "the", "The", "cat", "sat", "Mr", "Mr.", ".", ",", "-", "(", ")", "x1",
+  "2013", "1,5", "a", "B", "U.S", "U.S.", "e.g.", "end", "\"", "?",
+  "P\xc5\x99\xc3\xadli\xc5\xa1", "\xc5\xbelu\xc5\xa5ou\xc4\x8dk\xc3\xbd"
+};
+
+/* WordLexer is a rough lexer standing in for those compiled from the
+ * schemes. A token is a run of letters, digits and non-ASCII bytes or any
+ * other single character. Two tokens not separated by whitespace get
+ * a MAY_JOIN point if a letter or digit follows another character and
+ * a MAY_SPLIT point otherwise. A full stop gets a MAY_BREAK_SENTENCE point
+ * if whitespace and an uppercase letter follow it. */
+class WordLexer: public IRoughLexerWrapper {
+
+public:
+    virtual void setup(istream *in, char const*) {
+      ostringstream text;
+      text << in->rdbuf();
+      m_text = text.str();
+      reset();
+    }
+
+    virtual void reset() {
+      m_position = 0;
+      m_pending.clear();
+    }
+
+    virtual rough_token_t receive() {
+      if (!m_pending.empty()) {
+        rough_token_t token = m_pending.front();
+        m_pending.pop_front();
+        return token;
+      }
+      if (m_position == m_text.length())
+        return make_token(TERMINATION_ID);
+
+      if (is_space(m_text[m_position])) {
+        int n_newlines = 0;
+        while ((m_position < m_text.length())
+               && is_space(m_text[m_position])) {
+          if (m_text[m_position] == '\n')
+            n_newlines++;
+          m_position++;
+        }
+        return make_token(WHITESPACE_ID, "", n_newlines);
+      }
+
+      size_t begin = m_position;
+      if (is_word(m_text[m_position])) {
+        while ((m_position < m_text.length())
+               && is_word(m_text[m_position]))
+          m_position++;
+      } else {
+        m_position++;
+      }
+      string text = m_text.substr(begin, m_position - begin);
+
+      if ((m_position < m_text.length()) && !is_space(m_text[m_position])) {
+        bool join = is_word(m_text[m_position]) && !is_word(text[0]);
+        m_pending.push_back(make_token(join ? MAY_JOIN_ID : MAY_SPLIT_ID));
+      }
+      if (text == ".") {
+        size_t next = m_position;
+        while ((next < m_text.length()) && is_space(m_text[next]))
+          next++;
+        if ((next > m_position) && (next < m_text.length())
+            && isupper((unsigned char)m_text[next]))
+          m_pending.push_back(make_token(MAY_BREAK_SENTENCE_ID));
+      }
+      return make_token(TOKEN_PIECE_ID, text);
+    }
+
+private:
+    static bool is_word(char c) {
+      return isalnum((unsigned char)c) || ((unsigned char)c >= 0x80);
+    }
+
+    static bool is_space(char c) {
+      return isspace((unsigned char)c);
+    }
+
+    static rough_token_t make_token(rough_token_id type_id,
+                                    string const &text = "",
+                                    int n_newlines = 0) {
+      rough_token_t token;
+      token.type_id = type_id;
+      token.text = text;
+      token.n_newlines = n_newlines;
+      return token;
+    }
+
+    string m_text;
+    size_t m_position;
+    deque<rough_token_t> m_pending;
+};
+
+// training_tokens generates tokens with random decisions to train the model
+// on.
+vector<token_t> training_tokens(TestGenerator &generator,
+                                properties_t const &properties) {
+  chunk_t chunk;
+  chunk.tokens.resize(N_TRAINING_TOKENS);
+  for (size_t t = 0; t != chunk.tokens.size(); t++) {
+    token_t &token = chunk.tokens[t];
+    token.text = generator.word();
+    token.n_newlines = (generator.next(4) == 0) ? -1 : generator.next(2);
+    int flags = NO_FLAG;
+    if (token.n_newlines == -1) {
+      flags |= (generator.next(2) == 0)
+                 ? MAY_SPLIT_FLAG | (generator.next(2) ? DO_SPLIT_FLAG : 0)
+                 : MAY_JOIN_FLAG | (generator.next(2) ? DO_JOIN_FLAG : 0);
+    }
+    if (token.text == ".")
+      flags |= MAY_BREAK_SENTENCE_FLAG
+               | (generator.next(2) ? DO_BREAK_SENTENCE_FLAG : 0);
+    token.decision_flags = (decision_flags_t)flags;
+  }
+  FeatureExtractor feature_extractor(properties.n_basic_properties,
+                                     properties.regex_properties,
+                                     properties.word_to_list_props);
+  feature_extractor(&chunk);
+  return chunk.tokens;
+}
+
+// char_boundary moves offset back to the start of the UTF-8 character it
+// falls into, so that the edits leave the text valid UTF-8.
+size_t char_boundary(string const &text, size_t offset) {
+  while ((offset > 0) && (offset < text.length())
+         && (((unsigned char)text[offset] & 0xc0) == 0x80))
+    offset--;
+  return offset;
+}
+
+// load_lexers loads the rough lexer compiled in lexer_path and makes two
+// instances of it. It returns false if the lexer cannot be loaded.
+bool load_lexers(char const *lexer_path, IRoughLexerWrapper *&incremental_p,
+                 IRoughLexerWrapper *&full_p) {
+  int return_code = lt_dlinit();
+  if (return_code != 0) {
+    cerr << "trtok_incremental_test: lt_dlinit returned " << return_code
+         << "." << endl;
+    return false;
+  }
+  lt_dlhandle libroughtok = lt_dlopen(lexer_path);
+  void *factory_func_void_p = (libroughtok == NULL) ? NULL
+                                : lt_dlsym(libroughtok, "make_quex_wrapper");
+  if (factory_func_void_p == NULL) {
+    cerr << "trtok_incremental_test: Cannot load the rough lexer "
+         << lexer_path << ": " << lt_dlerror() << endl;
+    return false;
+  }
+  typedef IRoughLexerWrapper* (*factory_func_t)(void);
+  factory_func_t factory_func_p = (factory_func_t)factory_func_void_p;
+  incremental_p = factory_func_p();
+  full_p = factory_func_p();
+  return true;
+}
+
+// compare describes the first difference between the tokenizations, it
+// returns an empty string if they are the same.
+string compare(tokenization_t const &actual, tokenization_t const &expected) {
+  ostringstream difference;
+  if (actual.text != expected.text) {
+    difference << "the texts differ";
+  } else if (actual.tokens.size() != expected.tokens.size()) {
+    difference << actual.tokens.size() << " tokens instead of "
+               << expected.tokens.size();
+  } else {
+    for (size_t t = 0; t != actual.tokens.size(); t++) {
+      token_t const &a = actual.tokens[t];
+      token_t const &e = expected.tokens[t];
+      if ((a.text != e.text) || (actual.offsets[t] != expected.offsets[t]))
+        difference << "token " << t << " is \"" << a.text << "\" at "
+                   << actual.offsets[t] << " instead of \"" << e.text
+                   << "\" at " << expected.offsets[t];
+      else if (a.decision_flags != e.decision_flags)
+        difference << "the decisions of token " << t << " are "
+                   << a.decision_flags << " instead of "
+                   << e.decision_flags;
+      else if (a.n_newlines != e.n_newlines)
+        difference << "token " << t << " is followed by " << a.n_newlines
+                   << " newlines instead of " << e.n_newlines;
+      else if (a.property_flags != e.property_flags)
+        difference << "the properties of token " << t << " differ";
+      else
+        continue;
+      break;
+    }
+  }
+  return difference.str();
+}
+
+int main(int argc, char **argv) {
+  WordLexer incremental_word_lexer, full_word_lexer;
+  IRoughLexerWrapper *incremental_lexer_p = &incremental_word_lexer;
+  IRoughLexerWrapper *full_lexer_p = &full_word_lexer;
+  if ((argc > 1)
+      && !load_lexers(argv[1], incremental_lexer_p, full_lexer_p)) {
+    cerr << "trtok_incremental_test: Skipped." << endl;
+    return SKIPPED;
+  }
+
+  TestGenerator generator(words, sizeof(words) / sizeof(char const*));
+  properties_t properties;
+  int const precontext = 3, postcontext = 2;
+  int mask_size = (precontext + 1 + postcontext) * properties.names.size();
+  bool *features_mask = new bool[mask_size];
+  for (int i = 0; i != mask_size; i++)
+    features_mask[i] = true;
+
+  fs::path model_path = fs::temp_directory_path()
+                        / fs::unique_path("trtok-incremental-%%%%%%.model");
+  train_model(properties, features_mask, precontext, postcontext,
+              training_tokens(generator, properties), model_path.native());
+
+  // The edited tokenization is checked against a second tokenizer, which
+  // tokenizes the edited text from scratch.
+  FeatureExtractor feature_extractor(properties.n_basic_properties,
+                                     properties.regex_properties,
+                                     properties.word_to_list_props);
+  Classifier incremental_classifier(TOKENIZE_MODE, properties.names,
+                                    precontext, postcontext, features_mask,
+                                    vector< vector< pair<int,int> > >());
+  Classifier full_classifier(TOKENIZE_MODE, properties.names,
+                             precontext, postcontext, features_mask,
+                             vector< vector< pair<int,int> > >());
+  incremental_classifier.load_model(model_path.native());
+  full_classifier.load_model(model_path.native());
+  fs::remove(model_path);
+  IncrementalTokenizer incremental(incremental_lexer_p, feature_extractor,
+                                   incremental_classifier, precontext,
+                                   postcontext);
+  IncrementalTokenizer full(full_lexer_p, feature_extractor, full_classifier,
+                            precontext, postcontext);
+
+  int n_failures = 0;
+  size_t n_decided = 0, n_tokens = 0;
+  for (int d = 0; d != N_DOCUMENTS; d++) {
+    tokenization_t result;
+    incremental.tokenize(generator.text(N_DOCUMENT_BYTES), result);
+    for (int e = 0; e != N_EDITS; e++) {
+      string const &text = result.text;
+      size_t edit_begin = generator.next(text.length() + 1);
+      size_t edit_end = edit_begin
+                        + generator.next(min<size_t>(6, text.length()
+                                                        - edit_begin + 1));
+      edit_begin = char_boundary(text, edit_begin);
+      edit_end = char_boundary(text, edit_end);
+      string replacement = generator.text(generator.next(12));
+      incremental.retokenize(result, edit_begin, edit_end, replacement);
+
+      tokenization_t expected;
+      full.tokenize(result.text, expected);
+      n_decided += incremental.n_decided();
+      n_tokens += expected.tokens.size();
+      string difference = compare(result, expected);
+      if (!difference.empty()) {
+        cerr << "trtok_incremental_test: Document " << d << ", edit " << e
+             << " (" << edit_begin << "-" << edit_end << "): " << difference
+             << "." << endl;
+        n_failures++;
+        // The tokenization is started afresh, so that the later edits are
+        // checked independently of this one.
+        incremental.tokenize(result.text, result);
+      }
+    }
+  }
+  delete[] features_mask;
+
+  cout << "trtok_incremental_test: " << N_DOCUMENTS * N_EDITS - n_failures
+       << " of " << N_DOCUMENTS * N_EDITS << " edits retokenized correctly, "
+       << n_decided << " of " << n_tokens << " tokens decided again." << endl;
+  return (n_failures == 0) ? 0 : 1;
+}
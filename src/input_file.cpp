@@ -0,0 +1,92 @@
+#include <iostream>
+#include <string>
+#include <exception>
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+
+#include "configuration.hpp"
+#ifdef USE_MMAP
+#include <boost/iostreams/device/array.hpp>
+#include <boost/iostreams/stream.hpp>
+#endif
+#ifdef HAVE_MADVISE
+#include <sys/mman.h>
+#endif
+
+#include "input_file.hpp"
+#include "CompressedStream.hpp"
+
+using namespace std;
+namespace fs = boost::filesystem;
+
+namespace trtok {
+
+namespace {
+
+#ifdef USE_MMAP
+/* MappedFileStream is a seekable stream reading a memory-mapped file. It
+   keeps the file mapped for as long as it exists. */
+class MappedFileStream:
+    public boost::iostreams::stream<boost::iostreams::array_source> {
+
+public:
+    explicit MappedFileStream(boost::iostreams::mapped_file_source const &file):
+        boost::iostreams::stream<boost::iostreams::array_source>(file.data(),
+                                                                 file.size()),
+        m_file(file)
+    {}
+
+private:
+    boost::iostreams::mapped_file_source m_file;
+};
+#endif
+
+}
+
+
+istream *open_input_file(string const &path) {
+  fs::path file_path(path);
+  boost::system::error_code error;
+  bool regular = fs::is_regular_file(file_path, error) && !error;
+#ifdef USE_MMAP
+  // Empty files cannot be mapped and are not worth it anyway.
+  if (regular && (fs::file_size(file_path, error) > 0) && !error) {
+    try {
+      boost::iostreams::mapped_file_source file(file_path.native());
+      return open_input_file(file, path);
+    } catch (exception const &) {
+      // The file could not be mapped, e.g. because it does not fit into
+      // the address space, and it is read as a stream instead.
+    }
+  }
+#endif
+  // Only the regular files are checked for compression, since the first
+  // bytes of a pipe cannot be read again.
+  istream *stream_p = new fs::ifstream(file_path);
+  return regular ? decompressed(stream_p, path) : stream_p;
+}
+
+#ifdef USE_MMAP
+istream *open_input_file(boost::iostreams::mapped_file_source const &file,
+                         string const &path) {
+#ifdef HAVE_MADVISE
+  madvise(const_cast<char*>(file.data()), file.size(), MADV_SEQUENTIAL);
+#endif
+  return decompressed(new MappedFileStream(file), path);
+}
+#endif
+
+istream *decompressed(istream *stream_p, string const &name) {
+  char magic[6];
+  stream_p->read(magic, sizeof(magic));
+  compression_t compression = compression_from_magic(magic,
+                                                     stream_p->gcount());
+  stream_p->clear();
+  stream_p->seekg(0);
+  if (compression == NO_COMPRESSION)
+    return stream_p;
+  return new DecompressingStream(stream_p, compression, name,
+                                 COMPRESSION_BLOCK_SIZE);
+}
+
+}
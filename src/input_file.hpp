@@ -0,0 +1,40 @@
+#ifndef INPUT_FILE_INCLUDE_GUARD
+#define INPUT_FILE_INCLUDE_GUARD
+
+#include <iostream>
+#include <string>
+
+#include "configuration.hpp"
+#ifdef USE_MMAP
+#include <boost/iostreams/device/mapped_file.hpp>
+#endif
+
+namespace trtok {
+
+// open_input_file returns a stream reading the input file at path, which
+// is to be deleted by the caller. Regular files are memory-mapped (if
+// USE_MMAP is configured) and read straight from the mapping, which the
+// kernel is told will be read sequentially. Other files, such as named
+// pipes, and files which cannot be mapped are opened as file streams.
+// Regular files compressed by gzip, xz or zstd are recognized by their
+// first bytes and decompressed, see decompressed.
+std::istream *open_input_file(std::string const &path);
+
+#ifdef USE_MMAP
+// open_input_file returns a stream reading the input file at path which
+// has already been mapped in file, e.g. by the FilePrefetcher. The stream
+// keeps the file mapped for as long as it exists.
+std::istream *open_input_file(
+    boost::iostreams::mapped_file_source const &file,
+    std::string const &path);
+#endif
+
+// decompressed checks the first bytes of a seekable stream and, if they
+// start compressed data, returns a DecompressingStream reading the stream,
+// which takes it over. Otherwise, the stream itself is returned, rewound.
+// The name of the file is used in error messages.
+std::istream *decompressed(std::istream *stream_p, std::string const &name);
+
+}
+
+#endif
@@ -0,0 +1,247 @@
+#include <iostream>
+#include <string>
+#include <stdexcept>
+#include <boost/lexical_cast.hpp>
+#include <boost/cstdint.hpp>
+typedef boost::uint32_t uint32_t;
+
+#include "jsonl.hpp"
+
+using namespace std;
+
+namespace trtok {
+
+namespace {
+
+// The code point put in place of unpaired surrogates.
+uint32_t const REPLACEMENT_CHARACTER = 0xFFFD;
+
+void skip_whitespace(string const &line, size_t &pos) {
+  while ((pos < line.length())
+         && ((line[pos] == ' ') || (line[pos] == '\t')
+             || (line[pos] == '\r') || (line[pos] == '\n'))) {
+    pos++;
+  }
+}
+
+void expect(string const &line, size_t &pos, char c) {
+  skip_whitespace(line, pos);
+  if ((pos == line.length()) || (line[pos] != c))
+    throw invalid_argument(string("Expected '") + c + "' at column "
+                           + boost::lexical_cast<string>(pos + 1) + ".");
+  pos++;
+}
+
+void append_utf8(uint32_t code_point, string &out) {
+  if (code_point < 0x80) {
+    out += (char)code_point;
+  } else if (code_point < 0x800) {
+    out += (char)(0xC0 | (code_point >> 6));
+    out += (char)(0x80 | (code_point & 0x3F));
+  } else if (code_point < 0x10000) {
+    out += (char)(0xE0 | (code_point >> 12));
+    out += (char)(0x80 | ((code_point >> 6) & 0x3F));
+    out += (char)(0x80 | (code_point & 0x3F));
+  } else {
+    out += (char)(0xF0 | (code_point >> 18));
+    out += (char)(0x80 | ((code_point >> 12) & 0x3F));
+    out += (char)(0x80 | ((code_point >> 6) & 0x3F));
+    out += (char)(0x80 | (code_point & 0x3F));
+  }
+}
+
+// read_hex4 reads the four hexadecimal digits of a \u escape at pos.
+uint32_t read_hex4(string const &line, size_t &pos) {
+  if (line.length() - pos < 4)
+    throw invalid_argument("Incomplete \\u escape.");
+  uint32_t value = 0;
+  for (int i = 0; i != 4; i++, pos++) {
+    char c = line[pos];
+    value <<= 4;
+    if ((c >= '0') && (c <= '9'))
+      value |= c - '0';
+    else if ((c >= 'a') && (c <= 'f'))
+      value |= c - 'a' + 10;
+    else if ((c >= 'A') && (c <= 'F'))
+      value |= c - 'A' + 10;
+    else
+      throw invalid_argument("Invalid \\u escape.");
+  }
+  return value;
+}
+
+// parse_string reads the string starting at pos and decodes its escapes
+// into out.
+void parse_string(string const &line, size_t &pos, string &out) {
+  expect(line, pos, '"');
+  out.clear();
+  while (true) {
+    size_t special = line.find_first_of("\"\\", pos);
+    if (special == string::npos)
+      throw invalid_argument("Unterminated string.");
+    out.append(line, pos, special - pos);
+    pos = special + 1;
+    if (line[special] == '"')
+      return;
+
+    if (pos == line.length())
+      throw invalid_argument("Unterminated string.");
+    char escape = line[pos++];
+    switch (escape) {
+      case '"': out += '"'; break;
+      case '\\': out += '\\'; break;
+      case '/': out += '/'; break;
+      case 'b': out += '\b'; break;
+      case 'f': out += '\f'; break;
+      case 'n': out += '\n'; break;
+      case 'r': out += '\r'; break;
+      case 't': out += '\t'; break;
+      case 'u': {
+        uint32_t code_point = read_hex4(line, pos);
+        if ((code_point >= 0xD800) && (code_point < 0xDC00)) {
+          // A high surrogate is combined with the low surrogate which
+          // should follow it.
+          size_t low_pos = pos + 2;
+          if ((line.compare(pos, 2, "\\u") == 0)
+              && (line.length() - low_pos >= 4)) {
+            uint32_t low = read_hex4(line, low_pos);
+            if ((low >= 0xDC00) && (low < 0xE000)) {
+              code_point = 0x10000 + ((code_point - 0xD800) << 10)
+                                   + (low - 0xDC00);
+              pos = low_pos;
+            } else {
+              code_point = REPLACEMENT_CHARACTER;
+            }
+          } else {
+            code_point = REPLACEMENT_CHARACTER;
+          }
+        } else if ((code_point >= 0xDC00) && (code_point < 0xE000)) {
+          code_point = REPLACEMENT_CHARACTER;
+        }
+        append_utf8(code_point, out);
+        break;
+      }
+      default:
+        throw invalid_argument(string("Invalid escape \\") + escape + ".");
+    }
+  }
+}
+
+// skip_value moves pos past the JSON value starting at it.
+void skip_value(string const &line, size_t &pos) {
+  skip_whitespace(line, pos);
+  if (pos == line.length())
+    throw invalid_argument("Missing value.");
+  if (line[pos] == '"') {
+    string ignored;
+    parse_string(line, pos, ignored);
+  } else if ((line[pos] == '{') || (line[pos] == '[')) {
+    // The nested values are only matched by their brackets.
+    int depth = 0;
+    do {
+      if (pos == line.length())
+        throw invalid_argument("Unterminated object or array.");
+      char c = line[pos];
+      if (c == '"') {
+        string ignored;
+        parse_string(line, pos, ignored);
+        continue;
+      }
+      if ((c == '{') || (c == '['))
+        depth++;
+      else if ((c == '}') || (c == ']'))
+        depth--;
+      pos++;
+    } while (depth > 0);
+  } else {
+    // A number, true, false or null.
+    size_t end = line.find_first_of(",}] \t\r\n", pos);
+    if (end == string::npos)
+      end = line.length();
+    if (end == pos)
+      throw invalid_argument("Missing value.");
+    pos = end;
+  }
+}
+
+void write_json_string(ostream &out, string const &value) {
+  static char const hex_digits[] = "0123456789abcdef";
+  out << '"';
+  size_t begin = 0;
+  for (size_t i = 0; i != value.length(); i++) {
+    unsigned char c = value[i];
+    if ((c >= 0x20) && (c != '"') && (c != '\\'))
+      continue;
+    out.write(value.data() + begin, i - begin);
+    begin = i + 1;
+    switch (c) {
+      case '"': out << "\\\""; break;
+      case '\\': out << "\\\\"; break;
+      case '\n': out << "\\n"; break;
+      case '\r': out << "\\r"; break;
+      case '\t': out << "\\t"; break;
+      default:
+        out << "\\u00" << hex_digits[c >> 4] << hex_digits[c & 0xF];
+    }
+  }
+  out.write(value.data() + begin, value.length() - begin);
+  out << '"';
+}
+
+}
+
+
+void parse_jsonl_record(string const &line, jsonl_record_t &record) {
+  record.id.clear();
+  record.text.clear();
+  bool has_text = false;
+
+  size_t pos = 0;
+  expect(line, pos, '{');
+  skip_whitespace(line, pos);
+  if ((pos < line.length()) && (line[pos] == '}')) {
+    pos++;
+  } else {
+    string key;
+    while (true) {
+      parse_string(line, pos, key);
+      expect(line, pos, ':');
+      skip_whitespace(line, pos);
+      if (key == "text") {
+        if ((pos == line.length()) || (line[pos] != '"'))
+          throw invalid_argument("The text of the record is not a string.");
+        parse_string(line, pos, record.text);
+        has_text = true;
+      } else if (key == "id") {
+        size_t begin = pos;
+        skip_value(line, pos);
+        record.id.assign(line, begin, pos - begin);
+      } else {
+        skip_value(line, pos);
+      }
+      skip_whitespace(line, pos);
+      if ((pos < line.length()) && (line[pos] == ',')) {
+        pos++;
+        continue;
+      }
+      expect(line, pos, '}');
+      break;
+    }
+  }
+  skip_whitespace(line, pos);
+  if (pos != line.length())
+    throw invalid_argument("Unexpected characters after the record.");
+  if (!has_text)
+    throw invalid_argument("The record has no text.");
+}
+
+void write_jsonl_record(ostream &out, jsonl_record_t const &record) {
+  out << '{';
+  if (!record.id.empty())
+    out << "\"id\":" << record.id << ',';
+  out << "\"text\":";
+  write_json_string(out, record.text);
+  out << "}\n";
+}
+
+}
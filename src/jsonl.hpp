@@ -0,0 +1,32 @@
+#ifndef JSONL_INCLUDE_GUARD
+#define JSONL_INCLUDE_GUARD
+
+#include <iostream>
+#include <string>
+
+namespace trtok {
+
+/* A document of a JSONL container: one JSON object per line, holding the
+   text of the document in its "text" member and, optionally, an "id"
+   member identifying the document. The id is kept as it is written in the
+   input, whatever its type, so that it can be copied to the output. */
+struct jsonl_record_t {
+  // The JSON value of the "id" member, empty if the record has none.
+  std::string id;
+  // The text of the document in UTF-8, with the JSON escapes decoded.
+  std::string text;
+};
+
+// parse_jsonl_record parses a line of a JSONL container into record. The
+// members other than "id" and "text" are ignored. It throws an
+// invalid_argument exception if the line is not a JSON object or if the
+// object has no string "text" member.
+void parse_jsonl_record(std::string const &line, jsonl_record_t &record);
+
+// write_jsonl_record writes the record to out as a line of JSON, the id
+// first (if the record has one) and the text second.
+void write_jsonl_record(std::ostream &out, jsonl_record_t const &record);
+
+}
+
+#endif
@@ -4,15 +4,22 @@
 #include <algorithm>
 #include <map>
 #include <utility>
+#include <stdexcept>
+#include <iomanip>
+#include <sstream>
+#include <set>
 #include <boost/program_options.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/filesystem/fstream.hpp>
 #include <boost/lexical_cast.hpp>
 #include <boost/unordered_map.hpp>
 #include <boost/ref.hpp>
+#include <boost/bind.hpp>
 #include <boost/thread.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
 #include "tbb/pipeline.h"
 #include "tbb/concurrent_queue.h"
+#include "tbb/task_scheduler_init.h"
 #include <ltdl.h>
 #include <pcrecpp.h>
 #include <maxentmodel.hpp>
@@ -21,6 +28,7 @@
 
 #include "configuration.hpp"
 #include "config_exception.hpp"
+#include "messages.hpp"
 #include "TextCleaner.hpp"
 #include "cutout_t.hpp"
 #include "roughtok_compile.hpp"
@@ -28,9 +36,23 @@
 #include "read_features_file.hpp"
 #include "FeatureExtractor.hpp"
 #include "Classifier.hpp"
+#include "MaxentTrainer.hpp"
+#include "CompactModel.hpp"
+#include "AlignmentPipeline.hpp"
+#include "WorkerThread.hpp"
+#include "DocumentStream.hpp"
+#include "DocumentFiles.hpp"
+#include "FilePrefetcher.hpp"
+#include "training_manifest.hpp"
+#include "feature_hash.hpp"
+#include "cross_validation.hpp"
+#include "parameter_sweep.hpp"
+#include "QAWriter.hpp"
+#include "BinaryQAEncoder.hpp"
 #include "SimplePreparer.hpp"
 #include "OutputFormatter.hpp"
 #include "Encoder.hpp"
+#include "Profile.hpp"
 
 using namespace std;
 using namespace trtok;
@@ -42,8 +64,12 @@ namespace fs = boost::filesystem;
   return 1;\
 }
 
-#define SIGNAL_WARNING(location, message) {\
-  cerr << location << ": Warning: " << message << endl;\
+boost::posix_time::ptime current_time() {
+  return boost::posix_time::microsec_clock::universal_time();
+}
+
+double seconds_since(boost::posix_time::ptime start) {
+  return (current_time() - start).total_microseconds() / 1e6;
 }
 
 // A 2D-array accessor for the feature selection mask
@@ -86,6 +112,26 @@ void include_listed_files(fs::path const &file_list_path,
     }
 }
 
+// back_up_unpruned copies the model at path to backup_path before it is
+// pruned. A backup which is not older than the model is kept, the model has
+// then been pruned from it already.
+void back_up_unpruned(fs::path const &path, fs::path const &backup_path) {
+  if (fs::exists(backup_path)
+      && (fs::last_write_time(backup_path) >= fs::last_write_time(path)))
+    return;
+  fs::copy_file(path, backup_path, fs::copy_option::overwrite_if_exists);
+}
+
+// replace_with_pruned moves the pruned model written to temp_path over
+// path. The backup of the unpruned model is dated the same, so that it is
+// kept when the model is pruned again, but not when it is retrained.
+void replace_with_pruned(fs::path const &temp_path, fs::path const &path,
+                         fs::path const &backup_path) {
+  fs::rename(temp_path, path);
+  if (fs::exists(backup_path))
+    fs::last_write_time(backup_path, fs::last_write_time(path));
+}
+
 
 int main(int argc, char const **argv) {
 
@@ -98,9 +144,11 @@ int main(int argc, char const **argv) {
     string s_mode, s_scheme;
     string s_encoding;
     string s_qa_file;
+    string s_profile_file;
 
     vector<string> sv_input_files;
     vector<string> sv_file_lists, sv_heldout_file_lists;
+    vector<string> sv_grid;
     string s_filename_regexp;
 
     bool o_detokenize, o_honour_single_newline, o_honour_more_newlines,
@@ -108,6 +156,16 @@ int main(int argc, char const **argv) {
     bool o_remove_xml, o_remove_xml_perm;
     bool o_expand_entities, o_expand_entities_perm;
     bool o_verbose;
+    bool o_warm_start;
+    bool o_rebuild_events;
+    bool o_binary_questions;
+    bool o_jsonl;
+    int n_jobs;
+    int n_prefetch_files;
+    size_t prefetch_megabytes;
+    int n_folds;
+    double min_weight;
+    size_t min_count;
 
     /* We use the Boost Program Options library to handle option parsing.
      * We first start off by enumerating the names, types and descriptions
@@ -133,6 +191,12 @@ int main(int argc, char const **argv) {
         "for the input files. These are the output files when in 'prepare' "
         "or 'tokenize' modes and annotated files when in 'train' or "
         "'evaluate' modes.")
+      ("jsonl", po::bool_switch(&o_jsonl),
+        "In 'prepare' and 'tokenize' modes, every line of the input files is "
+        "a JSON object holding a document in its \"text\" member and its "
+        "identifier in its \"id\" member. The documents are tokenized "
+        "independently and written to the output files as JSON objects with "
+        "the same identifiers, in the same order.")
       ("detokenize,d", po::bool_switch(&o_detokenize),
         "Preserve the tokenization (whitespace delimited) of the input.")
       ("honour-single-newline,s", po::bool_switch(&o_honour_single_newline),
@@ -161,10 +225,51 @@ int main(int argc, char const **argv) {
         "to the specified file. In 'tokenize' mode, the classifier's answer is "
         "present; in 'train' mode, it is the answer induced from the data. In "
         "'evaluate' mode, both the answer given by the classifier and the "
-        "correct answer are output. If no file is given in 'evaluate' mode, "
-        "the questions are output to the standard output instead.")
+        "correct answer are output. If the file is -, the questions are "
+        "output to the standard output.")
+      ("binary-questions,b", po::bool_switch(&o_binary_questions),
+        "Writes the questions and answers in a compact binary format instead "
+        "of text. The qa2text script converts them back to text.")
+      ("profile", po::value<string>(&s_profile_file)->implicit_value(""),
+        "Prints the time spent in every stage of the pipeline, the time the "
+        "stage spent waiting for its neighbours and the amount of data it "
+        "processed to the standard error output. If a file is given, the "
+        "profile is also written to it in JSON.")
+      ("jobs,j", po::value<int>(&n_jobs)->default_value(1),
+        "The number of files which are processed at the same time in 'train' "
+        "and 'evaluate' modes. The results do not depend on this number.")
+      ("prefetch", po::value<int>(&n_prefetch_files)->default_value(4),
+        "The number of input files which are read into memory ahead of the "
+        "ones being processed. In 'train' and 'evaluate' modes, the input "
+        "files and their annotated versions count separately. 0 turns the "
+        "reading ahead off.")
+      ("prefetch-memory",
+          po::value<size_t>(&prefetch_megabytes)->default_value(64),
+        "The most memory in megabytes taken by the files read ahead. Larger "
+        "files are not read ahead.")
+      ("folds,k", po::value<int>(&n_folds)->default_value(5),
+        "The number of folds the training data are split into in 'crossval' "
+        "mode.")
+      ("grid", po::value< vector<string> >(&sv_grid)->composing(),
+        "In 'sweep' mode, a training parameter to sweep over and the values "
+        "it takes, written as name=value1,value2,... A model is trained for "
+        "every combination of the values of all the parameters given.")
+      ("min-weight", po::value<double>(&min_weight)->default_value(0.0),
+        "In 'prune' mode, the parameters of the model whose absolute value "
+        "is less than this are removed.")
+      ("min-count", po::value<size_t>(&min_count)->default_value(0),
+        "In 'prune' mode, the predicates which have been seen fewer times "
+        "than this in the training data are removed from the model.")
+      ("warm-start,w", po::bool_switch(&o_warm_start),
+        "In 'train' mode, start from the parameters of the existing model and "
+        "train it only on the training files which are new or have changed "
+        "since it was trained.")
+      ("rebuild-events", po::bool_switch(&o_rebuild_events),
+        "In 'train', 'crossval' and 'sweep' modes, extract the events from "
+        "all the training files again instead of reusing the events cached "
+        "in the build directory.")
       ("verbose,v", po::bool_switch(&o_verbose),
-        "If set, the Maxent toolkit will output its reports.")
+        "If set, the maxent trainer will report its progress.")
     ;
 
     /* Positional arguments such as the mode and scheme need to be described
@@ -200,7 +305,8 @@ int main(int argc, char const **argv) {
           o_expand_entities = true;
     } catch (po::error const &exc) {
         cerr << "trtok:command line options: Error: " << exc.what() << endl;
-        cerr << "Usage: trtok <prepare|train|tokenize|evaluate> "
+        cerr << "Usage: trtok "
+                "<prepare|train|tokenize|evaluate|crossval|sweep|prune> "
                 "SCHEME [OPTION]... [FILE]..." << endl;
         cerr << explicit_options;
         return 1;
@@ -208,6 +314,9 @@ int main(int argc, char const **argv) {
 
 
     classifier_mode_t mode;
+    bool crossval = false;
+    bool sweep = false;
+    bool prune = false;
     if (s_mode == "prepare") {
       mode = PREPARE_MODE;
     } else if (s_mode == "train") {
@@ -216,14 +325,67 @@ int main(int argc, char const **argv) {
       mode = TOKENIZE_MODE;
     } else if (s_mode == "evaluate") {
       mode = EVALUATE_MODE;
+    } else if (s_mode == "crossval") {
+      // Cross-validation collects the training events like 'train' mode
+      // and reads the same file lists.
+      mode = TRAIN_MODE;
+      crossval = true;
+      s_mode = "train";
+    } else if (s_mode == "sweep") {
+      // The sweep trains on the files of 'train' mode, including the
+      // heldout files it evaluates the configurations on.
+      mode = TRAIN_MODE;
+      sweep = true;
+      s_mode = "train";
+    } else if (s_mode == "prune") {
+      // Pruning evaluates the model on the heldout data, whose annotated
+      // files are found the same way as in 'train' mode.
+      mode = EVALUATE_MODE;
+      prune = true;
+      s_mode = "train";
     } else {
       END_WITH_ERROR("trtok", "Mode " << s_mode << " not recognized. Supported "
-          "modes include prepare, train, tokenize and evaluate. See trtok "
-          "--help for more.");
+          "modes include prepare, train, tokenize, evaluate, crossval, "
+          "sweep and prune. See trtok --help for more.");
     }
 
     maxent::verbose = o_verbose ? 1 : 0;
 
+    if (n_jobs < 1) {
+      END_WITH_ERROR("trtok", "The number of jobs must be at least 1.");
+    }
+    if (n_prefetch_files < 0) {
+      END_WITH_ERROR("trtok", "The number of files to prefetch must not be "
+          "negative.");
+    }
+    if (o_jsonl && (mode != PREPARE_MODE) && (mode != TOKENIZE_MODE)) {
+      END_WITH_ERROR("trtok", "--jsonl can only be used in prepare and "
+          "tokenize modes.");
+    }
+    if (o_jsonl && (s_encoding != "UTF-8")) {
+      // JSON text is always encoded in UTF-8.
+      SIGNAL_WARNING("trtok", "The JSONL documents are read and written "
+          "in UTF-8, the encoding " << s_encoding << " is ignored.");
+      s_encoding = "UTF-8";
+    }
+    if (crossval && (n_folds < 2)) {
+      END_WITH_ERROR("trtok", "The number of folds must be at least 2.");
+    }
+
+    parameter_grid_t parameter_grid;
+    try {
+      for (vector<string>::const_iterator axis = sv_grid.begin();
+           axis != sv_grid.end(); axis++) {
+        add_grid_axis(*axis, parameter_grid);
+      }
+    } catch (invalid_argument const &exc) {
+      END_WITH_ERROR("trtok", exc.what());
+    }
+    if (sweep && parameter_grid.empty()) {
+      END_WITH_ERROR("trtok", "sweep mode needs the training parameters to "
+          "sweep over. Give them using --grid.");
+    }
+
     // We need the path to the TrTok file structure which is stored in the
     // environment variable TRTOK_PATH
     char *e_trtok_path = getenv("TRTOK_PATH");
@@ -607,7 +769,20 @@ int main(int argc, char const **argv) {
     // If no files or file lists were given explicitly, we check for
     // a .fl file with a default file list. In the case of train mode,
     // we also look for training files in the scheme folders.
-    if ((input_files.size() == 0)) {
+    if ((input_files.size() == 0) && prune) {
+      for (vector<string>::const_iterator
+           file_list = sv_heldout_file_lists.begin();
+           file_list != sv_heldout_file_lists.end(); file_list++) {
+        if (!fs::exists(*file_list) && (*file_list != "-")) {
+          SIGNAL_WARNING(*file_list, "File not found.");
+        } else {
+          include_listed_files(*file_list, input_files);
+        }
+      }
+      if ((input_files.size() == 0) && !default_heldout_file_list.empty()) {
+        include_listed_files(default_heldout_file_list, input_files);
+      }
+    } else if ((input_files.size() == 0)) {
       if (!default_file_list.empty()) {
         include_listed_files(default_file_list, input_files);
       }
@@ -622,6 +797,11 @@ int main(int argc, char const **argv) {
       }
     }
 
+    if ((input_files.size() == 0) && prune) {
+      END_WITH_ERROR("trtok", "prune mode needs heldout files to evaluate "
+          "the pruned model on. Give them using -h or heldout.fl.");
+    }
+
     // If no input files or file lists were given or set up as default
     // by the user, then we process standard input.
     if (input_files.size() == 0) {
@@ -634,8 +814,8 @@ int main(int argc, char const **argv) {
     int num_nonheldout_files = input_files.size();
 
     // If we are in 'train' mode, we also add the heldout files after
-    // the regular input files.
-    if (mode == TRAIN_MODE) {
+    // the regular input files. Cross-validation has its own heldout data.
+    if ((mode == TRAIN_MODE) && !crossval) {
 
       // We first check for any explicit heldout file lists...
       for (vector<string>::const_iterator file_list = sv_heldout_file_lists.begin();
@@ -656,6 +836,11 @@ int main(int argc, char const **argv) {
         include_listed_files(default_heldout_file_list, input_files);
       }
     }
+
+    if (sweep && ((int)input_files.size() == num_nonheldout_files)) {
+      END_WITH_ERROR("trtok", "sweep mode needs heldout files to evaluate "
+          "the configurations on. Give them using -h or heldout.fl.");
+    }
     
 
     // PARSING OTHER TIDBITS
@@ -663,6 +848,26 @@ int main(int argc, char const **argv) {
     // This is the file in which the trained maxent model for this tokenization
     // scheme is stored.
     fs::path model_path = build_path / "maxent.model";
+    // The compact version of the model, see CompactModel.
+    fs::path compact_model_path = build_path / "maxent.cmodel";
+    // The files the model was trained on, see training_manifest_t.
+    fs::path manifest_path = build_path / "training.manifest";
+    // The counts of the model's predicates in the training data.
+    fs::path counts_path = build_path / "maxent.counts";
+    // The backups of the models made when pruning them.
+    fs::path unpruned_model_path = build_path / "maxent.model.unpruned";
+    fs::path unpruned_compact_model_path =
+      build_path / "maxent.cmodel.unpruned";
+
+    if (o_warm_start && ((mode != TRAIN_MODE) || crossval || sweep)) {
+      SIGNAL_WARNING("trtok", "--warm-start only applies to 'train' mode.");
+      o_warm_start = false;
+    }
+    if (o_warm_start && !fs::exists(model_path)) {
+      SIGNAL_WARNING(model_path, "No model to warm-start from, training "
+          "from scratch.");
+      o_warm_start = false;
+    }
     if (((mode == TOKENIZE_MODE) || (mode == EVALUATE_MODE))
         && !fs::exists(model_path)) {
       END_WITH_ERROR(model_path, "Maxent model not found. Please train "
@@ -670,24 +875,36 @@ int main(int argc, char const **argv) {
     }
 
     // If a questions/answers file was requested, we create a stream to one.
-    // If we are in the EVALUATE_MODE, we always want to output questions
-    // and answers.
-    ostream *qa_stream_p = NULL;
-    if (!vm["questions"].defaulted() || (mode == EVALUATE_MODE)) {
+    // The questions are written by a QAWriter in the background, so that
+    // the Classifier does not have to wait for the output.
+    ostream *qa_file_stream_p = NULL;
+    QAWriter *qa_stream_p = NULL;
+    if (!vm["questions"].defaulted()) {
       if (s_qa_file == "-") {
-        qa_stream_p = &cout;
+        qa_file_stream_p = &cout;
       } else {
-        qa_stream_p = new ofstream(s_qa_file.c_str());
+        qa_file_stream_p = new ofstream(s_qa_file.c_str(),
+                                        ios::out | ios::binary);
+      }
+      qa_stream_p = new QAWriter(qa_file_stream_p, QA_BLOCK_SIZE);
+      if (o_binary_questions) {
+        write_binary_qa_header(*qa_stream_p);
       }
     }
 
 
     // PARSING THE TRAINING PARAMETERS
 
+    // The parameters are read in all the modes, since some of them (such as
+    // feature_buckets) affect how the model is used as well.
     training_parameters_t training_parameters;
     bool save_model_as_binary = false;
+    bool spool_training_events = false;
+    size_t n_feature_buckets = 0;
+    unsigned compact_model_bits = 0;
+    size_t warm_start_iterations = 5;
 
-    if ((mode == TRAIN_MODE) && !maxentparams_file.empty()) {
+    if (!maxentparams_file.empty()) {
 
       fs::ifstream maxentparams_stream(maxentparams_file);
 
@@ -705,6 +922,16 @@ int main(int argc, char const **argv) {
               po::value<double>(&training_parameters.convergence_tolerance))
           ("save_as_binary",
               po::value<bool>(&save_model_as_binary))
+          ("n_threads",
+              po::value<size_t>(&training_parameters.n_threads))
+          ("spool_events",
+              po::value<bool>(&spool_training_events))
+          ("feature_buckets",
+              po::value<size_t>(&n_feature_buckets))
+          ("compact_model_bits",
+              po::value<unsigned>(&compact_model_bits))
+          ("warm_start_iterations",
+              po::value<size_t>(&warm_start_iterations))
           ;
 
       po::variables_map maxent_vm;
@@ -719,11 +946,43 @@ int main(int argc, char const **argv) {
       }
 
       maxentparams_stream.close();
+
+      if ((training_parameters.method_name != "lbfgs")
+          && (training_parameters.method_name != "gis")) {
+        END_WITH_ERROR(maxentparams_file, "Unknown method_name \""
+            << training_parameters.method_name << "\", use either lbfgs or "
+            "gis.");
+      }
+
+      if ((compact_model_bits != 0) && (compact_model_bits != 8)
+          && (compact_model_bits != 16)) {
+        END_WITH_ERROR(maxentparams_file, "compact_model_bits must be 0, 8 "
+            "or 16.");
+      }
+    }
+
+    // If there is a compact model, it is used instead of the full one.
+    // We check it right away so that it can be loaded safely later.
+    bool use_compact_model = false;
+    if ((mode != TRAIN_MODE) && (compact_model_bits != 0)
+        && fs::exists(compact_model_path)) {
+      try {
+        CompactModel compact_model;
+        compact_model.load(compact_model_path.native());
+      } catch (runtime_error const &exc) {
+        cerr << exc.what() << endl;
+        return 1;
+      }
+      use_compact_model = true;
     }
 
 
     // CONSTRUCTING THE PIPELINE
 
+    // The profile has to outlive the pipeline which runs its filters.
+    Profile profile;
+    Profile *profile_p = vm.count("profile") ? &profile : NULL;
+
     tbb::pipeline pipeline;
 
     tbb::concurrent_bounded_queue<cutout_t> *cutout_queue_p = NULL;
@@ -732,11 +991,7 @@ int main(int argc, char const **argv) {
     pipes::pipe *input_pipe_p = NULL;
     pipes::opipestream *input_pipe_to_p = NULL;
     pipes::ipipestream *input_pipe_from_p = NULL;
-
-    TextCleaner *annot_cleaner_p = NULL;
-    pipes::pipe *annot_pipe_p = NULL;
-    pipes::opipestream *annot_pipe_to_p = NULL;
-    pipes::ipipestream *annot_pipe_from_p = NULL;
+    DocumentStream *input_documents_p = NULL;
 
     RoughTokenizer *rough_tokenizer_p = NULL;
     FeatureExtractor *feature_extractor_p = NULL;
@@ -748,52 +1003,24 @@ int main(int argc, char const **argv) {
     pipes::pipe *output_pipe_p = NULL;
     pipes::opipestream *output_pipe_to_p = NULL;
     pipes::ipipestream *output_pipe_from_p = NULL;
+    DocumentStream *output_documents_p = NULL;
 
-    if ((mode == TRAIN_MODE) || (mode == EVALUATE_MODE)) {
-      
-      input_pipe_p = new pipes::pipe(pipes::pipe::limited_capacity);
-      input_pipe_to_p = new pipes::opipestream(*input_pipe_p);
-      input_pipe_from_p = new pipes::ipipestream(*input_pipe_p);
-
-      input_cleaner_p = new TextCleaner(input_pipe_to_p, s_encoding,
-                                        o_remove_xml, o_remove_xml_perm,
-                                        o_expand_entities,
-                                        o_expand_entities_perm);
-
-      rough_tokenizer_p = new RoughTokenizer(rough_lexer_wrapper);
-      rough_tokenizer_p->setup(input_pipe_from_p, "UTF-8");
-      pipeline.add_filter(*rough_tokenizer_p);
-
-      annot_pipe_p = new pipes::pipe(pipes::pipe::limited_capacity);
-      annot_pipe_to_p = new pipes::opipestream(*annot_pipe_p);
-      annot_pipe_from_p = new pipes::ipipestream(*annot_pipe_p);
-
-      annot_cleaner_p = new TextCleaner(annot_pipe_to_p, s_encoding,
-                                        o_remove_xml, o_remove_xml_perm,
-                                        o_expand_entities,
-                                        o_expand_entities_perm);
+    // The threads running the TextCleaner and the Encoder. The pipeline
+    // runs once over all the files, whose documents are separated by
+    // END_OF_DOCUMENT in the pipes.
+    WorkerThread *input_worker_p = NULL;
+    WorkerThread *output_worker_p = NULL;
 
-      feature_extractor_p = new FeatureExtractor(n_basic_properties,
-                                                 regex_properties,
-                                                 word_to_list_props);
-      pipeline.add_filter(*feature_extractor_p);
-
-      classifier_p = new Classifier(mode, prop_id_to_name, precontext,
-                                    postcontext, features_mask,
-                                    combined_features, qa_stream_p,
-                                    annot_pipe_from_p);
-      if (mode == EVALUATE_MODE) {
-        classifier_p->load_model(model_path.native());
-      }
-      pipeline.add_filter(*classifier_p);
-
-    } else if ((mode == PREPARE_MODE) || (mode == TOKENIZE_MODE)) {
+    // The 'train' and 'evaluate' modes use AlignmentPipelines, which are
+    // constructed when running them.
+    if ((mode == PREPARE_MODE) || (mode == TOKENIZE_MODE)) {
 
       cutout_queue_p = new tbb::concurrent_bounded_queue<cutout_t>;
 
       input_pipe_p = new pipes::pipe(pipes::pipe::limited_capacity);
       input_pipe_to_p = new pipes::opipestream(*input_pipe_p);
       input_pipe_from_p = new pipes::ipipestream(*input_pipe_p);
+      input_documents_p = new DocumentStream(*input_pipe_from_p);
 
       input_cleaner_p = new TextCleaner(input_pipe_to_p, s_encoding,
                                         o_remove_xml, o_remove_xml_perm,
@@ -802,8 +1029,9 @@ int main(int argc, char const **argv) {
                                         cutout_queue_p);
 
       rough_tokenizer_p = new RoughTokenizer(rough_lexer_wrapper);
-      rough_tokenizer_p->setup(input_pipe_from_p, "UTF-8");
-      pipeline.add_filter(*rough_tokenizer_p);
+      rough_tokenizer_p->setup(input_documents_p, "UTF-8");
+      pipeline.add_filter(profiled(profile_p, *rough_tokenizer_p,
+                                   ROUGH_TOKENIZER_STAGE));
 
       // If we only want to cut up raw text so it is easier to annotate
       // and we are not interested in any features, we can cut out a lot
@@ -811,49 +1039,128 @@ int main(int argc, char const **argv) {
       // SimplePreparer
       if ((mode == PREPARE_MODE) && (qa_stream_p == NULL)) {
         simple_preparer_p = new SimplePreparer();
-        pipeline.add_filter(*simple_preparer_p);
+        pipeline.add_filter(profiled(profile_p, *simple_preparer_p,
+                                     CLASSIFIER_STAGE));
       } else {
         feature_extractor_p = new FeatureExtractor(n_basic_properties,
                                                    regex_properties,
                                                    word_to_list_props);
-        pipeline.add_filter(*feature_extractor_p);
+        pipeline.add_filter(profiled(profile_p, *feature_extractor_p,
+                                     FEATURE_EXTRACTOR_STAGE));
 
         classifier_p = new Classifier(mode, prop_id_to_name, precontext,
                                       postcontext, features_mask,
                                       combined_features, qa_stream_p);
-        classifier_p->load_model(model_path.native());
-        pipeline.add_filter(*classifier_p);
+        if (use_compact_model) {
+          classifier_p->load_compact_model(compact_model_path.native());
+        } else {
+          classifier_p->load_model(model_path.native());
+        }
+        classifier_p->hash_features(n_feature_buckets);
+        classifier_p->binary_questions(o_binary_questions);
+        pipeline.add_filter(profiled(profile_p, *classifier_p,
+                                     CLASSIFIER_STAGE));
       } //if ((mode == PREPARE_MODE) && (qa_stream_p == NULL))
 
       output_pipe_p = new pipes::pipe(pipes::pipe::limited_capacity);
       output_pipe_to_p = new pipes::opipestream(*output_pipe_p);
       output_pipe_from_p = new pipes::ipipestream(*output_pipe_p);
+      output_documents_p = new DocumentStream(*output_pipe_from_p);
       
       output_formatter_p = new OutputFormatter(output_pipe_to_p, o_detokenize,
                                                o_honour_single_newline,
                                                o_honour_more_newlines,
                                                o_never_add_newline,
                                                cutout_queue_p);
-      pipeline.add_filter(*output_formatter_p);
+      pipeline.add_filter(profiled(profile_p, *output_formatter_p,
+                                   OUTPUT_FORMATTER_STAGE));
 
-      encoder_p = new Encoder(output_pipe_from_p, s_encoding);
+      encoder_p = new Encoder(output_documents_p, s_encoding);
+
+      input_worker_p = new WorkerThread();
+      output_worker_p = new WorkerThread();
 
     } // if ((mode == PREPARE_MODE) || (mode == TOKENIZE_MODE))
     
     
     // RUNNING THE PIPELINE
 
-    for (vector<string>::const_iterator input_file = input_files.begin();
-         input_file != input_files.end(); input_file++) {
-      
-      clog << "trtok: Processing file " << *input_file << endl;
+    // In 'train' and 'evaluate' modes, the pairs of files are only collected
+    // here and processed afterwards.
+    AlignmentJobs alignment_jobs;
 
-      // If we have processed all the regular input files and there are more
-      // files to process, it must be the heldout data and so we notify the
-      // Classifier.
-      if (input_file - input_files.begin() == num_nonheldout_files) {
-        classifier_p->switch_to_heldout_data();
+    // When training, we fingerprint the training files so that a later
+    // warm-started training can tell which of them have changed.
+    training_manifest_t manifest;
+    if (o_warm_start) {
+      read_training_manifest(manifest_path.native(), manifest);
+    }
+    training_manifest_t trained_files;
+
+    // The events extracted from every training file are cached in the build
+    // directory. They are stored under a fingerprint of the file, of its
+    // annotated version and of everything in the scheme and the options
+    // which affects the events. The events cannot be cached when the
+    // questions are requested, since these are produced while aligning.
+    fs::path events_cache_path = build_path / "events";
+    bool cache_events = (mode == TRAIN_MODE) && (qa_stream_p == NULL);
+    uint64_t events_fingerprint = 0;
+    set<string> cached_event_files;
+    // The cached events of the unchanged files which were skipped, whose
+    // predicate counts are added to those of the files read again.
+    vector<string> skipped_events_files;
+    bool skipped_events_cached = true;
+    if (cache_events) {
+      fs::create_directories(events_cache_path);
+      vector<string> scheme_files;
+      vector<fs::path> const *scheme_file_lists[] = {
+        &split_files, &join_files, &break_files, &rep_files, &listp_files
+      };
+      for (int l = 0; l != 5; l++) {
+        for (vector<fs::path>::const_iterator
+             file = scheme_file_lists[l]->begin();
+             file != scheme_file_lists[l]->end(); file++) {
+          scheme_files.push_back(file->native());
+        }
       }
+      scheme_files.push_back(features_file.native());
+      ostringstream settings;
+      settings << "events 1 " << s_encoding << ' ' << o_remove_xml
+               << o_remove_xml_perm << o_expand_entities
+               << o_expand_entities_perm << ' ' << n_feature_buckets;
+      events_fingerprint = scheme_fingerprint(scheme_files, settings.str());
+    }
+
+    // In 'prepare' and 'tokenize' modes, the input files are read ahead
+    // while the files before them are being tokenized. 'train' and
+    // 'evaluate' modes do so when running the AlignmentPipelines.
+    FilePrefetcher *prefetcher_p = NULL;
+    if (((mode == PREPARE_MODE) || (mode == TOKENIZE_MODE))
+        && (n_prefetch_files > 0)) {
+      prefetcher_p = new FilePrefetcher(n_prefetch_files,
+                                        prefetch_megabytes << 20);
+      for (vector<string>::const_iterator input_file = input_files.begin();
+           input_file != input_files.end(); input_file++) {
+        string other_file(*input_file);
+        if ((*input_file != "-")
+            && fnre_regexp.Replace(fnre_replace, &other_file)) {
+          prefetcher_p->add(*input_file);
+        }
+      }
+      prefetcher_p->start();
+    }
+
+    DocumentFiles *document_files_p = NULL;
+    if ((mode == PREPARE_MODE) || (mode == TOKENIZE_MODE)) {
+      document_files_p = new DocumentFiles(*input_cleaner_p, *encoder_p,
+                                           *output_documents_p, classifier_p,
+                                           prefetcher_p, profile_p, o_jsonl);
+      if (classifier_p != NULL)
+        classifier_p->set_document_listener(document_files_p);
+    }
+
+    for (vector<string>::const_iterator input_file = input_files.begin();
+         input_file != input_files.end(); input_file++) {
 
       fs::path input_file_path(*input_file);
       string other_file(*input_file);
@@ -884,7 +1191,7 @@ int main(int argc, char const **argv) {
               "the standard input alone.");
         }
 
-        // Check for the annotated file,...
+        // Check for the annotated file.
         fs::path annotated_file_path(other_file);
         if (!fs::exists(annotated_file_path)) {
           cerr << other_file << ": Warning: Annotated file does not exist, "
@@ -892,118 +1199,482 @@ int main(int argc, char const **argv) {
           continue;
         }
 
-        // open the files,...
-        fs::ifstream input_stream(input_file_path);
-        fs::ifstream annotated_stream(annotated_file_path);
-
-        // restore the pipes,...
-        /* The sender closes his pipestream to signal an EOF to the receiver.
-           These pipestreams need to reopened for subsequent iterations.
-           All pipestreams must however disconnect from the pipe before
-           we can use it again. */
-        if (!input_pipe_to_p->is_open()) {
-          input_pipe_from_p->close();
-          input_pipe_to_p->open(*input_pipe_p);
-          input_pipe_from_p->open(*input_pipe_p);
-        }
-        if (!annot_pipe_to_p->is_open()) {
-          annot_pipe_from_p->close();
-          annot_pipe_to_p->open(*annot_pipe_p);
-          annot_pipe_from_p->open(*annot_pipe_p);
-        }
-
-        // clean out and setup the pipeline,...
-        input_cleaner_p->setup(&input_stream);
-        rough_tokenizer_p->reset();
-        annot_cleaner_p->setup(&annotated_stream);
-        classifier_p->setup(input_file_path.native(),
-                            annotated_file_path.native());
-
-        // run it...
-        boost::thread input_thread(&TextCleaner::do_work,
-                                   boost::ref(*input_cleaner_p));
-        boost::thread annot_thread(&TextCleaner::do_work,
-                                   boost::ref(*annot_cleaner_p));
-        pipeline.run(WORK_UNIT_COUNT);
-        input_thread.join();
-        annot_thread.join();
-      
-        // and close the files.
-        input_stream.close();
-        annotated_stream.close();
+        // If we have gone through all the regular input files and there are
+        // more files, they must be the heldout data.
+        bool heldout =
+            (input_file - input_files.begin() >= num_nonheldout_files);
+
+        uint64_t fingerprint = 0;
+        if (mode == TRAIN_MODE) {
+          fingerprint = file_fingerprint(other_file,
+                                         file_fingerprint(*input_file));
+        }
+
+        string events_file;
+        bool reuse_events = false;
+        if (cache_events) {
+          uint64_t key = feature_hash((char const*)&fingerprint,
+                                      sizeof(fingerprint),
+                                      events_fingerprint);
+          ostringstream events_filename;
+          events_filename << hex << setw(16) << setfill('0') << key
+                          << ".events";
+          events_file = (events_cache_path / events_filename.str()).native();
+          cached_event_files.insert(events_filename.str());
+          reuse_events = !o_rebuild_events && fs::exists(events_file);
+        }
+
+        if ((mode == TRAIN_MODE) && !heldout && !crossval) {
+          string manifest_key = fs::absolute(input_file_path).native();
+          trained_files[manifest_key] = fingerprint;
+
+          training_manifest_t::const_iterator
+            entry = manifest.find(manifest_key);
+          if ((entry != manifest.end()) && (entry->second == fingerprint)) {
+            clog << "trtok: Skipping unchanged file " << *input_file << endl;
+            skipped_events_files.push_back(events_file);
+            skipped_events_cached = skipped_events_cached && reuse_events;
+            continue;
+          }
+        }
+
+        alignment_jobs.add(*input_file, other_file, heldout,
+                           events_file, reuse_events);
 
       } else if ((mode == PREPARE_MODE) || (mode == TOKENIZE_MODE)) {
 
-        // Open the files,...
+        // The files are read and written by the worker threads while the
+        // pipeline runs, only their directories are created here.
         fs::path output_file_path(other_file);
         if (!fs::is_directory(output_file_path.parent_path())) {
           fs::create_directories(output_file_path.parent_path());
         }
 
-        istream *input_stream_p = (*input_file == "-") ? &cin
-                                       : new fs::ifstream(input_file_path);
-        ostream *output_stream_p = (*input_file == "-") ? &cout
-                                        : new fs::ofstream(output_file_path);
+        input_worker_p->post(boost::bind(&DocumentFiles::read_file,
+                                         document_files_p, *input_file));
+        output_worker_p->post(boost::bind(&DocumentFiles::write_file,
+                                          document_files_p, *input_file,
+                                          other_file));
+      }
+    }
+
+    if (document_files_p != NULL) {
+      // The pipeline ends once the TextCleaner has cleaned all the files.
+      input_worker_p->post(boost::bind(&TextCleaner::close,
+                                       input_cleaner_p));
+      pipeline.run(WORK_UNIT_COUNT);
+      input_worker_p->wait();
+      output_worker_p->wait();
+
+      if (profile_p != NULL) {
+        profile_p->add_wait(TEXT_CLEANER_STAGE,
+                            input_pipe_p->put_wait_seconds());
+        profile_p->add_wait(ROUGH_TOKENIZER_STAGE,
+                            input_pipe_p->get_wait_seconds());
+        profile_p->add_wait(OUTPUT_FORMATTER_STAGE,
+                            output_pipe_p->put_wait_seconds()
+                            + output_formatter_p->cutout_wait_seconds());
+        profile_p->add_wait(ENCODER_STAGE,
+                            output_pipe_p->get_wait_seconds());
+        if (classifier_p != NULL)
+          profile_p->add_counts(CLASSIFIER_STAGE,
+                                classifier_p->n_decisions(), 0, 0);
+      }
+      delete document_files_p;
+    }
+
+    if (input_worker_p != NULL) {
+      delete input_worker_p;
+      delete output_worker_p;
+    }
+    if (prefetcher_p != NULL) {
+      delete prefetcher_p;
+    }
+
+    if ((mode == TRAIN_MODE) || (mode == EVALUATE_MODE)) {
+
+      MaxentTrainer trainer;
+      if ((mode == TRAIN_MODE) && spool_training_events) {
+        trainer.spool_to((build_path / "events.spool").native(),
+                         (build_path / "heldout.spool").native(),
+                         EVENT_BLOCK_SIZE);
+      }
+
+      // In 'prune' mode, the model is pruned first and then both the
+      // original model (run 0) and the pruned model (run 1) are evaluated
+      // on the heldout data.
+      int n_runs = prune ? 2 : 1;
+      size_t n_model_preds[2] = { 0, 0 };
+      size_t n_model_params[2] = { 0, 0 };
+      double load_seconds[2] = { 0.0, 0.0 };
+      double run_seconds[2] = { 0.0, 0.0 };
+      size_t run_tokens[2] = { 0, 0 };
+      evaluation_stats_t run_stats[2];
+      // The number of files whose cached events were used.
+      size_t n_reused_events = 0;
+      // The evaluation of every file, for the report in 'evaluate' mode.
+      vector<string> evaluated_files;
+      vector<evaluation_stats_t> file_stats;
+
+      if (prune) {
+        // The pruned models are written to temporary files first, so that
+        // a failure leaves the models as they were.
+        fs::path pruned_model_path = build_path / "pruned.model";
+        fs::path pruned_compact_model_path = build_path / "pruned.cmodel";
+        try {
+          // A model pruned before is pruned again from its backup, so that
+          // the thresholds are not applied on top of the earlier ones.
+          back_up_unpruned(model_path, unpruned_model_path);
+          if ((compact_model_bits != 0) && fs::exists(compact_model_path))
+            back_up_unpruned(compact_model_path,
+                             unpruned_compact_model_path);
+
+          // The model is converted to the text format by the toolkit, as it
+          // might have been saved in the binary format.
+          maxent::MaxentModel original_model;
+          original_model.load(unpruned_model_path.native());
+          original_model.save(pruned_model_path.native(), false);
+
+          MaxentTrainer pruner;
+          pruner.load(pruned_model_path.native());
+          if ((min_count > 0) && fs::exists(counts_path)) {
+            pruner.load_counts(counts_path.native());
+          } else if (min_count > 0) {
+            SIGNAL_WARNING(counts_path, "The predicate counts are missing, "
+                "pruning by weight only. Retrain the model to record them.");
+            min_count = 0;
+          }
+          n_model_preds[0] = pruner.n_active_predicates();
+          n_model_params[0] = pruner.n_parameters();
+          pruner.prune(min_weight, min_count);
+          n_model_preds[1] = pruner.n_active_predicates();
+          n_model_params[1] = pruner.n_parameters();
+
+          pruner.save(pruned_model_path.native());
+          if (save_model_as_binary) {
+            maxent::MaxentModel model;
+            model.load(pruned_model_path.native());
+            model.save(pruned_model_path.native(), true);
+          }
+          if (compact_model_bits != 0) {
+            pruner.save_compact(pruned_compact_model_path.native(),
+                                compact_model_bits);
+            replace_with_pruned(pruned_compact_model_path,
+                                compact_model_path,
+                                unpruned_compact_model_path);
+          }
+          replace_with_pruned(pruned_model_path, model_path,
+                              unpruned_model_path);
+        } catch (runtime_error const &exc) {
+          cerr << exc.what() << endl;
+          boost::system::error_code error;
+          fs::remove(pruned_model_path, error);
+          fs::remove(pruned_compact_model_path, error);
+          return 1;
+        }
+      }
+
+      for (int run = 0; run != n_runs; run++) {
+        fs::path run_model_path = (prune && (run == 0)) ?
+                                    unpruned_model_path : model_path;
+        fs::path run_compact_model_path = (prune && (run == 0)) ?
+            unpruned_compact_model_path : compact_model_path;
+        if (run > 0) {
+          alignment_jobs.restart();
+        }
+
+        if (prune) {
+          boost::posix_time::ptime load_start = current_time();
+          if (use_compact_model) {
+            CompactModel model;
+            model.load(run_compact_model_path.native());
+          } else {
+            maxent::MaxentModel model;
+            model.load(run_model_path.native());
+          }
+          load_seconds[run] = seconds_since(load_start);
+        }
+        boost::posix_time::ptime run_start = current_time();
+
+        // Every pipeline gets its own rough lexer. If there is more than one
+        // pipeline, the questions and answers are collected per file so that
+        // they can be output in the order of the files.
+        // The pipelines take the jobs in order, so the files are read
+        // ahead in the same order, except those whose events are cached.
+        FilePrefetcher *run_prefetcher_p = NULL;
+        if (n_prefetch_files > 0) {
+          run_prefetcher_p = new FilePrefetcher(n_prefetch_files,
+                                                prefetch_megabytes << 20);
+          for (size_t j = 0; j != alignment_jobs.size(); j++) {
+            alignment_job_t const &job = alignment_jobs.job(j);
+            if (!job.reuse_events) {
+              run_prefetcher_p->add(job.input_file);
+              run_prefetcher_p->add(job.annotated_file);
+            }
+          }
+          run_prefetcher_p->start();
+        }
+
+        // The pipelines may only get a few files ahead of the merging of
+        // the results, so that the results waiting for it do not pile up
+        // in memory.
+        alignment_jobs.limit_pending(MAX_PENDING_FILES_PER_JOB * n_jobs);
+        vector<AlignmentPipeline*> alignment_pipelines;
+        boost::thread_group workers;
+        for (int j = 0; j < n_jobs; j++) {
+          AlignmentPipeline *alignment_pipeline_p = new AlignmentPipeline(mode,
+              ((j == 0) && (run == 0)) ? rough_lexer_wrapper
+                                       : factory_func_p(),
+              s_encoding, o_remove_xml, o_remove_xml_perm,
+              o_expand_entities, o_expand_entities_perm,
+              n_basic_properties, regex_properties, word_to_list_props,
+              prop_id_to_name, precontext, postcontext, features_mask,
+              combined_features, qa_stream_p, n_jobs > 1, profile_p);
+          if ((mode == EVALUATE_MODE) && use_compact_model) {
+            alignment_pipeline_p->load_compact_model(
+                run_compact_model_path.native());
+          } else if (mode == EVALUATE_MODE) {
+            alignment_pipeline_p->load_model(run_model_path.native());
+          }
+          alignment_pipeline_p->hash_features(n_feature_buckets);
+          alignment_pipeline_p->binary_questions(o_binary_questions);
+          alignment_pipeline_p->prefetch_from(run_prefetcher_p);
+          if ((mode == TRAIN_MODE) && spool_training_events) {
+            ostringstream spool_prefix;
+            spool_prefix << "events." << j;
+            alignment_pipeline_p->spool_events_to(
+                (build_path / spool_prefix.str()).native(),
+                EVENT_BLOCK_SIZE);
+          }
+          alignment_pipelines.push_back(alignment_pipeline_p);
+          workers.create_thread(boost::bind(&AlignmentPipeline::run_jobs,
+                                            alignment_pipeline_p,
+                                            boost::ref(alignment_jobs)));
+        }
+
+        // The results are merged in the order of the input files, which
+        // makes them independent of the number of jobs.
+        for (size_t j = 0; j != alignment_jobs.size(); j++) {
+          alignment_job_t &job = alignment_jobs.wait_for(j);
+          if (job.reuse_events) {
+            n_reused_events++;
+          }
+          if (job.events_p != NULL) {
+            trainer.add_events(*job.events_p, job.heldout);
+            delete job.events_p;
+            job.events_p = NULL;
+          }
+          run_stats[run] += job.stats;
+          run_tokens[run] += job.n_tokens;
+          if ((mode == EVALUATE_MODE) && !prune) {
+            evaluated_files.push_back(job.input_file);
+            file_stats.push_back(job.stats);
+          }
+          if (qa_stream_p != NULL) {
+            *qa_stream_p << job.questions;
+            string().swap(job.questions);
+          }
+          alignment_jobs.merged();
+        }
+
+        workers.join_all();
+        for (size_t j = 0; j != alignment_pipelines.size(); j++) {
+          delete alignment_pipelines[j];
+        }
+        if (run_prefetcher_p != NULL) {
+          delete run_prefetcher_p;
+        }
+        run_seconds[run] = seconds_since(run_start);
+      }
 
-        // restore the pipes,...
-        if (!input_pipe_to_p->is_open()) {
-          input_pipe_from_p->close();
-          input_pipe_to_p->open(*input_pipe_p);
-          input_pipe_from_p->open(*input_pipe_p);
+      // Only the events of the files trained on now are kept in the cache,
+      // the others were extracted from files or using a scheme which have
+      // changed since.
+      if (cache_events) {
+        if (n_reused_events > 0) {
+          clog << "trtok: Reused the cached events of " << n_reused_events
+               << " of " << alignment_jobs.size() << " files." << endl;
         }
-        if (!output_pipe_to_p->is_open()) {
-          output_pipe_from_p->close();
-          output_pipe_to_p->open(*output_pipe_p);
-          output_pipe_from_p->open(*output_pipe_p);
+        vector<fs::path> stale_files;
+        for (fs::directory_iterator file(events_cache_path);
+             file != fs::directory_iterator(); file++) {
+          if (cached_event_files.count(file->path().filename().string())
+              == 0) {
+            stale_files.push_back(file->path());
+          }
         }
+        for (size_t f = 0; f != stale_files.size(); f++) {
+          boost::system::error_code error;
+          fs::remove(stale_files[f], error);
+        }
+      }
 
-        // setup the pipeline,...
-        input_cleaner_p->setup(input_stream_p);
-        rough_tokenizer_p->reset();
-        if (simple_preparer_p != NULL) {
-          simple_preparer_p->reset();
+      // The evaluation report goes to the standard output, unless the
+      // questions are being written there.
+      if ((mode == EVALUATE_MODE) && !prune) {
+        print_evaluation_report(evaluated_files, file_stats,
+                                (qa_file_stream_p == &cout) ? clog : cout);
+      }
+
+      if (prune) {
+        fs::path const *model_paths[2];
+        if (use_compact_model) {
+          model_paths[0] = &unpruned_compact_model_path;
+          model_paths[1] = &compact_model_path;
         } else {
-          feature_extractor_p->reset();
-          classifier_p->setup(input_file_path.native());
-        }
-        output_formatter_p->reset();
-        encoder_p->setup(output_stream_p);
-
-        // run it...
-        boost::thread input_thread(&TextCleaner::do_work,
-                                   boost::ref(*input_cleaner_p));
-        boost::thread output_thread(&Encoder::do_work,
-                                    boost::ref(*encoder_p));
-        pipeline.run(WORK_UNIT_COUNT);
-        input_thread.join();
-        output_thread.join();
-        
-        output_stream_p->flush();
-        // and close the files.
-        if (*input_file != "-") {
-          fs::ifstream *input_file_stream_p = (fs::ifstream*)input_stream_p;
-          fs::ofstream *output_file_stream_p = (fs::ofstream*)output_stream_p;
-          input_file_stream_p->close();
-          output_file_stream_p->close();
-          delete input_file_stream_p;
-          delete output_file_stream_p;
+          model_paths[0] = &unpruned_model_path;
+          model_paths[1] = &model_path;
         }
+        char const *run_names[2] = { "original", "pruned" };
+
+        cout << setw(10) << "model" << setw(12) << "predicates"
+             << setw(12) << "parameters" << setw(14) << "size (bytes)"
+             << setw(10) << "load (s)" << setw(12) << "tokens/s"
+             << setw(10) << "accuracy" << endl;
+        cout << fixed;
+        for (int run = 0; run != 2; run++) {
+          cout << setw(10) << run_names[run]
+               << setw(12) << n_model_preds[run]
+               << setw(12) << n_model_params[run]
+               << setw(14) << fs::file_size(*model_paths[run])
+               << setw(10) << setprecision(4) << load_seconds[run]
+               << setw(12) << setprecision(0)
+               << run_tokens[run] / max(run_seconds[run], 1e-6)
+               << setw(10) << setprecision(4)
+               << run_stats[run].metric(EFFECTIVE_ACCURACY) << endl;
+        }
+        cout << "Accuracy change: " << showpos
+             << run_stats[1].metric(EFFECTIVE_ACCURACY)
+                - run_stats[0].metric(EFFECTIVE_ACCURACY)
+             << noshowpos << endl;
+        cout << "The original model was saved as "
+             << unpruned_model_path.filename().native() << "." << endl;
       }
-    }
 
-    // If our mission was to train a maxent model, then by now the Classifier
-    // has accumulated all the required questions and answers, so we can hand
-    // it over to the Maxent toolkit to do the rest.
-    if (mode == TRAIN_MODE) {
-      classifier_p->train_model(training_parameters, model_path.native(),
-                                save_model_as_binary);
+      // If our mission was to train a maxent model, then by now we have
+      // accumulated all the required questions and answers, so we can
+      // estimate the model. Cross-validation estimates a model for every
+      // fold and leaves the scheme's model alone.
+      if (crossval) {
+        vector<fold_result_t> fold_results;
+        cross_validate(trainer, n_folds, training_parameters,
+                       n_feature_buckets,
+                       tbb::task_scheduler_init::default_num_threads(),
+                       fold_results);
+        print_cross_validation(fold_results, cout);
+      } else if ((mode == TRAIN_MODE) && o_warm_start
+          && (trainer.n_events() == 0)) {
+        clog << "trtok: No new or changed training files, keeping the "
+                "current model." << endl;
+      } else if (mode == TRAIN_MODE) {
+        // The sweep trains a model for every configuration of the grid, the
+        // best one is then saved like the model trained in 'train' mode.
+        MaxentTrainer *model_trainer_p = &trainer;
+        if (sweep) {
+          vector<sweep_result_t> sweep_results;
+          size_t best;
+          model_trainer_p = sweep_parameters(trainer, parameter_grid,
+                              training_parameters, n_feature_buckets,
+                              tbb::task_scheduler_init::default_num_threads(),
+                              sweep_results, best);
+          print_sweep(parameter_grid, sweep_results, best, cout);
+          fs::ofstream sweep_results_file(build_path / "sweep.results");
+          print_sweep(parameter_grid, sweep_results, best, sweep_results_file);
+          cout << "The model of configuration " << best + 1 << " was saved "
+                  "as " << model_path.filename().native() << "." << endl;
+        }
+
+        // The previous model is converted to the text format by the toolkit,
+        // as it might have been saved in the binary format.
+        if (o_warm_start) {
+          fs::path warm_start_path = build_path / "warm_start.model";
+          maxent::MaxentModel previous_model;
+          previous_model.load(model_path.native());
+          previous_model.save(warm_start_path.native(), false);
+          try {
+            trainer.warm_start(warm_start_path.native());
+          } catch (runtime_error const &exc) {
+            cerr << exc.what() << endl;
+            return 1;
+          }
+          fs::remove(warm_start_path);
+          training_parameters.n_iterations = warm_start_iterations;
+          // The counts of the files which were not read again are taken
+          // from their cached events. Without them, the counts saved with
+          // the previous model are used, in which the changed files are
+          // counted twice. That only matters for the event cutoff and
+          // pruning.
+          if (skipped_events_cached) {
+            try {
+              for (vector<string>::const_iterator
+                   file = skipped_events_files.begin();
+                   file != skipped_events_files.end(); file++) {
+                trainer.load_event_counts(*file);
+              }
+            } catch (runtime_error const &exc) {
+              cerr << exc.what() << endl;
+              return 1;
+            }
+          } else if (fs::exists(counts_path)) {
+            SIGNAL_WARNING(counts_path, "The events of some unchanged files "
+                "are not cached, the counts of the changed files are "
+                "counted twice.");
+            trainer.load_counts(counts_path.native());
+          }
+        }
+
+        if (!sweep && (trainer.n_events() > 0)) {
+          trainer.train(training_parameters, o_verbose);
+        }
+        model_trainer_p->save(model_path.native());
+        model_trainer_p->save_counts(counts_path.native());
+
+        // The trainer writes the toolkit's text format, the binary format is
+        // produced by the toolkit itself.
+        if (save_model_as_binary) {
+          maxent::MaxentModel model;
+          model.load(model_path.native());
+          model.save(model_path.native(), true);
+        }
+
+        if (compact_model_bits != 0) {
+          model_trainer_p->save_compact(compact_model_path.native(),
+                                        compact_model_bits);
+          model_trainer_p->report_compact_models(model_path.native());
+        }
+
+        // A warm-started model has been trained on the files it was trained
+        // on before as well.
+        if (o_warm_start) {
+          for (training_manifest_t::const_iterator
+               file = trained_files.begin(); file != trained_files.end();
+               file++) {
+            manifest[file->first] = file->second;
+          }
+          trained_files.swap(manifest);
+        }
+        write_training_manifest(manifest_path.native(), trained_files);
+
+        if (sweep) {
+          delete model_trainer_p;
+        }
+      }
     }
 
     if (qa_stream_p != NULL) {
-      qa_stream_p->flush();
+      qa_stream_p->close();
+      delete qa_stream_p;
       if (s_qa_file != "-") {
-        std::ofstream *qa_file_stream_p = (std::ofstream*)qa_stream_p;
-        qa_file_stream_p->close();
+        ((std::ofstream*)qa_file_stream_p)->close();
+        delete qa_file_stream_p;
+      }
+    }
+
+    if (profile_p != NULL) {
+      profile_p->print(clog);
+      if (!s_profile_file.empty()) {
+        ofstream profile_file(s_profile_file.c_str());
+        profile_p->print_json(profile_file);
       }
     }
 
@@ -0,0 +1,13 @@
+#ifndef MESSAGES_INCLUDE_GUARD
+#define MESSAGES_INCLUDE_GUARD
+
+#include <iostream>
+
+// SIGNAL_WARNING reports a problem which trtok works around, e.g. by
+// skipping the offending input. The location is usually the name of the
+// file, or "trtok" for problems with the options.
+#define SIGNAL_WARNING(location, message) {\
+  std::cerr << location << ": Warning: " << message << std::endl;\
+}
+
+#endif
@@ -0,0 +1,633 @@
+/* trtok_microbench measures the inner loops of the tokenizer one at a time
+ * on fixed, generated inputs, so that an optimization of one component can
+ * be validated without the noise of the whole pipeline. Every benchmark is
+ * run for at least --min-time seconds, the best of --repetitions runs is
+ * reported. */
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <streambuf>
+#include <string>
+#include <vector>
+#include <map>
+#include <utility>
+#include <climits>
+#include <pcrecpp.h>
+#include "tbb/concurrent_queue.h"
+#include <boost/thread/thread.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/program_options.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/cstdint.hpp>
+typedef boost::uint32_t uint32_t;
+
+#include "configuration.hpp"
+#include "pipes/pipe.hpp"
+#include "utils.hpp"
+#include "Utf8Reader.hpp"
+#include "token_t.hpp"
+#include "cutout_t.hpp"
+#include "FeatureExtractor.hpp"
+#include "Classifier.hpp"
+#include "MaxentTrainer.hpp"
+#include "OutputFormatter.hpp"
+#include "Encoder.hpp"
+#include "MemoryBuffer.hpp"
+#include "test_support.hpp"
+
+using namespace std;
+using namespace trtok;
+namespace po = boost::program_options;
+namespace fs = boost::filesystem;
+
+
+boost::posix_time::ptime current_time() {
+  return boost::posix_time::microsec_clock::universal_time();
+}
+
+double seconds_since(boost::posix_time::ptime start) {
+  return (current_time() - start).total_microseconds() / 1e6;
+}
+
+// The results of the kernels are accumulated here so that the compiler
+// cannot optimize them away.
+volatile uint32_t g_sink;
+
+
+// THE INPUTS
+
+// The words of the generated text and tokens, with characters of one to
+// four bytes.
+char const *const input_words[] = {
+  "the", "tokenizer", "reads", "text", "and", "of", "a", "Mr.", "U.S.",
+  "e.g.", "2013", "1,5", "(", ")", ",", ".", "?", "\"", "Praha",
+  "p\xc5\x99\xc3\xadli\xc5\xa1", /* příliš */
+  "\xc5\xbelu\xc5\xa5ou\xc4\x8dk\xc3\xbd", /* žluťoučký */
+  "k\xc5\xaf\xc5\x88", /* kůň */
+  "Stra\xc3\x9f" "e", /* Straße */
+  "na\xc3\xafve", /* naïve */
+  "\xe6\x9d\xb1\xe4\xba\xac", /* 東京 */
+  "\xe2\x82\xac", /* € */
+  "\xe2\x80\x94", /* — */
+  "\xe2\x80\xa6", /* … */
+  "\xf0\x9f\x98\x80", /* 😀 */
+  "\xf0\x9d\x90\x80", /* 𝐀 */
+  "sentence.", "end!"
+};
+
+// generate_tokens returns n_tokens rough tokens with their decision points
+// and with plausible correct decisions, which are used when training the
+// model the classifier benchmarks use.
+vector<token_t> generate_tokens(TestGenerator &generator, size_t n_tokens) {
+  vector<token_t> tokens(n_tokens);
+  for (size_t t = 0; t != n_tokens; t++) {
+    token_t &token = tokens[t];
+    token.text = generator.word();
+    token.n_newlines = (generator.next(10) < 8)
+                         ? 0 : ((generator.next(4) == 0) ? 1 : -1);
+    char last = token.text[token.text.length() - 1];
+    int flags = NO_FLAG;
+    if (token.n_newlines == -1)
+      flags |= MAY_SPLIT_FLAG | ((generator.next(3) > 0) ? DO_SPLIT_FLAG : 0);
+    if ((last >= '0') && (last <= '9') && (token.n_newlines == 0))
+      flags |= MAY_JOIN_FLAG | ((generator.next(3) == 0) ? DO_JOIN_FLAG : 0);
+    if ((last == '.') || (last == '?') || (last == '!'))
+      flags |= MAY_BREAK_SENTENCE_FLAG
+               | ((generator.next(2) == 0) ? DO_BREAK_SENTENCE_FLAG : 0);
+    token.decision_flags = (decision_flags_t)flags;
+  }
+  return tokens;
+}
+
+/* A stream buffer discarding everything written to it. */
+class NullBuffer: public std::streambuf {
+protected:
+    virtual int overflow(int c) { return c; }
+    virtual std::streamsize xsputn(char const*, std::streamsize n) {
+      return n;
+    }
+};
+
+
+// THE BENCHMARKS
+
+/* A benchmark runs a kernel a given number of times. Whatever must be
+ * done before the kernel runs, but is not to be measured, is done in
+ * prepare. */
+class Benchmark {
+
+public:
+    Benchmark(string const &name, string const &unit):
+        m_name(name), m_unit(unit) {}
+    virtual ~Benchmark() {}
+
+    string const &name() const { return m_name; }
+    // The unit of the throughput (MB, tokens, ...).
+    string const &unit() const { return m_unit; }
+    // How many units a single iteration processes.
+    virtual double units_per_iteration() const = 0;
+
+    virtual void prepare(size_t /*n_iterations*/) {}
+    virtual void run(size_t n_iterations) = 0;
+
+private:
+    string m_name;
+    string m_unit;
+};
+
+size_t const TEXT_SIZE = 1 << 20;
+size_t const N_CLASSIFIED_TOKENS = 1 << 14;
+
+class Utf8CharToUnicodeBenchmark: public Benchmark {
+public:
+    Utf8CharToUnicodeBenchmark(string const &text):
+        Benchmark("utf8char_to_unicode", "MB"), m_text(text) {}
+    virtual double units_per_iteration() const {
+      return m_text.length() / 1e6;
+    }
+    virtual void run(size_t n_iterations) {
+      uint32_t sum = 0;
+      for (size_t i = 0; i != n_iterations; i++) {
+        size_t offset = 0;
+        while (offset < m_text.length())
+          sum += utf8char_to_unicode(m_text.data(), offset);
+      }
+      g_sink = sum;
+    }
+private:
+    string const &m_text;
+};
+
+class Utf8ToUnicodeBenchmark: public Benchmark {
+public:
+    Utf8ToUnicodeBenchmark(string const &text):
+        Benchmark("utf8_to_unicode", "MB"), m_text(text) {}
+    virtual double units_per_iteration() const {
+      return m_text.length() / 1e6;
+    }
+    virtual void run(size_t n_iterations) {
+      for (size_t i = 0; i != n_iterations; i++) {
+        g_sink = utf8_to_unicode(m_text).length();
+      }
+    }
+private:
+    string const &m_text;
+};
+
+class GetUnicodeFromUtf8Benchmark: public Benchmark {
+public:
+    GetUnicodeFromUtf8Benchmark(string const &text):
+        Benchmark("get_unicode_from_utf8", "MB"), m_text(text),
+        m_stream(&m_buffer) {}
+    virtual double units_per_iteration() const {
+      return m_text.length() / 1e6;
+    }
+    virtual void run(size_t n_iterations) {
+      uint32_t sum = 0;
+      for (size_t i = 0; i != n_iterations; i++) {
+        m_buffer.set(m_text);
+        m_stream.clear();
+        uint32_t c;
+        while ((c = get_unicode_from_utf8(&m_stream)) != 0)
+          sum += c;
+      }
+      g_sink = sum;
+    }
+private:
+    string const &m_text;
+    MemoryBuffer m_buffer;
+    istream m_stream;
+};
+
+class Utf8ReaderBenchmark: public Benchmark {
+public:
+    Utf8ReaderBenchmark(string const &text):
+        Benchmark("Utf8Reader", "MB"), m_text(text), m_stream(&m_buffer) {}
+    virtual double units_per_iteration() const {
+      return m_text.length() / 1e6;
+    }
+    virtual void run(size_t n_iterations) {
+      uint32_t sum = 0;
+      for (size_t i = 0; i != n_iterations; i++) {
+        m_buffer.set(m_text);
+        m_stream.clear();
+        m_reader.setup(&m_stream);
+        uint32_t c;
+        while ((c = m_reader.get()) != 0)
+          sum += c;
+      }
+      g_sink = sum;
+    }
+private:
+    string const &m_text;
+    MemoryBuffer m_buffer;
+    istream m_stream;
+    Utf8Reader m_reader;
+};
+
+class Utf8LengthBenchmark: public Benchmark {
+public:
+    Utf8LengthBenchmark(string const &text):
+        Benchmark("utf8_length", "MB"), m_text(text) {}
+    virtual double units_per_iteration() const {
+      return m_text.length() / 1e6;
+    }
+    virtual void run(size_t n_iterations) {
+      size_t n_chars = 0;
+      for (size_t i = 0; i != n_iterations; i++) {
+        n_chars += utf8_length(m_text.data(), m_text.data() + m_text.length());
+      }
+      g_sink = n_chars;
+    }
+private:
+    string const &m_text;
+};
+
+class IsWhitespaceBenchmark: public Benchmark {
+public:
+    IsWhitespaceBenchmark(string const &text):
+        Benchmark("is_whitespace", "Mchars"),
+        m_codepoints(utf8_to_unicode(text)) {}
+    virtual double units_per_iteration() const {
+      return m_codepoints.length() / 1e6;
+    }
+    virtual void run(size_t n_iterations) {
+      uint32_t n_whitespace = 0;
+      for (size_t i = 0; i != n_iterations; i++) {
+        for (size_t c = 0; c != m_codepoints.length(); c++) {
+          if (is_whitespace(m_codepoints[c]))
+            n_whitespace++;
+        }
+      }
+      g_sink = n_whitespace;
+    }
+private:
+    basic_string<uint32_t> m_codepoints;
+};
+
+class FeatureExtractorBenchmark: public Benchmark {
+public:
+    FeatureExtractorBenchmark(properties_t const &properties,
+                              vector<token_t> const &tokens):
+        Benchmark("FeatureExtractor", "tokens"),
+        m_feature_extractor(properties.n_basic_properties,
+                            properties.regex_properties,
+                            properties.word_to_list_props)
+    {
+      m_chunk.tokens.assign(tokens.begin(), tokens.begin() + CHUNK_SIZE);
+    }
+    virtual double units_per_iteration() const {
+      return m_chunk.tokens.size();
+    }
+    virtual void run(size_t n_iterations) {
+      for (size_t i = 0; i != n_iterations; i++) {
+        m_feature_extractor(&m_chunk);
+      }
+    }
+private:
+    FeatureExtractor m_feature_extractor;
+    chunk_t m_chunk;
+};
+
+/* The classifier benchmarks run process_center_token for every token of
+ * a fixed sequence. In PREPARE_MODE, only the context is assembled; in
+ * TOKENIZE_MODE, the model is also asked for a prediction. */
+class ClassifierBenchmark: public Benchmark {
+public:
+    ClassifierBenchmark(string const &name, Classifier &classifier,
+                        vector<token_t> const &tokens):
+        Benchmark(name, "decisions"),
+        m_classifier(classifier),
+        m_tokens(tokens)
+    {
+      // Only the decisions made by the classifier are left in the tokens.
+      decision_flags_t const do_flags = (decision_flags_t)
+            (DO_SPLIT_FLAG | DO_JOIN_FLAG | DO_BREAK_SENTENCE_FLAG);
+      for (size_t t = 0; t != m_tokens.size(); t++) {
+        m_tokens[t].decision_flags = (decision_flags_t)
+              (m_tokens[t].decision_flags & ~do_flags);
+      }
+      m_classifier.setup("microbench");
+      m_classifier.process_tokens(m_tokens);
+      m_n_decisions = m_classifier.n_decisions();
+    }
+    virtual double units_per_iteration() const {
+      return m_n_decisions;
+    }
+    virtual void run(size_t n_iterations) {
+      for (size_t i = 0; i != n_iterations; i++) {
+        m_classifier.reset();
+        m_classifier.process_tokens(m_tokens);
+      }
+    }
+private:
+    Classifier &m_classifier;
+    vector<token_t> m_tokens;
+    size_t m_n_decisions;
+};
+
+/* Reads a pipe until its end. */
+class PipeDrainer {
+public:
+    PipeDrainer(istream &input): m_input(input) {}
+    void operator()() {
+      char buffer[4096];
+      size_t n_bytes = 0;
+      while (m_input.read(buffer, sizeof(buffer)) || m_input.gcount())
+        n_bytes += m_input.gcount();
+      g_sink = n_bytes;
+    }
+private:
+    istream &m_input;
+};
+
+class OutputFormatterBenchmark: public Benchmark {
+public:
+    OutputFormatterBenchmark(vector<token_t> const &tokens):
+        Benchmark("OutputFormatter", "chunks"),
+        m_pipe(pipes::pipe::limited_capacity),
+        m_pipe_to(m_pipe),
+        m_pipe_from(m_pipe),
+        m_output_formatter(&m_pipe_to, false, false, false, false,
+                           &m_cutout_queue),
+        m_drainer_thread(PipeDrainer(m_pipe_from))
+    {
+      m_chunk.tokens.assign(tokens.begin(), tokens.begin() + CHUNK_SIZE);
+      // A single cutout which is never reached, the OutputFormatter never
+      // waits for the TextCleaner.
+      cutout_t sync_mark;
+      sync_mark.type = SYNC_MARK;
+      sync_mark.position = LONG_MAX;
+      m_cutout_queue.push(sync_mark);
+    }
+    ~OutputFormatterBenchmark() {
+      m_pipe_to.close();
+      m_drainer_thread.join();
+    }
+    virtual double units_per_iteration() const { return 1; }
+    // The OutputFormatter deletes the chunks it gets.
+    virtual void prepare(size_t n_iterations) {
+      m_chunks.clear();
+      for (size_t i = 0; i != n_iterations; i++) {
+        m_chunks.push_back(new chunk_t(m_chunk));
+      }
+    }
+    virtual void run(size_t n_iterations) {
+      for (size_t i = 0; i != n_iterations; i++) {
+        m_output_formatter(m_chunks[i]);
+      }
+      m_chunks.clear();
+    }
+private:
+    pipes::pipe m_pipe;
+    pipes::opipestream m_pipe_to;
+    pipes::ipipestream m_pipe_from;
+    tbb::concurrent_bounded_queue<cutout_t> m_cutout_queue;
+    OutputFormatter m_output_formatter;
+    boost::thread m_drainer_thread;
+    chunk_t m_chunk;
+    vector<chunk_t*> m_chunks;
+};
+
+class EncoderBenchmark: public Benchmark {
+public:
+    EncoderBenchmark(string const &text):
+        Benchmark("Encoder", "MB"),
+        m_text(text),
+        m_input(&m_input_buffer),
+        m_output(&m_output_buffer),
+        m_encoder(&m_input, "UTF-8")
+    {
+      m_encoder.setup(&m_output);
+    }
+    virtual double units_per_iteration() const {
+      return m_text.length() / 1e6;
+    }
+    virtual void run(size_t n_iterations) {
+      for (size_t i = 0; i != n_iterations; i++) {
+        m_input_buffer.set(m_text);
+        m_input.clear();
+        m_encoder.do_work();
+      }
+    }
+private:
+    string const &m_text;
+    MemoryBuffer m_input_buffer;
+    NullBuffer m_output_buffer;
+    istream m_input;
+    ostream m_output;
+    Encoder m_encoder;
+};
+
+/* Writes the text to a pipe the given number of times in pieces of
+ * the given size and closes it. */
+class PipeWriter {
+public:
+    PipeWriter(pipes::opipestream &output, string const &text,
+               size_t n_times, size_t piece_size):
+        m_output(output), m_text(text), m_n_times(n_times),
+        m_piece_size(piece_size) {}
+    void operator()() {
+      for (size_t i = 0; i != m_n_times; i++) {
+        for (size_t offset = 0; offset < m_text.length();
+             offset += m_piece_size) {
+          m_output.write(m_text.data() + offset,
+                         min(m_piece_size, m_text.length() - offset));
+        }
+      }
+      m_output.close();
+    }
+private:
+    pipes::opipestream &m_output;
+    string const &m_text;
+    size_t m_n_times;
+    size_t m_piece_size;
+};
+
+class PipeBenchmark: public Benchmark {
+public:
+    PipeBenchmark(string const &text):
+        Benchmark("pipes::pipe", "MB"), m_text(text) {}
+    virtual double units_per_iteration() const {
+      return m_text.length() / 1e6;
+    }
+    virtual void run(size_t n_iterations) {
+      pipes::pipe pipe(pipes::pipe::limited_capacity);
+      pipes::opipestream pipe_to(pipe);
+      pipes::ipipestream pipe_from(pipe);
+      boost::thread writer_thread(PipeWriter(pipe_to, m_text,
+                                             n_iterations, 4096));
+      PipeDrainer drainer(pipe_from);
+      drainer();
+      writer_thread.join();
+    }
+private:
+    string const &m_text;
+};
+
+
+// RUNNING THE BENCHMARKS
+
+struct benchmark_result_t {
+  size_t n_iterations;
+  double seconds;
+};
+
+// measure finds a number of iterations which takes at least min_time
+// seconds and returns the fastest of n_repetitions runs of it.
+benchmark_result_t measure(Benchmark &benchmark, double min_time,
+                           int n_repetitions) {
+  benchmark_result_t result;
+  result.n_iterations = 1;
+  while (true) {
+    benchmark.prepare(result.n_iterations);
+    boost::posix_time::ptime start = current_time();
+    benchmark.run(result.n_iterations);
+    result.seconds = seconds_since(start);
+    if (result.seconds >= min_time)
+      break;
+    // We aim a bit above min_time so that a single step is usually enough.
+    size_t n_next = (result.seconds > 0)
+        ? (size_t)(result.n_iterations * 1.2 * min_time / result.seconds)
+        : result.n_iterations * 10;
+    result.n_iterations = max(n_next, result.n_iterations * 2);
+  }
+  for (int r = 1; r < n_repetitions; r++) {
+    benchmark.prepare(result.n_iterations);
+    boost::posix_time::ptime start = current_time();
+    benchmark.run(result.n_iterations);
+    result.seconds = min(result.seconds, seconds_since(start));
+  }
+  return result;
+}
+
+int main(int argc, char const **argv) {
+  string s_filter;
+  double min_time;
+  int n_repetitions;
+  bool o_json;
+
+  po::options_description options("Options");
+  options.add_options()
+    ("help", "Prints this message.")
+    ("filter,f", po::value<string>(&s_filter)->default_value(""),
+      "Runs only the benchmarks whose names contain the given string.")
+    ("min-time,t", po::value<double>(&min_time)->default_value(0.5),
+      "The minimal time in seconds a measured run of a benchmark takes.")
+    ("repetitions,r", po::value<int>(&n_repetitions)->default_value(3),
+      "The number of measured runs of every benchmark, the fastest one is "
+      "reported.")
+    ("json", po::bool_switch(&o_json),
+      "Prints the results as JSON instead of a table.");
+
+  po::variables_map vm;
+  try {
+    po::store(po::parse_command_line(argc, argv, options), vm);
+    po::notify(vm);
+  } catch (po::error const &exc) {
+    cerr << "trtok_microbench: " << exc.what() << endl;
+    return 1;
+  }
+  if (vm.count("help")) {
+    cout << "Usage: trtok_microbench [options]" << endl << options;
+    return 0;
+  }
+
+  // The inputs
+  TestGenerator generator(input_words,
+                          sizeof(input_words) / sizeof(char const*));
+  string text = generator.text(TEXT_SIZE);
+  vector<token_t> tokens = generate_tokens(generator, N_CLASSIFIED_TOKENS);
+  properties_t properties;
+  {
+    FeatureExtractor feature_extractor(properties.n_basic_properties,
+                                       properties.regex_properties,
+                                       properties.word_to_list_props);
+    chunk_t chunk;
+    chunk.tokens.swap(tokens);
+    feature_extractor(&chunk);
+    chunk.tokens.swap(tokens);
+  }
+
+  // The classifiers use the features -2..2: *; of the czeng scheme.
+  int const precontext = 2, postcontext = 2;
+  int mask_size = (precontext + 1 + postcontext) * properties.names.size();
+  bool *features_mask = new bool[mask_size];
+  for (int i = 0; i != mask_size; i++)
+    features_mask[i] = true;
+
+  fs::path model_path = fs::temp_directory_path()
+                        / fs::unique_path("trtok-microbench-%%%%%%.model");
+  train_model(properties, features_mask, precontext, postcontext, tokens,
+              model_path.native());
+  Classifier context_classifier(PREPARE_MODE, properties.names, precontext,
+                                postcontext, features_mask,
+                                vector< vector< pair<int,int> > >());
+  Classifier predicting_classifier(TOKENIZE_MODE, properties.names,
+                                   precontext, postcontext, features_mask,
+                                   vector< vector< pair<int,int> > >());
+  predicting_classifier.load_model(model_path.native());
+  fs::remove(model_path);
+
+  vector<Benchmark*> benchmarks;
+  benchmarks.push_back(new Utf8CharToUnicodeBenchmark(text));
+  benchmarks.push_back(new Utf8ToUnicodeBenchmark(text));
+  benchmarks.push_back(new GetUnicodeFromUtf8Benchmark(text));
+  benchmarks.push_back(new Utf8ReaderBenchmark(text));
+  benchmarks.push_back(new Utf8LengthBenchmark(text));
+  benchmarks.push_back(new IsWhitespaceBenchmark(text));
+  benchmarks.push_back(new FeatureExtractorBenchmark(properties, tokens));
+  benchmarks.push_back(new ClassifierBenchmark(
+      "Classifier::process_center_token (context)",
+      context_classifier, tokens));
+  benchmarks.push_back(new ClassifierBenchmark(
+      "Classifier::process_center_token (predict)",
+      predicting_classifier, tokens));
+  benchmarks.push_back(new OutputFormatterBenchmark(tokens));
+  benchmarks.push_back(new EncoderBenchmark(text));
+  benchmarks.push_back(new PipeBenchmark(text));
+
+  if (o_json) {
+    cout << "[";
+  } else {
+    cout << left << setw(46) << "benchmark" << right
+         << setw(12) << "iterations" << setw(14) << "ns/iteration"
+         << setw(22) << "throughput" << endl;
+  }
+  bool first = true;
+  for (size_t b = 0; b != benchmarks.size(); b++) {
+    Benchmark &benchmark = *benchmarks[b];
+    if (benchmark.name().find(s_filter) == string::npos)
+      continue;
+    benchmark_result_t result = measure(benchmark, min_time, n_repetitions);
+    double ns_per_iteration = result.seconds * 1e9 / result.n_iterations;
+    double throughput = benchmark.units_per_iteration()
+                        * result.n_iterations / result.seconds;
+    if (o_json) {
+      cout << (first ? "\n" : ",\n") << fixed << setprecision(3)
+           << "  {\"benchmark\": \"" << benchmark.name() << "\""
+           << ", \"iterations\": " << result.n_iterations
+           << ", \"seconds\": " << result.seconds
+           << ", \"ns_per_iteration\": " << ns_per_iteration
+           << ", \"throughput\": " << throughput
+           << ", \"unit\": \"" << benchmark.unit() << "/s\"}";
+    } else {
+      cout << left << setw(46) << benchmark.name() << right << fixed
+           << setw(12) << result.n_iterations
+           << setw(14) << setprecision(0) << ns_per_iteration
+           << setw(14) << setprecision(2) << throughput << " "
+           << benchmark.unit() << "/s" << endl;
+    }
+    cout.flush();
+    first = false;
+  }
+  if (o_json)
+    cout << "\n]" << endl;
+
+  for (size_t b = 0; b != benchmarks.size(); b++) {
+    delete benchmarks[b];
+  }
+  delete[] features_mask;
+  return 0;
+}
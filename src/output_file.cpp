@@ -0,0 +1,28 @@
+#include <iostream>
+#include <string>
+#include <algorithm>
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/thread.hpp>
+
+#include "configuration.hpp"
+#include "output_file.hpp"
+#include "CompressedStream.hpp"
+
+using namespace std;
+namespace fs = boost::filesystem;
+
+namespace trtok {
+
+ostream *open_output_file(string const &path) {
+  compression_t compression = compression_from_extension(path);
+  if (compression == NO_COMPRESSION)
+    return new fs::ofstream(fs::path(path));
+  size_t n_threads = max(1u, boost::thread::hardware_concurrency());
+  return new CompressingStream(new fs::ofstream(fs::path(path),
+                                                ios::out | ios::binary),
+                               compression, path, COMPRESSION_BLOCK_SIZE,
+                               n_threads);
+}
+
+}
@@ -0,0 +1,17 @@
+#ifndef OUTPUT_FILE_INCLUDE_GUARD
+#define OUTPUT_FILE_INCLUDE_GUARD
+
+#include <iostream>
+#include <string>
+
+namespace trtok {
+
+// open_output_file returns a stream writing the output file at path, which
+// is to be deleted by the caller. If the path ends with .gz, .xz or .zst,
+// the output is compressed accordingly on all the available cores, see
+// CompressingStream.
+std::ostream *open_output_file(std::string const &path);
+
+}
+
+#endif
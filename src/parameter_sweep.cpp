@@ -0,0 +1,232 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <utility>
+#include <stdexcept>
+#include <algorithm>
+#include <boost/thread.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+#include "parameter_sweep.hpp"
+#include "task_queue.hpp"
+
+using namespace std;
+
+namespace trtok {
+
+namespace {
+
+// set_parameter sets the training parameter called name to the value
+// written in value.
+void set_parameter(training_parameters_t &parameters, string const &name,
+                   string const &value) {
+  try {
+    if (name == "event_cutoff") {
+      parameters.event_cutoff = boost::lexical_cast<size_t>(value);
+    } else if (name == "n_iterations") {
+      parameters.n_iterations = boost::lexical_cast<size_t>(value);
+    } else if (name == "method_name") {
+      if ((value != "lbfgs") && (value != "gis"))
+        throw invalid_argument("Unknown method_name \"" + value
+                               + "\", use either lbfgs or gis.");
+      parameters.method_name = value;
+    } else if (name == "smoothing_coefficient") {
+      parameters.smoothing_coefficient = boost::lexical_cast<double>(value);
+    } else if (name == "convergence_tolerance") {
+      parameters.convergence_tolerance = boost::lexical_cast<double>(value);
+    } else {
+      throw invalid_argument("The training parameter \"" + name
+                             + "\" cannot be swept over.");
+    }
+  } catch (boost::bad_lexical_cast const &) {
+    throw invalid_argument("Invalid value \"" + value + "\" of the training "
+                           "parameter \"" + name + "\".");
+  }
+}
+
+/* ConfigurationTask trains and evaluates a configuration, it is run by
+   run_tasks for every configuration. It keeps the trainer of the best
+   configuration. */
+class ConfigurationTask {
+
+public:
+    ConfigurationTask(MaxentTrainer const &trainer,
+                      size_t n_feature_buckets,
+                      vector<sweep_result_t> &results,
+                      MaxentTrainer *&best_trainer_p,
+                      size_t &best):
+        m_trainer(trainer),
+        m_n_feature_buckets(n_feature_buckets),
+        m_results(results),
+        m_best_trainer_p(best_trainer_p),
+        m_best(best)
+    {}
+
+    void operator()(size_t configuration) {
+      sweep_result_t &result = m_results[configuration];
+
+      // All the configurations read the events of the trainer, only the
+      // parameters are their own. The event cutoff is applied to the shared
+      // predicate counts, so it needs no events of its own either.
+      MaxentTrainer *trainer_p = new MaxentTrainer();
+      trainer_p->share_events(m_trainer);
+
+      boost::posix_time::ptime start =
+        boost::posix_time::microsec_clock::universal_time();
+      if (trainer_p->n_events() > 0) {
+        trainer_p->train(result.parameters);
+      }
+      boost::posix_time::time_duration elapsed =
+        boost::posix_time::microsec_clock::universal_time() - start;
+      result.seconds = elapsed.total_microseconds() / 1e6;
+
+      result.n_parameters = trainer_p->n_parameters();
+      if (trainer_p->n_events() > 0) {
+        trainer_p->classify_heldout(m_n_feature_buckets, result.stats);
+      }
+
+      boost::mutex::scoped_lock lock(m_best_mutex);
+      clog << "trtok: Configuration " << configuration + 1 << " of "
+           << m_results.size() << " trained in " << result.seconds << " s"
+           << endl;
+      if (better(configuration)) {
+        swap(trainer_p, m_best_trainer_p);
+        m_best = configuration;
+      }
+      delete trainer_p;
+    }
+
+private:
+    // better tells whether the result of a configuration beats the best
+    // one so far. Ties go to the configuration listed first, so the choice
+    // does not depend on the order in which the workers finish.
+    bool better(size_t configuration) const {
+      if (m_best_trainer_p == NULL)
+        return true;
+      double accuracy =
+        m_results[configuration].stats.metric(EFFECTIVE_ACCURACY);
+      double best_accuracy = m_results[m_best].stats.metric(EFFECTIVE_ACCURACY);
+      return (accuracy > best_accuracy)
+          || ((accuracy == best_accuracy) && (configuration < m_best));
+    }
+
+    MaxentTrainer const &m_trainer;
+    size_t m_n_feature_buckets;
+    vector<sweep_result_t> &m_results;
+    MaxentTrainer *&m_best_trainer_p;
+    size_t &m_best;
+    boost::mutex m_best_mutex;
+};
+}
+
+
+void add_grid_axis(string const &spec, parameter_grid_t &grid) {
+  size_t equals = spec.find('=');
+  if ((equals == string::npos) || (equals == 0)
+      || (equals + 1 == spec.length())) {
+    throw invalid_argument("The grid axis \"" + spec + "\" should look like "
+                           "name=value1,value2,...");
+  }
+
+  string name = spec.substr(0, equals);
+  vector<string> values;
+  size_t begin = equals + 1;
+  while (begin <= spec.length()) {
+    size_t end = spec.find(',', begin);
+    if (end == string::npos)
+      end = spec.length();
+    values.push_back(spec.substr(begin, end - begin));
+    begin = end + 1;
+  }
+
+  // The values are checked right away, so that the sweep does not fail
+  // after the events have been extracted.
+  training_parameters_t parameters;
+  for (size_t v = 0; v != values.size(); v++) {
+    set_parameter(parameters, name, values[v]);
+  }
+
+  for (size_t a = 0; a != grid.size(); a++) {
+    if (grid[a].first == name)
+      throw invalid_argument("The training parameter \"" + name
+                             + "\" is given more than once in the grid.");
+  }
+  grid.push_back(make_pair(name, values));
+}
+
+MaxentTrainer *sweep_parameters(MaxentTrainer const &trainer,
+                                parameter_grid_t const &grid,
+                                training_parameters_t const &base_parameters,
+                                size_t n_feature_buckets, size_t n_workers,
+                                vector<sweep_result_t> &results,
+                                size_t &best) {
+  // The configurations are enumerated with the last axis of the grid
+  // changing the fastest.
+  size_t n_configurations = 1;
+  for (size_t a = 0; a != grid.size(); a++) {
+    n_configurations *= grid[a].second.size();
+  }
+  results.assign(n_configurations, sweep_result_t());
+  for (size_t c = 0; c != n_configurations; c++) {
+    sweep_result_t &result = results[c];
+    result.parameters = base_parameters;
+    result.values.resize(grid.size());
+    size_t rest = c;
+    for (size_t a = grid.size(); a-- > 0; ) {
+      vector<string> const &values = grid[a].second;
+      result.values[a] = values[rest % values.size()];
+      set_parameter(result.parameters, grid[a].first, result.values[a]);
+      rest /= values.size();
+    }
+  }
+
+  MaxentTrainer *best_trainer_p = NULL;
+  best = 0;
+  ConfigurationTask task(trainer, n_feature_buckets, results,
+                         best_trainer_p, best);
+  run_tasks(task, n_configurations, n_workers);
+
+  return best_trainer_p;
+}
+
+void print_sweep(parameter_grid_t const &grid,
+                 vector<sweep_result_t> const &results, size_t best,
+                 ostream &out) {
+  ios::fmtflags flags = out.flags();
+  streamsize precision = out.precision();
+  out << fixed << setprecision(4);
+
+  vector<int> widths(grid.size());
+  out << setw(8) << "config";
+  for (size_t a = 0; a != grid.size(); a++) {
+    widths[a] = max((size_t)10, grid[a].first.length() + 2);
+    for (size_t v = 0; v != grid[a].second.size(); v++) {
+      widths[a] = max((size_t)widths[a], grid[a].second[v].length() + 2);
+    }
+    out << setw(widths[a]) << grid[a].first;
+  }
+  for (size_t m = 0; m != N_TABLE_METRICS; m++) {
+    out << setw(10) << table_metric_headings[m];
+  }
+  out << setw(12) << "parameters" << setw(10) << "time (s)" << endl;
+
+  for (size_t c = 0; c != results.size(); c++) {
+    sweep_result_t const &result = results[c];
+    out << setw(7) << c + 1 << ((c == best) ? "*" : " ");
+    for (size_t a = 0; a != grid.size(); a++) {
+      out << setw(widths[a]) << result.values[a];
+    }
+    for (size_t m = 0; m != N_TABLE_METRICS; m++) {
+      print_metric(out, result.stats.metric(table_metrics[m]), 10);
+    }
+    out << setw(12) << result.n_parameters
+        << setw(10) << result.seconds << endl;
+  }
+
+  out.flags(flags);
+  out.precision(precision);
+}
+
+}
@@ -0,0 +1,63 @@
+#ifndef PARAMETER_SWEEP_INCLUDE_GUARD
+#define PARAMETER_SWEEP_INCLUDE_GUARD
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <iostream>
+
+#include "MaxentTrainer.hpp"
+#include "evaluation_stats.hpp"
+
+namespace trtok {
+
+/* A grid of training parameters to sweep over. Every axis names one of
+   the parameters of training_parameters_t and lists the values it takes,
+   the grid is made of all their combinations. */
+typedef std::vector< std::pair< std::string, std::vector<std::string> > >
+        parameter_grid_t;
+
+struct sweep_result_t {
+  training_parameters_t parameters;
+  // The values of the grid's axes, as they were given.
+  std::vector<std::string> values;
+  size_t n_parameters;
+  evaluation_stats_t stats;
+  // The wall-clock time spent on training the model.
+  double seconds;
+};
+
+// add_grid_axis parses an axis of the grid written as
+// "name=value1,value2,..." and appends it to the grid. It throws
+// std::invalid_argument if the parameter or one of its values is not
+// recognized.
+void add_grid_axis(std::string const &spec, parameter_grid_t &grid);
+
+// sweep_parameters trains a model for every configuration of the grid,
+// with the parameters not on the grid taken from base_parameters, and
+// classifies the heldout events of trainer by it. The events are the ones
+// collected by the Classifier, so the input is tokenized and aligned only
+// once for all the configurations. Up to n_workers configurations are
+// trained at the same time, sharing the events of trainer. The trainer
+// holding the model with the best effective accuracy is returned and must
+// be deleted by the caller before trainer, best is set to its index in the
+// results. If the features were hashed into
+// n_feature_buckets buckets, the same must be given here so that the
+// decision points can be recognized.
+MaxentTrainer *sweep_parameters(MaxentTrainer const &trainer,
+                                parameter_grid_t const &grid,
+                                training_parameters_t const &base_parameters,
+                                size_t n_feature_buckets, size_t n_workers,
+                                std::vector<sweep_result_t> &results,
+                                size_t &best);
+
+// print_sweep outputs a table with the values of the grid's axes, the
+// metrics and the training time of every configuration, marking the best
+// one.
+void print_sweep(parameter_grid_t const &grid,
+                 std::vector<sweep_result_t> const &results, size_t best,
+                 std::ostream &out);
+
+}
+
+#endif
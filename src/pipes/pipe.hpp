@@ -14,6 +14,7 @@
 #include <boost/noncopyable.hpp>
 #include <boost/thread/mutex.hpp>
 #include <boost/thread/condition.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
 
 namespace pipes {
 
@@ -67,6 +68,10 @@ class basic_pipestreambuf : public std::basic_streambuf<Ch,Tr>
     boost::mutex m_mutex;
     boost::condition m_cond;
 
+    // The time the writer and the reader have spent waiting for each other.
+    boost::posix_time::time_duration m_put_wait;
+    boost::posix_time::time_duration m_get_wait;
+
     friend class basic_pipe<Ch,Tr>;
     friend class basic_opipestream<Ch,Tr>;
     friend class basic_ipipestream<Ch,Tr>;
@@ -132,6 +137,11 @@ class basic_pipestreambuf : public std::basic_streambuf<Ch,Tr>
         assert(this->epptr() == m_pblock->end());
     }
 
+    static boost::posix_time::ptime now()
+    {
+        return boost::posix_time::microsec_clock::universal_time();
+    }
+
     static block* allocate()
     {
         const std::size_t char_bytes = sizeof(Ch) * chars_in_block;
@@ -232,8 +242,13 @@ class basic_pipestreambuf : public std::basic_streambuf<Ch,Tr>
         boost::mutex::scoped_lock lock(m_mutex);
         invariants(); // before overflow
 
-        while(m_limited_capacity && m_pblock != m_gblock)
-            m_cond.wait(lock);
+        if(m_limited_capacity && m_pblock != m_gblock)
+        {
+            boost::posix_time::ptime start = now();
+            while(m_pblock != m_gblock)
+                m_cond.wait(lock);
+            m_put_wait += now() - start;
+        }
 
         m_pblock->next = allocate();
         m_pblock = m_pblock->next;
@@ -257,7 +272,11 @@ class basic_pipestreambuf : public std::basic_streambuf<Ch,Tr>
             {
                 // label 1 (used below)
                 if(this->gptr() == this->pbase() && m_pstate != closed)
+                {
+                    boost::posix_time::ptime start = now();
                     m_cond.wait(lock);
+                    m_get_wait += now() - start;
+                }
                 else
                 {
                     this->setg(this->eback(), this->gptr(), this->pbase());
@@ -418,6 +437,27 @@ class basic_pipe : private boost::noncopyable
     basic_pipe(capacity_type cap = limited_capacity)
         : m_buf(cap == limited_capacity) {}
 
+    // The time the writing and the reading end have spent blocked waiting
+    // for each other since the pipe was created or reset_wait_times called.
+    double put_wait_seconds()
+    {
+        boost::mutex::scoped_lock lock(m_buf.m_mutex);
+        return m_buf.m_put_wait.total_microseconds() / 1e6;
+    }
+
+    double get_wait_seconds()
+    {
+        boost::mutex::scoped_lock lock(m_buf.m_mutex);
+        return m_buf.m_get_wait.total_microseconds() / 1e6;
+    }
+
+    void reset_wait_times()
+    {
+        boost::mutex::scoped_lock lock(m_buf.m_mutex);
+        m_buf.m_put_wait = boost::posix_time::time_duration();
+        m_buf.m_get_wait = boost::posix_time::time_duration();
+    }
+
     ~basic_pipe() {}
 };
 
@@ -0,0 +1,500 @@
+#!/usr/bin/python
+# -*- coding: utf-8 -*-
+
+# Benchmarks trtok on synthetic corpora. The corpora are generated from
+# a seed, so the same options always give the same text. The script runs
+# the prepare, train (with and without cached events), tokenize and
+# evaluate modes on them with a scheme from the schemes directory and
+# reports the throughput, the peak memory and the startup time of every
+# run as JSON, which can be compared between builds to catch performance
+# regressions.
+#
+# The runs use their own TRTOK_PATH inside the work directory, so the
+# models in the installation directory are left untouched. With
+# --generate-only, the script only writes a corpus and its annotation.
+
+import io
+import json
+import optparse
+import os
+import random
+import shutil
+import subprocess
+import sys
+import time
+
+BENCH_VERSION = 2
+
+# The words are drawn from small vocabularies of the languages of the
+# bundled scheme. Some of them contain characters which the tokenizer will
+# see as entities when --entity-density is set.
+WORDS = {
+  'en': u'the of and to in a is that for it as was with be by on not he '
+        u'this are or his from at which but have an they you were her '
+        u'she there been one all would their we him when who more no if '
+        u'out so said what up its about into than them can only other '
+        u'new some could time these two may then do first any my now '
+        u'such like our over man me even most made after also did many '
+        u'before must through back years where much your way well down '
+        u'should because each just those people how too little state good '
+        u'very make world still own see men work long get here between '
+        u'both life being under never day same another know while last '
+        u'might us great old year off come since against go came right '
+        u'used take three government company market café naïve résumé '
+        u'report minister president week city percent'.split(),
+  'cs': u'a se na je že v to s z do o i by jako ale ve k za pro který '
+        u'jeho po tak jsem jak bylo jen už nebo od však jsou aby když '
+        u'také co jejich podle byl ani mezi být bude může než jeho jsme '
+        u'roce let vláda české republiky lidé práce člověk dnes velmi '
+        u'první další nové celé země města strany ministr prezident '
+        u'řekl uvedl týden procent koruny společnost trhu škola života '
+        u'čas den rok dva tři středa čtvrtek pátek sobota neděle Praha '
+        u'Brno Ostrava dětí žen mužů úřad řešení účet příliš všechno'
+        .split()
+}
+
+ABBREVIATIONS = {
+  'en': [u'Mr.', u'Mrs.', u'Dr.', u'Prof.', u'Inc.', u'Corp.', u'Jan.',
+         u'Feb.', u'etc.', u'e.g.', u'i.e.', u'U.S.'],
+  'cs': [u'např.', u'tj.', u'atd.', u'apod.', u'Kč', u'tis.', u'mil.',
+         u'min.', u'max.', u'odst.', u'čl.', u'spol.']
+}
+
+ENTITIES = [u'&amp;', u'&lt;', u'&gt;', u'&#8211;', u'&sect;']
+# Characters which are written as entities inside of words.
+ENTITY_CHARS = {u'é': u'&eacute;', u'ï': u'&#239;',
+                u'í': u'&iacute;', u'á': u'&#225;'}
+INLINE_TAGS = ['b', 'i', 'em', 'span']
+LINE_BREAKS = ['sentence', 'paragraph', 'wrap', 'mixed']
+
+MODES = ['prepare', 'train', 'retrain', 'tokenize', 'evaluate']
+
+
+# GENERATING THE CORPORA
+
+class Token:
+  """A token of the generated text. raw is its form in the input text,
+  annot the one in the annotated text and glued is true if no whitespace
+  precedes it in the input text."""
+  def __init__(self, raw, annot=None, glued=False):
+    self.raw = raw
+    self.annot = raw if annot is None else annot
+    self.glued = glued
+
+
+class CorpusGenerator:
+  """Generates sentences of an input text and its annotation, in which the
+  tokens are separated by spaces and the sentences by newlines. The
+  tokens only differ from the rough tokens at the MAY_SPLIT, MAY_JOIN and
+  MAY_BREAK_SENTENCE points of the bundled scheme, so the annotated text
+  can be aligned with the input."""
+
+  def __init__(self, seed, languages, xml_density, entity_density,
+               line_breaks):
+    self.random = random.Random(seed)
+    self.languages = languages
+    self.xml_density = xml_density
+    self.entity_density = entity_density
+    self.line_breaks = line_breaks
+
+  # choice and randint are derived from random only, whose sequence is the
+  # same in all versions of Python, unlike that of the functions of random.
+  def choice(self, seq):
+    return seq[int(self.random.random() * len(seq))]
+
+  def randint(self, a, b):
+    return a + int(self.random.random() * (b - a + 1))
+
+  def language(self):
+    x = self.random.random() * sum(weight for _, weight in self.languages)
+    for language, weight in self.languages:
+      x = x - weight
+      if x < 0:
+        return language
+    return self.languages[-1][0]
+
+  def word(self, language):
+    word = self.choice(WORDS[language])
+    if self.entity_density and self.random.random() < self.entity_density:
+      for char, entity in ENTITY_CHARS.items():
+        word = word.replace(char, entity)
+    return word
+
+  def number(self):
+    kind = self.random.random()
+    if kind < 0.5:
+      return Token(str(self.randint(1, 2020)))
+    elif kind < 0.8:
+      return Token('%d.%d' % (self.randint(0, 99),
+                              self.randint(0, 99)))
+    else:
+      # Thousands separated by a space are joined in the annotation.
+      thousands = self.randint(1, 999)
+      rest = self.randint(0, 999)
+      return Token('%d %03d' % (thousands, rest),
+                   '%d%03d' % (thousands, rest))
+
+  def sentence(self):
+    language = self.language()
+    tokens = []
+    first = self.word(language)
+    tokens.append(Token(first[0].upper() + first[1:]))
+    for t in range(self.randint(4, 24)):
+      kind = self.random.random()
+      if kind < 0.06:
+        tokens.append(self.number())
+      elif kind < 0.10:
+        tokens.append(Token(self.choice(ABBREVIATIONS[language])))
+      elif kind < 0.12:
+        # A word in parentheses or quotes, split off in the annotation.
+        opening, closing = self.choice([('(', ')'), ('"', '"')])
+        tokens.append(Token(opening))
+        tokens.append(Token(self.word(language), glued=True))
+        tokens.append(Token(closing, glued=True))
+      elif self.entity_density and kind < 0.12 + self.entity_density / 4:
+        tokens.append(Token(self.choice(ENTITIES)))
+      else:
+        token = Token(self.word(language))
+        if self.xml_density and self.random.random() < self.xml_density:
+          tag = self.choice(INLINE_TAGS)
+          token.raw = '<%s>%s</%s>' % (tag, token.raw, tag)
+          token.annot = token.raw
+        tokens.append(token)
+      if self.random.random() < 0.08:
+        tokens.append(Token(self.choice([',', ';', ':']), glued=True))
+    tokens.append(Token(self.choice(['.', '.', '.', '?', '!']),
+                        glued=True))
+
+    raw = []
+    for token in tokens:
+      if raw and not token.glued:
+        raw.append(' ')
+      raw.append(token.raw)
+    return u''.join(raw), u' '.join(token.annot for token in tokens)
+
+  def paragraph(self):
+    sentences = [self.sentence() for s in range(self.randint(1, 8))]
+    raw = [s[0] for s in sentences]
+    annot = [s[1] for s in sentences]
+    if self.xml_density:
+      raw[0] = '<p>' + raw[0]
+      raw[-1] = raw[-1] + '</p>'
+      annot[0] = '<p>' + annot[0]
+      annot[-1] = annot[-1] + '</p>'
+
+    line_breaks = self.line_breaks
+    if line_breaks == 'mixed':
+      line_breaks = self.choice(LINE_BREAKS[:-1])
+    if line_breaks == 'sentence':
+      raw_text = u'\n'.join(raw) + u'\n'
+    elif line_breaks == 'paragraph':
+      raw_text = u' '.join(raw) + u'\n\n'
+    else:
+      raw_text = self.wrap(u' '.join(raw), self.randint(60, 80)) \
+                 + u'\n\n'
+    return raw_text, u'\n'.join(annot) + u'\n'
+
+  def wrap(self, text, width):
+    lines = []
+    line = []
+    length = 0
+    for word in text.split(' '):
+      if line and length + 1 + len(word) > width:
+        lines.append(u' '.join(line))
+        line = []
+        length = 0
+      length = length + len(word) + (1 if line else 0)
+      line.append(word)
+    lines.append(u' '.join(line))
+    return u'\n'.join(lines)
+
+  def write(self, raw_path, annot_path, size):
+    """Writes paragraphs to the files until the input text has at least
+    size bytes. Returns the size of the input text."""
+    raw_file = io.open(raw_path, 'w', encoding='utf-8', newline='\n')
+    annot_file = io.open(annot_path, 'w', encoding='utf-8', newline='\n')
+    written = 0
+    while written < size:
+      raw, annot = self.paragraph()
+      raw_file.write(raw)
+      annot_file.write(annot)
+      written = written + len(raw.encode('utf-8'))
+    raw_file.close()
+    annot_file.close()
+    return written
+
+
+def generate_corpus(directory, options, seed):
+  """Writes a corpus of options.files files to the directory along with
+  a file list. The input files end with .txt, the annotated ones with .tok.
+  Returns the path to the file list and the size of the input."""
+  if not os.path.isdir(directory):
+    os.makedirs(directory)
+  generator = CorpusGenerator(seed, options.languages, options.xml_density,
+                              options.entity_density, options.line_breaks)
+  names = []
+  size = 0
+  for f in range(options.files):
+    name = 'part%03d' % f
+    size = size + generator.write(os.path.join(directory, name + '.txt'),
+                                  os.path.join(directory, name + '.tok'),
+                                  options.size // options.files)
+    names.append(name + '.txt')
+  file_list = os.path.join(directory, 'files.fl')
+  with open(file_list, 'w') as out:
+    out.write('\n'.join(names) + '\n')
+  return file_list, size
+
+
+# RUNNING TRTOK
+
+class Run:
+  """The measurements of a single run of trtok."""
+  def __init__(self, wall_seconds, peak_rss_kb, profile):
+    self.wall_seconds = wall_seconds
+    self.peak_rss_kb = peak_rss_kb
+    self.profile = profile
+
+  def stage(self, name):
+    if self.profile is None:
+      return {}
+    for stage in self.profile['stages']:
+      if stage['stage'] == name:
+        return stage
+    return {}
+
+
+def run_trtok(options, env, args, log_path, profile_path=None):
+  """Runs trtok with args and an empty standard input and measures its
+  wall-clock time and peak resident set size. If profile_path is given,
+  the profile written by trtok is read."""
+  if profile_path is not None:
+    args = args + ['--profile=' + profile_path]
+  log = open(log_path, 'w')
+  devnull = open(os.devnull, 'r+')
+  start = time.time()
+  process = subprocess.Popen([options.trtok] + args, env=env,
+                             stdin=devnull, stdout=devnull, stderr=log)
+  # wait4 gives us the resource usage of this very process (ru_maxrss is
+  # in kilobytes on Linux).
+  _, status, usage = os.wait4(process.pid, 0)
+  wall_seconds = time.time() - start
+  # The process has been reaped, Popen must not wait for it again.
+  process.returncode = status
+  devnull.close()
+  log.close()
+  if status != 0:
+    sys.stderr.write(open(log_path).read())
+    sys.exit('trtok_bench: trtok %s failed, see %s.'
+             % (' '.join(args), log_path))
+
+  profile = None
+  if profile_path is not None:
+    with open(profile_path) as profile_file:
+      profile = json.load(profile_file)
+  return Run(wall_seconds, usage.ru_maxrss, profile)
+
+
+def best_run(options, env, args, log_path, profile_path=None):
+  runs = [run_trtok(options, env, args, log_path, profile_path)
+          for r in range(options.repeat)]
+  return min(runs, key=lambda run: run.wall_seconds)
+
+
+def setup_trtok_path(options):
+  """Makes a TRTOK_PATH in the work directory which shares the schemes and
+  code with the build but has its own build directory for the models."""
+  trtok_path = os.path.join(options.work_dir, 'trtok_path')
+  if os.path.isdir(trtok_path):
+    shutil.rmtree(trtok_path)
+  os.makedirs(os.path.join(trtok_path, 'build'))
+  os.symlink(os.path.abspath(options.schemes),
+             os.path.join(trtok_path, 'schemes'))
+  os.symlink(os.path.abspath(options.code),
+             os.path.join(trtok_path, 'code'))
+  env = dict(os.environ)
+  env['TRTOK_PATH'] = trtok_path
+  return env
+
+
+def report(name, run, input_bytes):
+  rough = run.stage('RoughTokenizer')
+  classifier = run.stage('Classifier')
+  tokens = rough.get('tokens', 0)
+  decisions = classifier.get('decisions', 0)
+  seconds = max(run.wall_seconds, 1e-9)
+  result = {
+    'wall_seconds': run.wall_seconds,
+    'input_bytes': input_bytes,
+    'mb_per_second': input_bytes / 1e6 / seconds,
+    'tokens': tokens,
+    'tokens_per_second': tokens / seconds,
+    'decisions': decisions,
+    'decisions_per_second': decisions / seconds,
+    'peak_rss_kb': run.peak_rss_kb,
+  }
+  if run.profile is not None:
+    result['stages'] = run.profile['stages']
+  sys.stderr.write('%-10s %8.3f s %8.2f MB/s %10.0f tokens/s '
+                   '%10.0f decisions/s %8d kB\n'
+                   % (name, run.wall_seconds, result['mb_per_second'],
+                      result['tokens_per_second'],
+                      result['decisions_per_second'], run.peak_rss_kb))
+  return result
+
+
+def benchmark(options):
+  work_dir = os.path.abspath(options.work_dir)
+  env = setup_trtok_path(options)
+  logs = os.path.join(work_dir, 'logs')
+  if not os.path.isdir(logs):
+    os.makedirs(logs)
+  def log(name):
+    return os.path.join(logs, name + '.log')
+  def profile(name):
+    return os.path.join(logs, name + '.profile.json')
+
+  sys.stderr.write('trtok_bench: Generating the corpora.\n')
+  train_list, train_bytes = generate_corpus(
+      os.path.join(work_dir, 'corpus', 'train'), options, options.seed)
+  test_list, test_bytes = generate_corpus(
+      os.path.join(work_dir, 'corpus', 'test'), options, options.seed + 1)
+
+  common = []
+  if options.xml_density:
+    common.append('-x')
+  if options.entity_density:
+    common.append('-e')
+  jobs = ['-j', str(options.jobs)]
+
+  # The rough lexer of the scheme is compiled on first use, which is not
+  # what we want to measure.
+  sys.stderr.write('trtok_bench: Compiling the rough lexer.\n')
+  run_trtok(options, env, ['prepare', options.scheme, '-'], log('warmup'))
+
+  results = {}
+  commands = {
+    'prepare': (['prepare', options.scheme, '-l', train_list,
+                 '-r', '|\\.txt$|.prep|'], train_bytes),
+    # Training extracts the events anew every time, retraining reuses the
+    # events cached by it.
+    'train': (['train', options.scheme, '-l', train_list,
+               '-r', '|\\.txt$|.tok|', '--rebuild-events'] + jobs,
+              train_bytes),
+    'retrain': (['train', options.scheme, '-l', train_list,
+                 '-r', '|\\.txt$|.tok|'] + jobs, train_bytes),
+    'tokenize': (['tokenize', options.scheme, '-l', test_list,
+                  '-r', '|\\.txt$|.out|'], test_bytes),
+    'evaluate': (['evaluate', options.scheme, '-l', test_list,
+                  '-r', '|\\.txt$|.tok|'] + jobs, test_bytes),
+  }
+  for mode in MODES:
+    args, input_bytes = commands[mode]
+    run = best_run(options, env, args + common, log(mode), profile(mode))
+    results[mode] = report(mode, run, input_bytes)
+
+  # The startup time is that of tokenizing an empty input with the trained
+  # model, i.e. mostly loading the scheme, the lexer and the model.
+  startup = best_run(options, env, ['tokenize', options.scheme, '-'],
+                     log('startup'))
+  sys.stderr.write('%-10s %8.3f s %35s %8d kB\n'
+                   % ('startup', startup.wall_seconds, '',
+                      startup.peak_rss_kb))
+
+  return {
+    'version': BENCH_VERSION,
+    'timestamp': time.strftime('%Y-%m-%dT%H:%M:%SZ', time.gmtime()),
+    'trtok': os.path.abspath(options.trtok),
+    'scheme': options.scheme,
+    'corpus': {
+      'size': options.size,
+      'files': options.files,
+      'seed': options.seed,
+      'languages': dict(options.languages),
+      'xml_density': options.xml_density,
+      'entity_density': options.entity_density,
+      'line_breaks': options.line_breaks,
+      'train_bytes': train_bytes,
+      'test_bytes': test_bytes,
+    },
+    'jobs': options.jobs,
+    'repeat': options.repeat,
+    'startup_seconds': startup.wall_seconds,
+    'startup_peak_rss_kb': startup.peak_rss_kb,
+    'runs': results,
+  }
+
+
+def parse_languages(value):
+  languages = []
+  for part in value.split(','):
+    language, _, weight = part.partition(':')
+    if language not in WORDS:
+      sys.exit('trtok_bench: Unknown language %s, use one of %s.'
+               % (language, ', '.join(sorted(WORDS))))
+    languages.append((language, float(weight) if weight else 1.0))
+  return languages
+
+
+def main():
+  parser = optparse.OptionParser(usage='%prog [options]')
+  parser.add_option('--trtok', default='trtok',
+                    help='the trtok executable')
+  parser.add_option('--schemes', help='the schemes directory')
+  parser.add_option('--code', help='the code directory of the build')
+  parser.add_option('--scheme', default='czeng/en',
+                    help='the scheme used for the runs [%default]')
+  parser.add_option('--work-dir', default='bench',
+                    help='where the corpora, models and logs are written '
+                         '[%default]')
+  parser.add_option('--output', help='the file the JSON results are '
+                    'written to, the standard output by default')
+  parser.add_option('--size', type='int', default=4000000,
+                    help='the size of the training and testing corpora '
+                         'in bytes [%default]')
+  parser.add_option('--files', type='int', default=4,
+                    help='the number of files in each corpus [%default]')
+  parser.add_option('--seed', type='int', default=1,
+                    help='the seed of the corpus generator [%default]')
+  parser.add_option('--languages', default='en:0.7,cs:0.3',
+                    help='the languages of the sentences and their weights '
+                         '[%default]')
+  parser.add_option('--xml-density', type='float', default=0.0,
+                    help='the probability that a word is marked up with '
+                         'XML; the runs then use -x [%default]')
+  parser.add_option('--entity-density', type='float', default=0.0,
+                    help='the probability of entities in words and between '
+                         'them; the runs then use -e [%default]')
+  parser.add_option('--line-breaks', choices=LINE_BREAKS, default='mixed',
+                    help='where the lines of the input are broken, one of '
+                         '%s [%%default]' % ', '.join(LINE_BREAKS))
+  parser.add_option('--jobs', type='int', default=1,
+                    help='the -j option for train and evaluate [%default]')
+  parser.add_option('--repeat', type='int', default=1,
+                    help='how many times each run is repeated, the fastest '
+                         'one is reported [%default]')
+  parser.add_option('--generate-only', action='store_true', default=False,
+                    help='only write a corpus to the work directory')
+  options, args = parser.parse_args()
+  options.languages = parse_languages(options.languages)
+  options.files = max(options.files, 1)
+  options.repeat = max(options.repeat, 1)
+
+  if options.generate_only:
+    generate_corpus(options.work_dir, options, options.seed)
+    return
+  if options.schemes is None or options.code is None:
+    parser.error('--schemes and --code are needed to run trtok')
+
+  results = benchmark(options)
+  if options.output is None:
+    json.dump(results, sys.stdout, indent=2, sort_keys=True)
+    sys.stdout.write('\n')
+  else:
+    with open(options.output, 'w') as out:
+      json.dump(results, out, indent=2, sort_keys=True)
+      out.write('\n')
+
+
+if __name__ == '__main__':
+  main()
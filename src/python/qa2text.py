@@ -0,0 +1,94 @@
+#!/usr/bin/python
+
+# Converts questions and answers written by trtok with --binary-questions
+# to the text format, which is what analyze and other tools read. The
+# binary format is described in BinaryQAEncoder.hpp.
+
+import struct
+import sys
+
+VERSION = 1
+OUTCOMES = ['', 'SPLIT', 'JOIN', 'BREAK_SENTENCE']
+
+
+class Reader:
+  def __init__(self, data):
+    self.data = bytearray(data)
+    self.pos = 0
+
+  def at_end(self):
+    return self.pos >= len(self.data)
+
+  def byte(self):
+    value = self.data[self.pos]
+    self.pos = self.pos + 1
+    return value
+
+  def varint(self):
+    value = 0
+    shift = 0
+    while True:
+      byte = self.byte()
+      value = value | ((byte & 0x7f) << shift)
+      shift = shift + 7
+      if byte < 0x80:
+        return value
+
+  def string(self):
+    length = self.varint()
+    value = bytes(self.data[self.pos:self.pos + length])
+    self.pos = self.pos + length
+    return value
+
+  def float(self):
+    value = struct.unpack('<f', bytes(self.data[self.pos:self.pos + 4]))[0]
+    self.pos = self.pos + 4
+    return value
+
+
+def convert(data, out):
+  if data[:8] != b'trtokqa\0':
+    sys.exit('qa2text: Not a binary file of questions and answers.')
+  version = struct.unpack('<I', data[8:12])[0]
+  if version != VERSION:
+    sys.exit('qa2text: Unsupported version %d of the binary format.'
+             % version)
+
+  reader = Reader(data[12:])
+  filename = b''
+  preds = []
+  while not reader.at_end():
+    record = reader.byte()
+    if record == ord('F'):
+      filename = reader.string()
+      preds = []
+    elif record == ord('Q'):
+      line = reader.varint()
+      predicted = OUTCOMES[reader.byte()]
+      true = OUTCOMES[reader.byte()]
+      parts = [filename, b':', str(line).encode('ascii'), b'|',
+               predicted.encode('ascii'), b'|',
+               true.encode('ascii'), b'|']
+      for f in range(reader.varint()):
+        code = reader.varint()
+        pred_id = code >> 1
+        if pred_id == len(preds):
+          preds.append(reader.string())
+        parts.append(b' ')
+        parts.append(preds[pred_id])
+        if code & 1:
+          parts.append(('=%g' % reader.float()).encode('ascii'))
+      parts.append(b'\n')
+      out.write(b''.join(parts))
+    else:
+      sys.exit('qa2text: Corrupted binary file of questions and answers.')
+
+
+out = getattr(sys.stdout, 'buffer', sys.stdout)
+if len(sys.argv) > 1:
+  for path in sys.argv[1:]:
+    qa_file = open(path, 'rb')
+    convert(qa_file.read(), out)
+    qa_file.close()
+else:
+  convert(getattr(sys.stdin, 'buffer', sys.stdin).read(), out)
@@ -0,0 +1,62 @@
+#ifndef TASK_QUEUE_INCLUDE_GUARD
+#define TASK_QUEUE_INCLUDE_GUARD
+
+#include <algorithm>
+#include <boost/thread.hpp>
+
+namespace trtok {
+
+/* TaskQueueWorker is run by every worker thread of run_tasks. The workers
+   take the tasks one by one, in order, until there are none left. */
+template <typename Task>
+class TaskQueueWorker {
+
+public:
+    TaskQueueWorker(Task &task, size_t n_tasks, size_t &next_task,
+                    boost::mutex &next_task_mutex):
+        m_task(task),
+        m_n_tasks(n_tasks),
+        m_next_task(next_task),
+        m_next_task_mutex(next_task_mutex)
+    {}
+
+    void operator()() {
+      while (true) {
+        size_t task;
+        {
+          boost::mutex::scoped_lock lock(m_next_task_mutex);
+          if (m_next_task == m_n_tasks)
+            return;
+          task = m_next_task++;
+        }
+        m_task(task);
+      }
+    }
+
+private:
+    Task &m_task;
+    size_t m_n_tasks;
+    size_t &m_next_task;
+    boost::mutex &m_next_task_mutex;
+};
+
+// run_tasks calls task(i) for every i from 0 to n_tasks - 1 on up to
+// n_workers threads and returns when all of the calls are done. The same
+// task object is called by all the threads, so it has to synchronize
+// whatever state it shares between the calls.
+template <typename Task>
+void run_tasks(Task &task, size_t n_tasks, size_t n_workers) {
+  size_t next_task = 0;
+  boost::mutex next_task_mutex;
+  TaskQueueWorker<Task> worker(task, n_tasks, next_task, next_task_mutex);
+
+  boost::thread_group workers;
+  for (size_t w = 0; w < std::min(n_workers, n_tasks); w++) {
+    workers.create_thread(worker);
+  }
+  workers.join_all();
+}
+
+}
+
+#endif
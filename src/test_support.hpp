@@ -0,0 +1,130 @@
+#ifndef TEST_SUPPORT_INCLUDE_GUARD
+#define TEST_SUPPORT_INCLUDE_GUARD
+
+/* The fixtures shared by trtok_microbench and trtok_incremental_test: the
+ * generator of their inputs, the configuration of the FeatureExtractor and
+ * the Classifiers and the training of a model for them. Every program
+ * includes it once. */
+
+#include <string>
+#include <vector>
+#include <map>
+#include <utility>
+#include <pcrecpp.h>
+#include <boost/cstdint.hpp>
+typedef boost::uint32_t uint32_t;
+
+#include "token_t.hpp"
+#include "Classifier.hpp"
+#include "MaxentTrainer.hpp"
+
+namespace trtok {
+
+/* TestGenerator generates texts from a list of words using a fixed linear
+ * congruential generator, so that they are the same on every run and every
+ * platform. */
+class TestGenerator {
+
+public:
+    TestGenerator(char const *const *words, size_t n_words):
+        m_words(words),
+        m_n_words(n_words),
+        m_state(12345)
+    {}
+
+    uint32_t next(uint32_t range) {
+      m_state = m_state * 1103515245u + 12345u;
+      return (m_state >> 16) % range;
+    }
+
+    char const *word() {
+      return m_words[next(m_n_words)];
+    }
+
+    // text returns at least n_bytes of text. Every word is followed by
+    // a space, a newline, two newlines, a no-break space or directly by the
+    // next word.
+    std::string text(size_t n_bytes) {
+      std::string text;
+      while (text.length() < n_bytes) {
+        text += word();
+        uint32_t whitespace = next(100);
+        if (whitespace < 70)
+          text += " ";
+        else if (whitespace < 80)
+          text += "\n";
+        else if (whitespace < 85)
+          text += "\n\n";
+        else if (whitespace < 90)
+          text += "\xc2\xa0";  // NO-BREAK SPACE
+        // otherwise no whitespace follows the word
+      }
+      return text;
+    }
+
+private:
+    char const *const *m_words;
+    size_t m_n_words;
+    uint32_t m_state;
+};
+
+// The properties resemble those of the bundled czeng scheme.
+char const *const regex_property_sources[] = {
+  "\\p{Lu}+", "\\p{Ll}+", "\\p{Lu}.*", "\\p{Ll}.*", "\\p{N}+",
+  "[0-9]{4}", "\\p{P}", "\\p{L}+\\.", "(\\p{L}\\.)+", "\\p{S}"
+};
+char const *const list_property_words[] = {
+  "Mr.", "Dr.", "e.g.", "U.S.", "the", "and", "of", "a", "Praha"
+};
+
+/* The configuration of the FeatureExtractor and the Classifiers. */
+struct properties_t {
+  properties_t() {
+    int n_regex = sizeof(regex_property_sources) / sizeof(char const*);
+    for (int p = 0; p != n_regex; p++) {
+      regex_properties.push_back(pcrecpp::RE(regex_property_sources[p],
+                                             pcrecpp::UTF8()));
+      names.push_back(std::string("regex") + (char)('a' + p));
+    }
+    int n_words = sizeof(list_property_words) / sizeof(char const*);
+    for (int w = 0; w != n_words; w++) {
+      word_to_list_props.insert(
+          std::make_pair(std::string(list_property_words[w]),
+                         n_regex + (w % 3)));
+    }
+    for (int p = 0; p != 3; p++) {
+      names.push_back(std::string("list") + (char)('a' + p));
+    }
+    n_basic_properties = n_regex + 3;
+    names.push_back("%length");
+    names.push_back("%Word");
+  }
+
+  int n_basic_properties;
+  std::vector<pcrecpp::RE> regex_properties;
+  std::multimap<std::string, int> word_to_list_props;
+  std::vector<std::string> names;
+};
+
+// train_model trains a model on the decisions of tokens, whose features
+// have been extracted, and stores it in model_path.
+inline void train_model(properties_t const &properties, bool *features_mask,
+                        int precontext, int postcontext,
+                        std::vector<token_t> tokens,
+                        std::string const &model_path) {
+  Classifier classifier(TRAIN_MODE, properties.names, precontext, postcontext,
+                        features_mask,
+                        std::vector< std::vector< std::pair<int,int> > >());
+  classifier.setup("test");
+  classifier.process_tokens(tokens);
+  MaxentTrainer *trainer_p = classifier.release_events();
+  training_parameters_t parameters;
+  parameters.n_iterations = 10;
+  trainer_p->train(parameters);
+  trainer_p->save(model_path);
+  delete trainer_p;
+}
+
+}
+
+#endif
@@ -37,7 +37,7 @@ struct token_t {
 struct chunk_t {
     chunk_t(): is_final(false), tokens() {}
 
-    //Is this the last chunk of tokens?
+    //Is this the last chunk of tokens of its document?
     bool is_final;
     std::vector<token_t> tokens;
 };
@@ -0,0 +1,75 @@
+#include <string>
+#include <map>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <stdexcept>
+
+#include "training_manifest.hpp"
+#include "feature_hash.hpp"
+
+using namespace std;
+
+namespace trtok {
+
+uint64_t file_fingerprint(string const &path, uint64_t fingerprint) {
+  ifstream file(path.c_str(), ios::binary);
+  if (!file) {
+    throw runtime_error(path + ": Cannot read the file.");
+  }
+  vector<char> buffer(1 << 16);
+  while (file) {
+    file.read(&buffer[0], buffer.size());
+    fingerprint = feature_hash(&buffer[0], file.gcount(), fingerprint);
+  }
+  return fingerprint;
+}
+
+uint64_t scheme_fingerprint(vector<string> const &paths,
+                            string const &settings) {
+  uint64_t fingerprint = feature_hash(settings);
+  for (size_t p = 0; p != paths.size(); p++) {
+    // Only the file name is hashed, the directory depends on where trtok
+    // is installed.
+    size_t slash = paths[p].find_last_of('/');
+    fingerprint = feature_hash(
+        (slash == string::npos) ? paths[p] : paths[p].substr(slash + 1),
+        fingerprint);
+    fingerprint = file_fingerprint(paths[p], fingerprint);
+  }
+  return fingerprint;
+}
+
+/* Every line of the manifest holds the fingerprint in hexadecimal, a space
+   and the path of the input file. */
+void read_training_manifest(string const &path,
+                            training_manifest_t &manifest) {
+  ifstream manifest_file(path.c_str());
+  string line;
+  while (getline(manifest_file, line)) {
+    size_t space = line.find(' ');
+    if (space == string::npos)
+      continue;
+    istringstream fingerprint_stream(line.substr(0, space));
+    uint64_t fingerprint;
+    if (fingerprint_stream >> hex >> fingerprint) {
+      manifest[line.substr(space + 1)] = fingerprint;
+    }
+  }
+}
+
+void write_training_manifest(string const &path,
+                             training_manifest_t const &manifest) {
+  ofstream manifest_file(path.c_str(), ios::trunc);
+  for (training_manifest_t::const_iterator entry = manifest.begin();
+       entry != manifest.end(); entry++) {
+    manifest_file << hex << setw(16) << setfill('0') << entry->second
+                  << ' ' << entry->first << '\n';
+  }
+  if (!manifest_file) {
+    throw runtime_error(path + ": Cannot write the training manifest.");
+  }
+}
+
+}
@@ -0,0 +1,39 @@
+#ifndef TRAINING_MANIFEST_INCLUDE_GUARD
+#define TRAINING_MANIFEST_INCLUDE_GUARD
+
+#include <string>
+#include <map>
+#include <vector>
+#include <boost/cstdint.hpp>
+typedef boost::uint64_t uint64_t;
+
+namespace trtok {
+
+/* The training manifest records which files a model has been trained on.
+   It maps the path of every input file to a fingerprint of the contents of
+   the input file and of its annotated version, so that warm-started training
+   can skip the files which have not changed since. */
+typedef std::map<std::string, uint64_t> training_manifest_t;
+
+// file_fingerprint continues the hash given in fingerprint with the contents
+// of the file at path (see feature_hash).
+uint64_t file_fingerprint(std::string const &path, uint64_t fingerprint = 0);
+
+// scheme_fingerprint hashes the names and the contents of the files at
+// paths and the settings, which together describe everything that affects
+// the events extracted from the training files. It is used to tell whether
+// cached events are still valid.
+uint64_t scheme_fingerprint(std::vector<std::string> const &paths,
+                            std::string const &settings);
+
+// read_training_manifest reads the manifest at path into manifest. A missing
+// manifest is treated as an empty one.
+void read_training_manifest(std::string const &path,
+                            training_manifest_t &manifest);
+
+void write_training_manifest(std::string const &path,
+                             training_manifest_t const &manifest);
+
+}
+
+#endif
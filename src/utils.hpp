@@ -3,11 +3,22 @@
 
 #include <string>
 #include <istream>
+#include <stdexcept>
 #include <boost/cstdint.hpp>
+typedef boost::uint8_t uint8_t;
 typedef boost::uint32_t uint32_t;
+typedef boost::uint64_t uint64_t;
 
+#include "configuration.hpp"
 #include "trtok_clean_entities_EntityCleaner"
 
+// utf8_length counts the characters 16 bytes at a time with SSE2 if it is
+// available.
+#if defined(USE_SIMD) && (defined(__SSE2__) || defined(_M_X64))
+#include <emmintrin.h>
+#define UTF8_USE_SSE2
+#endif
+
 using namespace std;
 
 namespace trtok {
@@ -30,11 +41,17 @@ inline string unicode_to_utf8(basic_string<uint32_t> const &str)
 }
 
 inline bool is_whitespace(uint32_t c) {
-    return ((c >= 0x0009) && (c <= 0x000D)) ||
-            (c == 0x0020) ||
-            (c == 0x0085) ||
-            (c == 0x00A0) ||
-            (c == 0x1680) ||
+    // Latin-1 is looked up in a bitmap of its whitespace characters
+    // (U+0009..U+000D, U+0020, U+0085 and U+00A0), the rest of the
+    // whitespace lies between U+1680 and U+3000.
+    static uint64_t const latin1_whitespace[4] = {
+        0x0000000100003E00ULL, 0, 0x0000000100000020ULL, 0
+    };
+    if (c < 0x100)
+        return (latin1_whitespace[c >> 6] >> (c & 63)) & 1;
+    if (c < 0x1680)
+        return false;
+    return  (c == 0x1680) ||
             (c == 0x180E) ||
            ((c >= 0x2000) && c <= (0x200A)) ||
            ((c >= 0x2028) && (c <= 0x2029)) ||
@@ -48,51 +65,96 @@ inline bool is_newline(uint32_t c) {
             (c == 0x0D);
 }
 
+// utf8_sequence_length gives the length of the UTF-8 sequence starting with
+// the given byte, or 0 if the byte cannot start a sequence: continuation
+// bytes, C0 and C1 (which only start overlong forms of ASCII) and F5 to FF
+// (which would start code points above U+10FFFF).
+inline size_t utf8_sequence_length(uint8_t lead) {
+    if (lead < 0x80)
+        return 1;
+    else if (lead < 0xC2) // 10xxxxxx, a continuation byte, or C0, C1
+        return 0;
+    else if (lead < 0xE0)
+        return 2;
+    else if (lead < 0xF0)
+        return 3;
+    else if (lead < 0xF5)
+        return 4;
+    else
+        return 0;
+}
+
+// utf8_decode_sequence decodes the UTF-8 sequence of the given length (see
+// utf8_sequence_length) starting at p. It throws a domain_error if the
+// sequence lacks continuation bytes, is an overlong form or encodes a UTF-16
+// surrogate or a code point above U+10FFFF.
+inline uint32_t utf8_decode_sequence(uint8_t const *p, size_t length) {
+    static uint32_t const min_codepoint[5] = { 0, 0, 0x80, 0x800, 0x10000 };
+    if (length == 1)
+        return p[0];
+    uint32_t codepoint = p[0] & (0x7F >> length);
+    for (size_t i = 1; i != length; i++) {
+        if ((p[i] & 0xC0) != 0x80)
+            throw std::domain_error
+                ("buffer does not hold a valid UTF-8 character.");
+        codepoint = (codepoint << 6) | (p[i] & 0x3F);
+    }
+    if ((codepoint < min_codepoint[length]) || (codepoint > 0x10FFFF)
+        || ((codepoint >= 0xD800) && (codepoint < 0xE000)))
+        throw std::domain_error
+            ("buffer does not hold a valid UTF-8 character.");
+    return codepoint;
+}
+
 inline uint32_t utf8char_to_unicode(char const *buffer, size_t &offset) {
     // C++ char type is signed, so we cast the array to uint8_t,
     // so the values are interpreted as naturals
-    uint8_t *ubuffer = (uint8_t*)buffer;
-
-    if (ubuffer[offset] >> 7 == 0 /*0xxxxxxx*/) {
-        // An ASCII singleton.
-        uint32_t codepoint = ubuffer[offset];
-        offset++;
-        return codepoint;
-    } else if (ubuffer[offset] >> 5 == 6 /*110xxxxx*/) {
-        // A two-byte sequence
-        uint32_t msb = ubuffer[offset] & 31 /*last 5 bits*/;
-        uint32_t lsb = ubuffer[offset+1] & 63 /*last 6 bits*/;
-        uint32_t codepoint = (msb << 6) | lsb;
-        offset += 2;
-        return codepoint;
-    } else if (ubuffer[offset] >> 4 == 14 /*1110xxxx*/) {
-        // A three-byte sequence
-        uint32_t msb = ubuffer[offset] & 15 /*last 4 bits*/;
-        uint32_t smsb = ubuffer[offset+1] & 63;
-        uint32_t lsb = ubuffer[offset+2] & 63;
-        offset += 3;
-        return (msb << 12) | (smsb << 6) | lsb;
-    } else if (ubuffer[offset] >> 3 == 30 /*11110xxx*/) {
-        // A four-byte sequence
-        uint32_t msb = ubuffer[offset] & 7; /*last 3 bits*/
-        uint32_t smsb = ubuffer[offset+1] & 63;
-        uint32_t slsb = ubuffer[offset+2] & 63;
-        uint32_t lsb = ubuffer[offset+3] & 63;
-        offset += 4;
-        return (msb << 18) | (smsb << 12) | (slsb << 6) | lsb;
-    } else {
+    uint8_t const *ubuffer = (uint8_t const*)buffer + offset;
+
+    size_t length = utf8_sequence_length(*ubuffer);
+    if (length == 0)
         throw std::domain_error
             ("buffer does not hold a valid UTF-8 character.");
+    uint32_t codepoint = utf8_decode_sequence(ubuffer, length);
+    offset += length;
+    return codepoint;
+}
+
+// utf8_length counts the characters of the UTF-8 text between begin and
+// end, i.e. the bytes which are not continuation bytes.
+inline size_t utf8_length(char const *begin, char const *end) {
+    size_t n_chars = 0;
+    char const *p = begin;
+#ifdef UTF8_USE_SSE2
+    // The continuation bytes 10xxxxxx are the signed bytes below -64.
+    __m128i const threshold = _mm_set1_epi8(-64);
+    while (end - p >= 16) {
+        __m128i bytes = _mm_loadu_si128((__m128i const*)p);
+        unsigned mask = _mm_movemask_epi8(_mm_cmplt_epi8(bytes, threshold));
+        // A population count of the continuation bytes' mask.
+        mask = mask - ((mask >> 1) & 0x5555);
+        mask = (mask & 0x3333) + ((mask >> 2) & 0x3333);
+        mask = (mask + (mask >> 4)) & 0x0F0F;
+        n_chars += 16 - ((mask + (mask >> 8)) & 0x1F);
+        p += 16;
     }
+#endif
+    for (; p != end; p++) {
+        if ((*p & 0xC0) != 0x80)
+            n_chars++;
+    }
+    return n_chars;
 }
 
 inline basic_string<uint32_t> utf8_to_unicode(string const &str) {
-    string::size_type i = 0;
     basic_string<uint32_t> codepoints;
-
-    while (i < str.length()) {
-        codepoints.push_back(utf8char_to_unicode(str.data(), i));
-    }
+    codepoints.reserve(str.length());
+    // A sequence cut short by the end of the string is stopped by its
+    // terminating null, which is not a continuation byte.
+    char const *buffer = str.c_str();
+    size_t offset = 0;
+    while (offset != str.length())
+        codepoints.push_back(utf8char_to_unicode(buffer, offset));
 
     return codepoints;
 }
@@ -108,12 +170,10 @@ inline uint32_t get_unicode_from_utf8(std::istream *input_stream_p) {
     input_stream_p->get(buffer[0]);
     if (input_stream_p->gcount() == 0)
         return 0;
-    if (ubuffer[0] >= 192) // 11xxxxxx => at least two bytes
-        input_stream_p->get(buffer[1]);
-    if (ubuffer[0] >= 224) // 111xxxxx => at least three bytes
-        input_stream_p->get(buffer[2]);
-    if (ubuffer[0] >= 240) // 1111xxxx => four bytes
-        input_stream_p->get(buffer[3]);
+    // The continuation bytes are read at once.
+    size_t length = utf8_sequence_length(ubuffer[0]);
+    if (length > 1)
+        input_stream_p->read(buffer + 1, length - 1);
     return utf8char_to_unicode(buffer, offset);
 }
 